@@ -0,0 +1,89 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Boot profile: the end of every setup() phase and the later milestones, in us since chip reset.
+// The clock is 64 bit so it does not wrap like micros(), a phase is only marked once.
+// setup() phases run in sequence, so the time of a phase is its end minus the end of the last phase
+// reached before it. The AP path skip some of them.
+
+enum BootPhase : uint8_t
+{
+  BOOT_FS,         // SPIFFS mount, format on failure and config recovery
+  BOOT_CONFIG,     // load wifi, others and unit config
+  BOOT_MQTT_INIT,  // load mqtt config, topics and client
+  BOOT_WIFI_INIT,  // start station or AP, does not wait
+  BOOT_WEB,        // web server routes
+  BOOT_HP_CONNECT, // open the CN105 serial
+  BOOT_SETUP,      // end of setup()
+  BOOT_WIFI_READY, // station got IP
+  BOOT_HP_STATUS,  // first status from the unit
+  BOOT_MQTT_READY, // first broker connect
+  BOOT_DEFERRED,   // deferred boot work done
+  BOOT_PHASE_COUNT
+};
+
+#define BOOT_SETUP_PHASES (BOOT_SETUP + 1) // phases timed back to back, the rest are milestones
+
+static const char *const bootPhaseName[BOOT_PHASE_COUNT] = {
+    /* BOOT_FS */ "fs",
+    /* BOOT_CONFIG */ "config",
+    /* BOOT_MQTT_INIT */ "mqtt_init",
+    /* BOOT_WIFI_INIT */ "wifi_init",
+    /* BOOT_WEB */ "web",
+    /* BOOT_HP_CONNECT */ "hp_connect",
+    /* BOOT_SETUP */ "setup",
+    /* BOOT_WIFI_READY */ "wifi_ready",
+    /* BOOT_HP_STATUS */ "hp_status",
+    /* BOOT_MQTT_READY */ "mqtt_ready",
+    /* BOOT_DEFERRED */ "deferred"};
+
+uint32_t bootPhaseUs[BOOT_PHASE_COUNT]; // 0 until reached, saturate after 71 minutes
+
+inline uint64_t bootClockUs()
+{
+#ifdef ESP32
+  return esp_timer_get_time();
+#else
+  return micros64();
+#endif
+}
+
+// Mark the end of phase, it can be called from the HP and MQTT tasks
+void bootMark(BootPhase phase)
+{
+  if (bootPhaseUs[phase] != 0)
+    return;
+  uint64_t now = bootClockUs();
+  bootPhaseUs[phase] = now < UINT32_MAX ? (uint32_t)now : UINT32_MAX;
+}
+
+bool bootReached(BootPhase phase)
+{
+  return bootPhaseUs[phase] != 0;
+}
+
+// Time spent in phase, the milestones count from reset
+uint32_t bootPhaseDurationUs(BootPhase phase)
+{
+  if (phase >= BOOT_SETUP_PHASES || bootPhaseUs[phase] == 0)
+    return bootPhaseUs[phase];
+  uint32_t start = 0;
+  for (uint8_t prev = 0; prev < phase; prev++)
+  {
+    if (bootPhaseUs[prev] != 0)
+      start = bootPhaseUs[prev];
+  }
+  return bootPhaseUs[phase] - start;
+}
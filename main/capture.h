@@ -0,0 +1,262 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// CN105 capture for download. Armed, every packet go in a ring that keep the last CAPTURE_SIZE
+// packets as history. The trigger keep up to pre packets before it and record until the ring is
+// full or stopped. A download read the ring one record at a time, it is never copied whole.
+//
+// Binary format, little endian: header "CN105CAP", u8 version 1, u8 0, u16 record count (less
+// records follow when armed history is overwritten during the download),
+// u32 index of the first record after the trigger (0xffffffff when not triggered), then
+// records: u64 us since boot, u8 flags, u8 length, packet bytes.
+// pcap format: LINKTYPE_USER0, each packet start with the flags byte.
+// Flags: bit 0 sent by us, bit 1 checksum valid, bit 2 after the trigger.
+
+#ifdef ESP32
+#define CAPTURE_SIZE 256
+#else
+#define CAPTURE_SIZE 48
+#endif
+#define CAPTURE_PRE_TRIGGER 32 // default history kept before the trigger
+#define CAPTURE_STAGE_SIZE 64  // largest header or record
+
+#define CAPTURE_FLAG_SENT 0x01
+#define CAPTURE_FLAG_CHECKSUM_OK 0x02
+#define CAPTURE_FLAG_TRIGGERED 0x04
+
+enum CaptureState : uint8_t
+{
+  CAPTURE_OFF,
+  CAPTURE_ARMED,     // recording history
+  CAPTURE_TRIGGERED, // recording until the ring is full
+  CAPTURE_STOPPED
+};
+
+static const char *const captureStateName[] = {"off", "armed", "triggered", "stopped"};
+
+struct CaptureEntry
+{
+  uint64_t us;
+  uint8_t flags;
+  uint8_t length;
+  byte data[HP_PACKET_MAX_LEN];
+};
+
+CaptureEntry *captureRing = nullptr; // allocated on first arm, kept so a download never read freed memory
+volatile CaptureState captureState = CAPTURE_OFF;
+uint32_t captureNextSeq = 0;
+uint32_t captureFirstSeq = 0;   // first packet kept after the trigger
+uint32_t captureTriggerSeq = 0; // first packet after the trigger
+bool captureTriggered = false;
+#ifdef ESP32
+portMUX_TYPE captureMux = portMUX_INITIALIZER_UNLOCKED; // HP task write, async_tcp task read
+#define CAPTURE_LOCK() portENTER_CRITICAL(&captureMux)
+#define CAPTURE_UNLOCK() portEXIT_CRITICAL(&captureMux)
+#else
+#define CAPTURE_LOCK()
+#define CAPTURE_UNLOCK()
+#endif
+
+static uint32_t captureOldestSeq()
+{
+  return captureNextSeq > CAPTURE_SIZE ? captureNextSeq - CAPTURE_SIZE : 0;
+}
+
+// CN105 checksum: 0xfc minus the sum of all bytes before it
+static bool captureChecksumOk(const byte *packet, uint8_t length)
+{
+  if (length < 2)
+    return false;
+  uint8_t sum = 0;
+  for (uint8_t idx = 0; idx < length - 1; idx++)
+    sum += packet[idx];
+  return (uint8_t)(0xfc - sum) == packet[length - 1];
+}
+
+// Packet callback
+void captureAdd(const byte *packet, unsigned int length, bool sent)
+{
+  if (captureState != CAPTURE_ARMED && captureState != CAPTURE_TRIGGERED)
+    return;
+  uint64_t us = bootClockUs();
+  CAPTURE_LOCK();
+  if (captureState == CAPTURE_TRIGGERED && captureNextSeq - captureFirstSeq >= CAPTURE_SIZE)
+  {
+    captureState = CAPTURE_STOPPED; // full, keep the history before the trigger
+  }
+  else if (captureState != CAPTURE_STOPPED)
+  {
+    CaptureEntry &entry = captureRing[captureNextSeq % CAPTURE_SIZE];
+    entry.us = us;
+    entry.length = min(length, (unsigned int)HP_PACKET_MAX_LEN);
+    memcpy(entry.data, packet, entry.length);
+    entry.flags = (sent ? CAPTURE_FLAG_SENT : 0) | (captureChecksumOk(packet, length) ? CAPTURE_FLAG_CHECKSUM_OK : 0) |
+                  (captureState == CAPTURE_TRIGGERED ? CAPTURE_FLAG_TRIGGERED : 0);
+    captureNextSeq++;
+  }
+  CAPTURE_UNLOCK();
+}
+
+// Start recording history, a new capture drop the previous one. False when out of memory
+bool captureArm()
+{
+  if (captureRing == nullptr)
+    captureRing = (CaptureEntry *)malloc(sizeof(CaptureEntry) * CAPTURE_SIZE);
+  if (captureRing == nullptr)
+    return false;
+  CAPTURE_LOCK();
+  captureNextSeq = 0;
+  captureFirstSeq = 0;
+  captureTriggerSeq = 0;
+  captureTriggered = false;
+  captureState = CAPTURE_ARMED;
+  CAPTURE_UNLOCK();
+  return true;
+}
+
+// Keep up to pre packets of history and record what follow
+bool captureTrigger(uint16_t pre)
+{
+  if (captureState != CAPTURE_ARMED && !captureArm())
+    return false;
+  CAPTURE_LOCK();
+  uint32_t history = min((uint32_t)min(pre, (uint16_t)(CAPTURE_SIZE - 1)), captureNextSeq - captureOldestSeq()); // leave room after the trigger
+  captureTriggerSeq = captureNextSeq;
+  captureFirstSeq = captureNextSeq - history;
+  captureTriggered = true;
+  captureState = CAPTURE_TRIGGERED;
+  CAPTURE_UNLOCK();
+  return true;
+}
+
+void captureStop()
+{
+  if (captureState != CAPTURE_OFF)
+    captureState = CAPTURE_STOPPED;
+}
+
+// Stop recording, the last capture can still be downloaded until the next arm
+void captureOff()
+{
+  captureState = CAPTURE_OFF;
+}
+
+// Packets a download would return now, and where the trigger is among them
+void captureRange(uint32_t &first, uint32_t &end, uint32_t &trigger)
+{
+  CAPTURE_LOCK();
+  first = max(captureTriggered ? captureFirstSeq : 0, captureOldestSeq());
+  end = captureNextSeq;
+  trigger = captureTriggered ? captureTriggerSeq : UINT32_MAX;
+  CAPTURE_UNLOCK();
+}
+
+// Cursor of one download, lives in the chunked response filler
+struct CaptureStream
+{
+  uint32_t seq;
+  uint32_t end;
+  uint32_t trigger;
+  bool pcap;
+  bool headerDone;
+  uint8_t stagedLen;
+  uint8_t stagedPos;
+  uint8_t staged[CAPTURE_STAGE_SIZE];
+};
+
+void captureStreamBegin(CaptureStream &stream, bool pcap)
+{
+  captureRange(stream.seq, stream.end, stream.trigger);
+  stream.pcap = pcap;
+  stream.headerDone = false;
+  stream.stagedLen = 0;
+  stream.stagedPos = 0;
+}
+
+static void captureStagePut(CaptureStream &stream, const void *data, uint8_t length)
+{
+  memcpy(stream.staged + stream.stagedLen, data, length);
+  stream.stagedLen += length;
+}
+
+// Stage the file header or the next record, false at the end of the capture
+static bool captureStageNext(CaptureStream &stream)
+{
+  stream.stagedLen = 0;
+  stream.stagedPos = 0;
+  if (!stream.headerDone)
+  {
+    stream.headerDone = true;
+    if (stream.pcap)
+    {
+      const uint32_t header[] = {0xa1b2c3d4, 0x00040002, 0, 0, CAPTURE_STAGE_SIZE, 147}; // v2.4, snaplen, LINKTYPE_USER0
+      captureStagePut(stream, header, sizeof(header));
+    }
+    else
+    {
+      uint8_t version[] = {1, 0};
+      uint16_t count = stream.end - stream.seq;
+      uint32_t trigger = stream.trigger == UINT32_MAX ? UINT32_MAX : stream.trigger - stream.seq;
+      captureStagePut(stream, "CN105CAP", 8);
+      captureStagePut(stream, version, sizeof(version));
+      captureStagePut(stream, &count, sizeof(count));
+      captureStagePut(stream, &trigger, sizeof(trigger));
+    }
+    return true;
+  }
+  CaptureEntry entry;
+  bool found = false;
+  CAPTURE_LOCK();
+  stream.seq = max(stream.seq, captureOldestSeq()); // armed history overwritten while reading
+  if (stream.seq < stream.end && stream.seq < captureNextSeq)
+  {
+    entry = captureRing[stream.seq % CAPTURE_SIZE];
+    found = true;
+  }
+  CAPTURE_UNLOCK();
+  if (!found)
+    return false;
+  stream.seq++;
+  if (stream.pcap)
+  {
+    uint32_t record[] = {(uint32_t)(entry.us / 1000000), (uint32_t)(entry.us % 1000000), entry.length + 1u, entry.length + 1u};
+    captureStagePut(stream, record, sizeof(record));
+    captureStagePut(stream, &entry.flags, 1);
+  }
+  else
+  {
+    captureStagePut(stream, &entry.us, sizeof(entry.us));
+    captureStagePut(stream, &entry.flags, 1);
+    captureStagePut(stream, &entry.length, 1);
+  }
+  captureStagePut(stream, entry.data, entry.length);
+  return true;
+}
+
+// Chunked response filler, return 0 at the end
+size_t captureStreamRead(CaptureStream &stream, uint8_t *buffer, size_t maxLen)
+{
+  size_t written = 0;
+  while (written < maxLen)
+  {
+    if (stream.stagedPos == stream.stagedLen && !captureStageNext(stream))
+      break;
+    size_t length = min(maxLen - written, (size_t)(stream.stagedLen - stream.stagedPos));
+    memcpy(buffer + written, stream.staged + stream.stagedPos, length);
+    stream.stagedPos += length;
+    written += length;
+  }
+  return written;
+}
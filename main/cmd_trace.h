@@ -0,0 +1,198 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Trace of a set command from the MQTT message to the state publish that confirm it.
+// The HP library merge commands into one update, so one trace is in flight and a newer
+// command take it over, also from another unit. Each command kind keep its last CMD_TRACE_WINDOW ack and state
+// latencies, the percentiles are read from a sorted copy.
+
+#define CMD_TRACE_WINDOW 16
+#define CMD_TRACE_TIMEOUT_MS 30000 // no state publish by then, the command did not change the unit
+
+enum CmdTraceKind : uint8_t
+{
+  CMD_TRACE_POWER,
+  CMD_TRACE_MODE,
+  CMD_TRACE_TEMP,
+  CMD_TRACE_FAN,
+  CMD_TRACE_VANE,
+  CMD_TRACE_WIDE_VANE,
+  CMD_TRACE_REMOTE_TEMP,
+  CMD_TRACE_KIND_COUNT
+};
+
+static const char *const cmdTraceKindName[CMD_TRACE_KIND_COUNT] = {
+    /* CMD_TRACE_POWER */ "power",
+    /* CMD_TRACE_MODE */ "mode",
+    /* CMD_TRACE_TEMP */ "temp",
+    /* CMD_TRACE_FAN */ "fan",
+    /* CMD_TRACE_VANE */ "vane",
+    /* CMD_TRACE_WIDE_VANE */ "wide_vane",
+    /* CMD_TRACE_REMOTE_TEMP */ "remote_temp"};
+
+enum CmdTraceStage : uint8_t
+{
+  CMD_TRACE_RECV,     // mqttCallback
+  CMD_TRACE_SENT,     // hp.update() write the set packet
+  CMD_TRACE_ACK,      // unit ack the set packet
+  CMD_TRACE_SETTINGS, // settings callback with the new settings
+  CMD_TRACE_STATE,    // state published
+  CMD_TRACE_STAGE_COUNT
+};
+
+static const char *const cmdTraceStageName[CMD_TRACE_STAGE_COUNT] = {
+    /* CMD_TRACE_RECV */ "recv",
+    /* CMD_TRACE_SENT */ "sent",
+    /* CMD_TRACE_ACK */ "ack",
+    /* CMD_TRACE_SETTINGS */ "settings",
+    /* CMD_TRACE_STATE */ "state"};
+
+struct CmdTrace
+{
+  uint16_t id; // 0 when no trace is in flight
+  uint8_t unit;
+  CmdTraceKind kind;
+  uint32_t startMs;
+  uint32_t stageUs[CMD_TRACE_STAGE_COUNT]; // micros() at each stage, 0 until reached
+};
+
+struct CmdLatencyWindow
+{
+  uint16_t ackMs[CMD_TRACE_WINDOW];
+  uint16_t stateMs[CMD_TRACE_WINDOW];
+  uint8_t next;
+  uint8_t size;
+  uint32_t count;
+};
+
+CmdTrace cmdTrace = {};
+CmdLatencyWindow cmdLatency[CMD_TRACE_KIND_COUNT];
+uint16_t cmdTraceNextId = 1;
+TelemetryCounter cmdTraceTimeouts("command_trace_timeouts_total", "Commands without a confirming state in 30 s");
+#ifdef ESP32
+portMUX_TYPE cmdTraceMux = portMUX_INITIALIZER_UNLOCKED; // MQTT, HP task and loop() all stamp the trace
+#define CMD_TRACE_LOCK() portENTER_CRITICAL(&cmdTraceMux)
+#define CMD_TRACE_UNLOCK() portEXIT_CRITICAL(&cmdTraceMux)
+#else
+#define CMD_TRACE_LOCK()
+#define CMD_TRACE_UNLOCK()
+#endif
+
+// Start a trace for a command just received, return its id
+uint16_t cmdTraceBegin(uint8_t unit, CmdTraceKind kind)
+{
+  CMD_TRACE_LOCK();
+  if (cmdTrace.id != 0 && cmdTrace.stageUs[CMD_TRACE_ACK] == 0 && millis() - cmdTrace.startMs > CMD_TRACE_TIMEOUT_MS)
+    cmdTraceTimeouts.add();
+  cmdTrace = {};
+  cmdTrace.id = cmdTraceNextId++;
+  if (cmdTraceNextId == 0)
+    cmdTraceNextId = 1;
+  cmdTrace.unit = unit;
+  cmdTrace.kind = kind;
+  cmdTrace.startMs = millis();
+  cmdTrace.stageUs[CMD_TRACE_RECV] = micros() | 1;
+  uint16_t id = cmdTrace.id;
+  CMD_TRACE_UNLOCK();
+  return id;
+}
+
+// Stamp a stage of the trace in flight of unit, stages only move forward
+void cmdTraceMark(uint8_t unit, CmdTraceStage stage)
+{
+  CMD_TRACE_LOCK();
+  if (cmdTrace.id != 0 && cmdTrace.unit == unit && cmdTrace.stageUs[stage] == 0 && cmdTrace.stageUs[stage - 1] != 0)
+    cmdTrace.stageUs[stage] = micros() | 1;
+  CMD_TRACE_UNLOCK();
+}
+
+// Set packet ack from the packet callback
+void cmdTracePacket(uint8_t unit, const byte *packet, unsigned int length, const char *direction)
+{
+  if (length > 1 && packet[1] == 0x61 && strcmp(direction, "packetRecv") == 0)
+    cmdTraceMark(unit, CMD_TRACE_ACK);
+}
+
+static uint16_t cmdTraceMs(const CmdTrace &trace, CmdTraceStage stage)
+{
+  return min((trace.stageUs[stage] - trace.stageUs[CMD_TRACE_RECV]) / 1000, (uint32_t)UINT16_MAX);
+}
+
+// The state of unit is about to be published, close the trace when the unit acked it. Copy the closed
+// trace into done and return its id to echo in the state, 0 if no trace ended
+uint16_t cmdTraceComplete(uint8_t unit, CmdTrace &done)
+{
+  uint16_t id = 0;
+  CMD_TRACE_LOCK();
+  if (cmdTrace.id != 0 && millis() - cmdTrace.startMs > CMD_TRACE_TIMEOUT_MS)
+  {
+    cmdTraceTimeouts.add();
+    cmdTrace.id = 0;
+  }
+  if (cmdTrace.id != 0 && cmdTrace.unit == unit && cmdTrace.stageUs[CMD_TRACE_ACK] != 0)
+  {
+    cmdTrace.stageUs[CMD_TRACE_STATE] = micros() | 1;
+    CmdLatencyWindow &window = cmdLatency[cmdTrace.kind];
+    window.ackMs[window.next] = cmdTraceMs(cmdTrace, CMD_TRACE_ACK);
+    window.stateMs[window.next] = cmdTraceMs(cmdTrace, CMD_TRACE_STATE);
+    window.next = (window.next + 1) % CMD_TRACE_WINDOW;
+    window.size = min(window.size + 1, CMD_TRACE_WINDOW);
+    window.count++;
+    done = cmdTrace;
+    id = cmdTrace.id;
+    cmdTrace.id = 0;
+  }
+  CMD_TRACE_UNLOCK();
+  return id;
+}
+
+// Milliseconds from recv to stage of a closed trace, 0 if the stage was not seen
+uint32_t cmdTraceStageMs(const CmdTrace &trace, CmdTraceStage stage)
+{
+  return trace.stageUs[stage] ? cmdTraceMs(trace, stage) : 0;
+}
+
+struct CmdLatencyPercentiles
+{
+  uint16_t p50;
+  uint16_t p95;
+  uint16_t p99;
+  uint8_t size;
+};
+
+// Percentiles of the ack (ack true) or state latencies of a kind
+CmdLatencyPercentiles cmdLatencyGet(CmdTraceKind kind, bool ack)
+{
+  uint16_t sorted[CMD_TRACE_WINDOW];
+  CMD_TRACE_LOCK();
+  const CmdLatencyWindow &window = cmdLatency[kind];
+  uint8_t size = window.size;
+  memcpy(sorted, ack ? window.ackMs : window.stateMs, sizeof(sorted));
+  CMD_TRACE_UNLOCK();
+  telemetrySort(sorted, size);
+  CmdLatencyPercentiles result = {0, 0, 0, size};
+  if (size > 0)
+  {
+    result.p50 = telemetryPercentile(sorted, size, 50);
+    result.p95 = telemetryPercentile(sorted, size, 95);
+    result.p99 = telemetryPercentile(sorted, size, 99);
+  }
+  return result;
+}
+
+uint32_t cmdLatencyCount(CmdTraceKind kind)
+{
+  return cmdLatency[kind].count;
+}
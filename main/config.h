@@ -26,6 +26,8 @@ extern "C"
 {
 #include "freertos/FreeRTOS.h" //AsyncMqttClient
 #include "freertos/timers.h"
+#include "freertos/queue.h"    // HP task command and event queues
+#include "freertos/semphr.h"
 }
 #include "esp_ota_ops.h"       // IDF api to get app version
 #include "esp_app_format.h"    // IDF api to get app version infor
@@ -33,6 +35,7 @@ extern "C"
 #include "nvs_flash.h"         //nvs ESP IDF to save wifi settings
 #include "esp_flash_encrypt.h" //encryption check
 #include "esp_secure_boot.h"   //secure boot check
+#include "esp_pm.h"            // dynamic frequency scaling when idle
 #else
 #include <ESP8266WiFi.h> // WIFI for ESP8266
 #include <WiFiClient.h>
@@ -54,11 +57,15 @@ AsyncEventSource events("/events"); // Create an Event Source on /events
 #include <math.h>        // for rounding to Fahrenheit values
 #include <ArduinoOTA.h>  // for OTA
 // #define ARDUINO_OTA 1      // Uncomment to enable Arduino OTA over ip
+// #define FAST_BOOT 1        // Uncomment to run log cleanup, mDNS and discovery after the first HP status and MQTT connect
 
 #include <HeatPump.h> // SwiCago library: https://github.com/SwiCago/HeatPump
 #include <Ticker.h>   // for LED status (Using a Wemos D1-Mini)
 #include "time.h"     // time lib
 
+// Counters, gauges and histograms shared by all subsystems
+#include "telemetry.h"
+
 #ifdef ESP32
 // Let Encrypt isrgrootx1.pem
 const char rootCA_LE[] = R"====(
@@ -110,7 +117,26 @@ Ticker wifiReconnectTimer; // timer for esp8266 AsyncMqttClient
 #endif
 
 bool mqtt_connected = false;
+bool mqttClosing = false; // the client is closed to apply new config, do not reconnect it
+unsigned long mqttClosingAt;
 uint8_t mqtt_disconnect_reason = -1;
+TelemetryGauge mqttConnectedGauge("mqtt_connected", "1 while connected to the MQTT broker");
+TelemetryCounter mqttPublishes("mqtt_publishes_total", "MQTT messages queued for publish"); // see mqttPublish()
+TelemetryCounter mqttPublishFailures("mqtt_publish_failures_total", "MQTT messages that could not be queued");
+TelemetryCounter mqttConnects("mqtt_connects_total", "MQTT connections to the broker");
+TelemetryCounter mqttDisconnects("mqtt_disconnects_total", "MQTT connections lost or closed");
+TelemetryCounter wifiDisconnects("wifi_disconnects_total", "Wi-Fi connections lost");
+TelemetryCounter httpRequests("http_requests_total", "Web page and API requests checked for login");
+TelemetryCounter httpAuthFailures("http_auth_failures_total", "Web page and API requests refused without login");
+// Sampled by telemetryRefresh() before each export
+TelemetryGauge uptimeGauge("uptime_seconds", "Time since boot");
+TelemetryGauge heapFreeGauge("heap_free_bytes", "Free heap");
+TelemetryGauge heapMinFreeGauge("heap_min_free_bytes", "Lowest free heap since boot");
+TelemetryGauge heapLargestBlockGauge("heap_largest_block_bytes", "Largest free heap block");
+TelemetryGauge wifiRssiGauge("wifi_rssi_dbm", "Wi-Fi signal strength");
+#ifdef ESP8266
+uint32_t heapMinFreeBytes = UINT32_MAX; // lowest free heap seen by loop()
+#endif
 
 Ticker ticker;
 
@@ -123,20 +149,105 @@ DNSServer dnsServer;
 boolean captive = false;
 boolean mqtt_config = false;
 boolean wifi_config = false;
-boolean remoteTempActive = false;
 
 // HVAC
-HeatPump hp;
-unsigned long lastAliveMsgSend;
+#ifdef ESP32
+// Extra indoor units on the other UARTs, {RX, TX} pins of each. The second unit use Serial2, a third one use Serial
+// and need the first unit on custom pins. Each unit get its own topics under <topic>/<name>/unitN and its own HA device.
+// The web pages control the first unit. Uncomment to enable
+// #define HP_EXTRA_UNIT_PINS {16, 17}
+// #define HP_EXTRA_UNIT_PINS {16, 17}, {3, 1}
+#endif
+#ifdef HP_EXTRA_UNIT_PINS
+const PROGMEM int8_t hpExtraUnitPins[][2] = {HP_EXTRA_UNIT_PINS};
+#define HP_UNIT_MAX (1 + sizeof(hpExtraUnitPins) / sizeof(hpExtraUnitPins[0]))
+static_assert(HP_UNIT_MAX <= 3, "the ESP32 has 3 UARTs");
+#else
+#define HP_UNIT_MAX 1
+#endif
+bool hpHasUart(uint8_t unit);
+// unit label of the per unit metrics, the first unit has none
+static const char *const hpUnitLabel[3] = {nullptr, "2", "3"};
+HeatPump hp[HP_UNIT_MAX];
 unsigned long lastTempSend;
 unsigned long lastMqttRetry;
-unsigned long lastHpSync;
-unsigned int hpConnectionRetries;
-unsigned int hpConnectionTotalRetries;
-unsigned long lastRemoteTemp;
+
+// HVAC commands from MQTT and web, on ESP32 they are queued to the task owning the CN105 link
+#define HP_COMMAND_TEXT_SIZE 20 // longest setting name or a custom packet
+#define HP_PACKET_MAX_LEN 32    // debug packet log entry, CN105 packets are 22 bytes
+enum HpCommandType : uint8_t
+{
+  HP_CMD_POWER,
+  HP_CMD_MODE,
+  HP_CMD_TEMPERATURE,
+  HP_CMD_FAN,
+  HP_CMD_VANE,
+  HP_CMD_WIDE_VANE,
+  HP_CMD_REMOTE_TEMP,
+  HP_CMD_CUSTOM_PACKET,
+  HP_CMD_UPDATE // send wanted settings if they changed
+};
+
+struct HpCommand
+{
+  HpCommandType type;
+  uint8_t unit;
+  uint8_t length; // custom packet length
+  float value;
+  char text[HP_COMMAND_TEXT_SIZE];
+};
+
+#ifdef ESP32
+enum HpEventType : uint8_t
+{
+  HP_EVT_SETTINGS,
+  HP_EVT_STATUS
+};
+
+// HP callbacks are run by loop() from these events, debug packets go through the packet log
+struct HpEvent
+{
+  HpEventType type;
+  uint8_t unit;
+};
+
+// Snapshot of the HP object for the other tasks, only the HP task touch hp
+struct HpState
+{
+  heatpumpSettings settings;
+  heatpumpStatus status;
+  unsigned long lastWanted;
+  bool connected;
+};
+
+TaskHandle_t hpTaskHandle = nullptr;
+QueueHandle_t hpCommandQueue = nullptr;
+QueueHandle_t hpEventQueue = nullptr;
+HpState hpState[HP_UNIT_MAX] = {};
+portMUX_TYPE hpStateMux = portMUX_INITIALIZER_UNLOCKED;
+#define HP_STATE_LOCK() portENTER_CRITICAL(&hpStateMux)
+#define HP_STATE_UNLOCK() portEXIT_CRITICAL(&hpStateMux)
+bool hpUpdatePending[HP_UNIT_MAX] = {}; // HP task only
+uint32_t hpUpdateDue[HP_UNIT_MAX];
+HardwareSerial *hpSerial[HP_UNIT_MAX] = {}; // nullptr for a unit without UART
+volatile uint32_t hpRxFrameUs[HP_UNIT_MAX] = {}; // set by the UART event task at the end of a frame, 0 once handled
+uint32_t hpFrameLatencyLastUs = 0;  // frame end to HP packet callback
+uint32_t hpFrameLatencyMaxUs = 0;
+static const uint32_t hpFrameLatencyBoundsUs[] = {100, 500, 1000, 5000, 10000, 50000};
+TelemetryCounter hpFrames("hp_frames_total", "CN105 frames received");
+TelemetryHistogram<6> hpFrameLatency("hp_frame_latency_us", "Time from the end of a CN105 frame to its handler", hpFrameLatencyBoundsUs);
+#endif
 
 // Local state
-StaticJsonDocument<JSON_OBJECT_SIZE(12)> rootInfo;
+StaticJsonDocument<JSON_OBJECT_SIZE(17)> rootInfo[HP_UNIT_MAX];
+#ifdef ESP32
+SemaphoreHandle_t rootInfoMutex = nullptr; // MQTT callbacks and loop() both write rootInfo
+#define ROOT_INFO_LOCK() xSemaphoreTakeRecursive(rootInfoMutex, portMAX_DELAY)
+#define ROOT_INFO_UNLOCK() xSemaphoreGiveRecursive(rootInfoMutex)
+#else
+#define ROOT_INFO_LOCK()
+#define ROOT_INFO_UNLOCK()
+#endif
 String wifi_list = "";                            // cache wifi scan result
 const String localApIpUrl = "http://8.8.8.8";     // a string version of the local IP with http, used for redirecting clients to your webpage
 String unique_id = "";                            // cache board unique id
@@ -145,15 +256,36 @@ String unique_id = "";                            // cache board unique id
 int uploaderror = 0;
 size_t ota_content_len;
 
+// Deferred and periodic work run from loop()
+#include "scheduler.h"
+// loop() stage timing and stall attribution
+#include "loop_stats.h"
+// Packet debug ring buffer
+#include "packet_log.h"
+// Set command latency tracing
+#include "cmd_trace.h"
+// Boot phase timestamps
+#include "boot_profile.h"
+// CN105 capture download
+#include "capture.h"
+#ifdef WEBSOCKET_ENABLE
+// Web socket message reassembly
+#include "ws_message.h"
+#endif
+// Web socket and event source client limits
+#include "web_clients.h"
 // For Asynce reboot after timeout
 bool requestReboot = false;
-unsigned long requestRebootTime = 0;
-// For MQTTAsync hp update callback
-bool requestHpUpdate = false;
-unsigned long requestHpUpdateTime = 0;
-// For async wifi scan
-bool requestWifiScan = false;
-unsigned long requestWifiScanTime = 0;
+// For async apply config changes without reboot, bitmask of APPLY_* flags
+#define APPLY_WIFI (1 << 0)
+#define APPLY_MQTT (1 << 1)
+#define APPLY_UNIT (1 << 2)
+#define APPLY_OTHERS (1 << 3)
+uint8_t requestConfigApply = 0;
+bool webServerStarted = false; // web panel server listening, can change at run time
+// For deferred config file writes, bitmask of APPLY_* flags with unsaved changes
+uint8_t requestConfigSave = 0;
+TelemetryCounter configWrites("config_writes_total", "Config files written to flash, kept across reboots in writes_file");
 #define WIFI_SCAN_PERIOD 120000
 unsigned lastWifiScanMillis;
 
@@ -168,6 +300,7 @@ const PROGMEM char *mqtt_conf = "/mqtt.json";
 const PROGMEM char *unit_conf = "/unit.json";
 const PROGMEM char *console_file = "/console.log";
 const PROGMEM char *others_conf = "/others.json";
+const PROGMEM char *writes_file = "/config_writes.txt";
 // pinouts
 const PROGMEM uint8_t blueLedPin = 2; // The ESP32 has an internal blue LED at D2 (GPIO 02)
 // keep LED off (check board schematic)
@@ -178,6 +311,7 @@ const PROGMEM char *mqtt_conf = "mqtt.json";
 const PROGMEM char *unit_conf = "unit.json";
 const PROGMEM char *console_file = "console.log";
 const PROGMEM char *others_conf = "others.json";
+const PROGMEM char *writes_file = "config_writes.txt";
 // pinouts
 const PROGMEM uint8_t blueLedPin = LED_BUILTIN; // Onboard LED = digital pin 2 "D4" (blue LED on WEMOS D1-Mini)
 // keep LED off (For Wemos D1-Mini), Other board check the schematic
@@ -195,7 +329,16 @@ static const char *const TAG = "mitsu_cn105";
 
 unsigned long wifi_timeout;
 unsigned long wifi_reconnect_timeout;
-unsigned long mqtt_reconnect_timeout;
+
+// Wifi bring-up run from events and the scheduler, setup() does not wait for it
+enum WifiState : uint8_t
+{
+  WIFI_STATE_OFF,
+  WIFI_STATE_CONNECTING, // association and DHCP, AP fallback after WIFI_CONNECT_TIMEOUT_MS
+  WIFI_STATE_CONNECTED,
+  WIFI_STATE_AP
+};
+volatile WifiState wifiState = WIFI_STATE_OFF;
 
 String hostname = "";
 String ap_ssid;
@@ -237,28 +380,8 @@ bool others_haa;
 String others_haa_topic;
 String timezone = "ICT-7"; // Set timezone to Vietnam Standard Time
 
-// Define global variables for HA topics
-String ha_power_set_topic;
-String ha_mode_set_topic;
-String ha_temp_set_topic;
-String ha_remote_temp_set_topic;
-String ha_fan_set_topic;
-String ha_vane_set_topic;
-String ha_wide_vane_set_topic;
-String ha_state_topic;
-String ha_system_info_topic;
-String ha_system_set_topic;
-String ha_system_setting_info;
-String ha_system_setting_request;
-String ha_system_setting_respond;
-String ha_debug_pckts_topic;
-String ha_debug_pckts_set_topic;
-String ha_debug_logs_topic;
-String ha_debug_logs_set_topic;
-String ha_discovery_topic;
-String ha_custom_packet;
-String ha_availability_topic;
-String ha_birth_topic;
+// HA topics
+#include "mqtt_topics.h"
 String hvac_name;
 
 // login
@@ -285,13 +408,66 @@ const PROGMEM uint32_t SEND_ALIVE_MSG_INTERVAL_MS = 30000; // interval send mqtt
 const PROGMEM uint32_t SEND_ROOM_TEMP_INTERVAL_MS = 30000; // 45 seconds (anything less may cause bouncing)
 const PROGMEM uint32_t WIFI_RETRY_INTERVAL_MS = 300000;
 const PROGMEM uint32_t WIFI_RECONNECT_INTERVAL_MS = 10000;     // 10 seconds
+const PROGMEM uint32_t WIFI_CONNECT_TIMEOUT_MS = 35000;        // association and DHCP at boot, then fall back to AP mode
+const PROGMEM uint32_t BOOT_DEFER_MAX_MS = 60000;              // fast boot run the deferred work by then even without HP or MQTT
 const PROGMEM uint32_t CHECK_REMOTE_TEMP_INTERVAL_MS = 300000; // 5 minutes
+const PROGMEM uint32_t TEMP_FUSION_CHECK_MS = 10000;           // stale sensor sources and fusion diagnostics
+const PROGMEM uint32_t PACKET_LOG_PUBLISH_MS = 1000;           // drain the debug packets per interval
+const PROGMEM uint32_t PACKET_LOG_BUSY_MS = 20;                // drain again soon when the MQTT outbox stopped it
 const PROGMEM uint32_t MQTT_RETRY_INTERVAL_MS = 1000;          // 1 second
 const PROGMEM uint32_t MQTT_RECONNECT_INTERVAL_MS = 10000;     // 10 seconds
+const PROGMEM uint32_t MQTT_CLOSE_POLL_MS = 50;                // check the closing client, the offline message go out first
+const PROGMEM uint32_t MQTT_CLOSE_WAIT_MS = 3000;              // then close it by force
 const PROGMEM uint32_t REBOOT_REQUEST_INTERVAL_MS = 1000;      // 1 seconds
+const PROGMEM uint32_t CONFIG_APPLY_DELAY_MS = 1000;           // let the web response go out before applying new config
+const PROGMEM size_t API_CONFIG_MAX_SIZE = 6144;               // bulk config import body, fit a root CA cert
+const PROGMEM uint32_t CONFIG_SAVE_QUIET_MS = 5000;            // write changed config to flash after 5 seconds without changes
+const PROGMEM uint32_t WIFI_WATCHDOG_INTERVAL_MS = 1000;       // check wifi connection every 1 second
+const PROGMEM uint32_t LOOP_IDLE_MAX_MS = 20;                  // longest loop() sleep, HP serial and DNS are still polled
 const PROGMEM uint32_t HP_RETRY_INTERVAL_MS = 1000;            // 1 second
 const PROGMEM uint32_t HP_MAX_RETRIES = 10;                    // Double the interval between retries up to this many times, then keep retrying forever at that maximum interval.
-// Default values give a final retry interval of 1000ms * 2^10, which is 1024 seconds, about 17 minutes.
+// Default values give a final retry interval of 1000ms * 2^10, which is 1024 seconds, about 17 minutes. Retries wait a random
+// time up to that interval, UART activity restart the backoff from the start
+const PROGMEM uint32_t HP_LINK_CHECK_MS = 50;                  // ESP8266 look for UART activity this often while the link is down, ESP32 use HP_TASK_IDLE_MS
+const PROGMEM uint32_t HP_LINK_WAKE_HOLDOFF_MS = 30000;        // a noisy line restart the backoff at most this often
+const PROGMEM uint32_t HP_UPDATE_DELAY_MS = 10;                // merge settings arriving together into one update packet
+// Info request polling: the floor after a command, a remote change or a compressor change, then the interval
+// double at each poll without change up to the ceiling. Defaults of the poll_* unit config, see loadUnit()
+const PROGMEM uint32_t HP_POLL_MIN_MS = 500;
+const PROGMEM uint32_t HP_POLL_ON_MAX_MS = 4000;               // power on
+const PROGMEM uint32_t HP_POLL_OFF_MAX_MS = 8000;              // power off
+const PROGMEM uint32_t HP_POLL_FLOOR_MS = 200;                 // lowest setting, the unit need time to answer
+const PROGMEM uint32_t HP_POLL_LIMIT_MS = 9000;                // highest setting, the library reconnect after 10 s of silence
+const PROGMEM uint32_t HP_EXT_GAP_MS = 1000;                   // extended request at least this far from a core request
+const PROGMEM uint32_t HP_EXT_POLL_MS = 60000;                 // extended reply older than this is requested again
+#ifdef ESP32
+const PROGMEM uint32_t HP_TASK_IDLE_MS = 50;                   // wake this often while the link is down or an update wait, else sleep to the next poll
+const PROGMEM uint8_t HP_RX_TIMEOUT_SYMBOLS = 2;               // UART idle time that mark the end of a CN105 frame
+const PROGMEM uint32_t HP_TASK_STACK_SIZE = 4096;
+const PROGMEM UBaseType_t HP_TASK_PRIORITY = 5;                // above loop, AsyncTCP and MQTT tasks for steady serial timing
+const PROGMEM BaseType_t HP_TASK_CORE = portNUM_PROCESSORS - 1; // away from the wifi core when there are two
+const PROGMEM UBaseType_t HP_COMMAND_QUEUE_LEN = 16;
+const PROGMEM UBaseType_t HP_EVENT_QUEUE_LEN = 16;
+const PROGMEM uint32_t HP_COMMAND_TIMEOUT_MS = 100;             // wait for room in the command queue
+#endif
+
+// Adaptive info request polling per unit, run where hp.sync() run. Set by hpPollBoost() at connect
+uint32_t hpPollMinMs = HP_POLL_MIN_MS; // unit config, ceilings are never under the floor
+uint32_t hpPollOnMaxMs = HP_POLL_ON_MAX_MS;
+uint32_t hpPollOffMaxMs = HP_POLL_OFF_MAX_MS;
+uint32_t hpPollIntervalMs[HP_UNIT_MAX];
+uint32_t hpPollDue[HP_UNIT_MAX];
+bool hpPollChanged[HP_UNIT_MAX]; // something changed since the last poll
+int hpPollCompressorFrequency[HP_UNIT_MAX];
+bool hpPollOperating[HP_UNIT_MAX];
+// CN105 reconnect backoff and outage stats
+#include "hp_link.h"
+// Outdoor temperature, power, energy, error code and runtime
+#include "hp_extended.h"
+// Remote temperature filter, deadband and rate limit
+#include "remote_temp.h"
+// Remote temperature fused from several sensor topics
+#include "temp_fusion.h"
 
 // temp settings
 bool useFahrenheit = false;
@@ -354,9 +530,13 @@ const byte ENT_BSSI = 5;
 const byte ENT_COMPR_FRQ = 6;
 const byte ENT_RESTART_BTN = 7;
 const byte ENT_WEB_PANEL = 8;
+const byte ENT_CFG_WRITES = 9;
+const byte ENT_OUTDOOR_TEMPERATURE = 10;
+const byte ENT_INPUT_POWER = 11;
+const byte ENT_ENERGY = 12;
+const byte ENT_ERROR_CODE = 13;
+const byte ENT_RUNTIME = 14;
 
-const byte MAX_ENTITY_ID = ENT_WEB_PANEL;
+const byte MAX_ENTITY_ID = ENT_RUNTIME;
 
 static constexpr uint8_t NUM_LANGUAGES = sizeof(languages) / sizeof(const char *);
-
-// #define METRICS 1   // un comment to enable Prometheus exporter
@@ -0,0 +1,186 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Extended CN105 status: outdoor temperature, input power, energy, error code and runtime.
+// The HP library drop these fields, they are read here from the replies seen by the packet callback.
+// A reply type not seen for HP_EXT_POLL_MS is requested in the idle middle of a poll interval, one type
+// per interval in turn and at least HP_EXT_GAP_MS from the core requests, so settings and status polls
+// are never pushed back. Models without a field never answer it or answer zero, the field stay missing.
+
+enum HpExtType : uint8_t
+{
+  HP_EXT_TEMPERATURES, // outdoor temperature, runtime
+  HP_EXT_ERRORS,       // error code
+  HP_EXT_STATUS,       // input power, energy
+  HP_EXT_TYPE_COUNT
+};
+
+struct HpExtRequest
+{
+  uint8_t info;     // info byte of the request and its reply
+  uint8_t syncType; // index of the info in the library INFOMODE table, for sync()
+};
+
+static const HpExtRequest hpExtRequest[HP_EXT_TYPE_COUNT] = {
+    /* HP_EXT_TEMPERATURES */ {0x03, 1},
+    /* HP_EXT_ERRORS */ {0x04, 2},
+    /* HP_EXT_STATUS */ {0x06, 4}};
+
+// Fields read at least once
+#define HP_EXT_HAS_OUTDOOR_TEMP 0x01
+#define HP_EXT_HAS_POWER 0x02
+#define HP_EXT_HAS_ENERGY 0x04
+#define HP_EXT_HAS_ERROR 0x08
+#define HP_EXT_HAS_RUNTIME 0x10
+
+struct HpExtended
+{
+  uint8_t has; // HP_EXT_HAS_*
+  float outdoorTemperature; // °C
+  uint16_t inputPower;      // W
+  float energy;             // kWh counter
+  uint16_t errorCode;       // 0 without error
+  uint32_t runtimeMinutes;
+};
+
+struct HpExtPoll
+{
+  uint32_t askedAt[HP_EXT_TYPE_COUNT]; // last request sent, by us or the core poll
+  uint32_t seenAt[HP_EXT_TYPE_COUNT];  // last reply
+  uint8_t next;
+  bool slotOpen;
+  uint32_t slotAt;
+};
+
+HpExtended hpExt[HP_UNIT_MAX];
+HpExtPoll hpExtPoll[HP_UNIT_MAX];
+uint8_t hpExtAnnounced[HP_UNIT_MAX]; // fields with their HA entity sent, loop() only
+#ifdef ESP32
+portMUX_TYPE hpExtMux = portMUX_INITIALIZER_UNLOCKED; // HP task write, loop() and web read
+#define HP_EXT_LOCK() portENTER_CRITICAL(&hpExtMux)
+#define HP_EXT_UNLOCK() portEXIT_CRITICAL(&hpExtMux)
+#else
+#define HP_EXT_LOCK()
+#define HP_EXT_UNLOCK()
+#endif
+
+static bool hpExtRecent(uint32_t at)
+{
+  return at != 0 && millis() - at < HP_EXT_POLL_MS;
+}
+
+// A core request was just sent, the slot open HP_EXT_GAP_MS later when the interval leave room after it
+void hpExtSlotOpen(uint8_t unit, uint32_t intervalMs)
+{
+  HpExtPoll &poll = hpExtPoll[unit];
+  poll.slotOpen = intervalMs >= 2 * HP_EXT_GAP_MS;
+  poll.slotAt = millis() + HP_EXT_GAP_MS;
+}
+
+// When the slot is reached, the sync() type of the next stale reply to request, -1 for none
+int hpExtSlotTake(uint8_t unit, uint32_t pollDue)
+{
+  HpExtPoll &poll = hpExtPoll[unit];
+  if (!poll.slotOpen || !timeReached(poll.slotAt))
+    return -1;
+  poll.slotOpen = false; // also when missed, the next core request open another one
+  if ((int32_t)(pollDue - millis()) < (int32_t)HP_EXT_GAP_MS)
+    return -1;
+  for (uint8_t tried = 0; tried < HP_EXT_TYPE_COUNT; tried++)
+  {
+    uint8_t type = poll.next;
+    poll.next = (poll.next + 1) % HP_EXT_TYPE_COUNT;
+    if (!hpExtRecent(poll.askedAt[type]) && !hpExtRecent(poll.seenAt[type]))
+      return hpExtRequest[type].syncType;
+  }
+  return -1;
+}
+
+// Time the HP loop must wake for the slot or the next core poll
+uint32_t hpExtWakeAt(uint8_t unit, uint32_t pollDue)
+{
+  const HpExtPoll &poll = hpExtPoll[unit];
+  return poll.slotOpen && (int32_t)(pollDue - poll.slotAt) >= (int32_t)HP_EXT_GAP_MS ? poll.slotAt : pollDue;
+}
+
+static int hpExtTypeOf(uint8_t info)
+{
+  for (uint8_t type = 0; type < HP_EXT_TYPE_COUNT; type++)
+    if (hpExtRequest[type].info == info)
+      return type;
+  return -1;
+}
+
+// Packet callback, track the requests sent and read the replies
+void hpExtPacket(uint8_t unit, const byte *packet, unsigned int length, bool sent)
+{
+  if (length < 22 || packet[1] != (sent ? 0x42 : 0x62))
+    return;
+  int type = hpExtTypeOf(packet[5]);
+  if (type < 0)
+    return;
+  HpExtPoll &poll = hpExtPoll[unit];
+  if (sent)
+  {
+    poll.askedAt[type] = millis() | 1;
+    return;
+  }
+  poll.seenAt[type] = millis() | 1;
+  const byte *data = packet + 5;
+  HpExtended &ext = hpExt[unit];
+  HP_EXT_LOCK();
+  switch (type)
+  {
+  case HP_EXT_TEMPERATURES:
+    if (data[5] > 1) // 0 without outdoor sensor
+    {
+      ext.outdoorTemperature = (data[5] - 128) / 2.0f;
+      ext.has |= HP_EXT_HAS_OUTDOOR_TEMP;
+    }
+    ext.runtimeMinutes = ((uint32_t)data[11] << 16) | (data[12] << 8) | data[13];
+    if (ext.runtimeMinutes != 0)
+      ext.has |= HP_EXT_HAS_RUNTIME;
+    break;
+  case HP_EXT_ERRORS:
+    ext.errorCode = data[4] == 0x80 && data[5] == 0 ? 0 : (data[4] << 8) | data[5];
+    ext.has |= HP_EXT_HAS_ERROR;
+    break;
+  case HP_EXT_STATUS:
+    ext.inputPower = (data[5] << 8) | data[6];
+    ext.energy = ((data[7] << 8) | data[8]) / 10.0f;
+    if (ext.inputPower != 0)
+      ext.has |= HP_EXT_HAS_POWER;
+    if (ext.energy != 0)
+      ext.has |= HP_EXT_HAS_ENERGY;
+    break;
+  }
+  HP_EXT_UNLOCK();
+}
+
+HpExtended hpExtGet(uint8_t unit)
+{
+  HP_EXT_LOCK();
+  HpExtended ext = hpExt[unit];
+  HP_EXT_UNLOCK();
+  return ext;
+}
+
+// Fields read since their HA entity was last sent, marked as sent. loop() only
+uint8_t hpExtTakeNew(uint8_t unit, uint8_t has)
+{
+  uint8_t fresh = has & ~hpExtAnnounced[unit];
+  hpExtAnnounced[unit] |= fresh;
+  return fresh;
+}
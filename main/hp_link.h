@@ -0,0 +1,151 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// CN105 link reconnect, one state per unit. While the link is down a retry wait a random time up to
+// HP_RETRY_INTERVAL_MS * 2^stage (full jitter), the stage go up at each failed retry.
+// UART bytes or a change of the RX line level mean the unit is back after a power blip or a
+// cable reseat, the backoff restart from stage 0 at once. A dead unit stay quiet and keep the
+// slow retries, a noisy line can restart it once per HP_LINK_WAKE_HOLDOFF_MS.
+// The time from link lost to reconnect of the last HP_LINK_WINDOW outages is kept.
+
+#define HP_LINK_WINDOW 16
+
+struct HpLinkPercentiles
+{
+  uint32_t p50;
+  uint32_t p95;
+  uint32_t max;
+  uint8_t size;
+};
+
+struct HpLink
+{
+  uint32_t stage;    // retries since the link was lost, up to HP_MAX_RETRIES
+  uint32_t retries;  // all connect retries
+  int rxPin;         // -1 when the level is not watched
+  int8_t rxLevel;    // last RX line level seen while down, -1 unknown
+  bool up;
+  uint32_t lostAt;   // 0 while connected and before the first connect
+  uint32_t retryDue;
+  uint32_t wakeAt;   // last backoff restart on activity
+  uint32_t wakes;
+  uint32_t reconnectMs[HP_LINK_WINDOW];
+  uint8_t next;
+  uint8_t size;
+  uint32_t reconnects;
+};
+
+HpLink hpLink[HP_UNIT_MAX];
+#ifdef ESP32
+portMUX_TYPE hpLinkMux = portMUX_INITIALIZER_UNLOCKED; // HP task write, loop() and web read
+#define HP_LINK_LOCK() portENTER_CRITICAL(&hpLinkMux)
+#define HP_LINK_UNLOCK() portEXIT_CRITICAL(&hpLinkMux)
+#else
+#define HP_LINK_LOCK()
+#define HP_LINK_UNLOCK()
+#endif
+
+// RX pin of the unit serial, its level is read while the link is down
+void hpLinkBegin(uint8_t unit, int rxPin)
+{
+  HpLink &link = hpLink[unit];
+  link = {};
+  link.rxPin = rxPin;
+  link.rxLevel = -1;
+  link.retryDue = millis();
+}
+
+// The link is up, record the outage it end
+void hpLinkConnected(uint8_t unit)
+{
+  HpLink &link = hpLink[unit];
+  if (link.lostAt != 0)
+  {
+    HP_LINK_LOCK();
+    link.reconnectMs[link.next] = millis() - link.lostAt;
+    link.next = (link.next + 1) % HP_LINK_WINDOW;
+    link.size = min(link.size + 1, HP_LINK_WINDOW);
+    link.reconnects++;
+    HP_LINK_UNLOCK();
+    link.lostAt = 0;
+  }
+  link.up = true;
+  link.stage = 0;
+  link.rxLevel = -1;
+  link.retryDue = millis() + HP_RETRY_INTERVAL_MS; // first retry a second after the link is lost
+}
+
+// The link is down, rxData when the UART has bytes waiting. True when a retry is due now
+bool hpLinkRetryNow(uint8_t unit, bool rxData)
+{
+  HpLink &link = hpLink[unit];
+  if (link.up)
+  {
+    link.up = false;
+    link.lostAt = millis() | 1;
+  }
+  bool activity = rxData;
+  if (link.rxPin >= 0)
+  {
+    int8_t level = digitalRead(link.rxPin);
+    activity |= link.rxLevel >= 0 && level != link.rxLevel;
+    link.rxLevel = level;
+  }
+  if (activity && link.stage > 0 && (link.wakes == 0 || millis() - link.wakeAt > HP_LINK_WAKE_HOLDOFF_MS))
+  {
+    link.stage = 0;
+    link.wakeAt = millis();
+    link.wakes++;
+    return true;
+  }
+  return timeReached(link.retryDue);
+}
+
+// A retry was sent, next one after a random wait up to the backoff of the next stage
+void hpLinkRetried(uint8_t unit)
+{
+  HpLink &link = hpLink[unit];
+  link.stage = min(link.stage + 1u, HP_MAX_RETRIES);
+  link.retries++;
+  link.retryDue = millis() + random((HP_RETRY_INTERVAL_MS << link.stage) + 1);
+}
+
+// Milliseconds to the next retry, 0 while connected or due
+uint32_t hpLinkRetryInMs(uint8_t unit)
+{
+  const HpLink &link = hpLink[unit];
+  if (link.up || timeReached(link.retryDue))
+    return 0;
+  return link.retryDue - millis();
+}
+
+// Percentiles of the reconnect times
+HpLinkPercentiles hpLinkReconnectGet(uint8_t unit)
+{
+  uint32_t sorted[HP_LINK_WINDOW];
+  HP_LINK_LOCK();
+  uint8_t size = hpLink[unit].size;
+  memcpy(sorted, hpLink[unit].reconnectMs, sizeof(sorted));
+  HP_LINK_UNLOCK();
+  telemetrySort(sorted, size);
+  HpLinkPercentiles result = {0, 0, 0, size};
+  if (size > 0)
+  {
+    result.p50 = telemetryPercentile(sorted, size, 50);
+    result.p95 = telemetryPercentile(sorted, size, 95);
+    result.max = telemetryPercentile(sorted, size, 100);
+  }
+  return result;
+}
@@ -36,6 +36,15 @@ const char html_page_save_reboot[] PROGMEM =
         "</script>"
 ;
 
+const char html_page_save_apply[] PROGMEM =
+        "<p>_TXT_M_SAVE_APPLY_</p>"
+        "<script>"
+            "setTimeout(function() {"
+                "window.location.href = '/';"
+            "}, 3000);"
+        "</script>"
+;
+
 const char html_page_mqtt[] PROGMEM =
         "<div id='l1' name='l1'>"
             "<fieldset>"
@@ -43,7 +52,7 @@ const char html_page_mqtt[] PROGMEM =
                 "<form method='post'>"
                     "<p><b>_TXT_MQTT_FN_</b> _TXT_MQTT_FN_DESC_"
                         "<br/>"
-                        "<input id='fn' name='fn' placeholder=' ' value='_MQTT_FN_' "
+                        "<input id='fn' name='fn' placeholder=' ' maxlength='64' value='_MQTT_FN_' "
 						"autocomplete='off' autocorrect='off' autocapitalize='off' spellcheck='false'>"
                     "</p>"
                     "<p><b>_TXT_MQTT_HOST_</b>"
@@ -68,7 +77,7 @@ const char html_page_mqtt[] PROGMEM =
                     "</p>"
                     "<p><b>_TXT_MQTT_TOPIC_</b>"
                         "<br/>"
-                        "<input id='mt' name='mt' placeholder='_TXT_MQTT_PH_TOPIC_' value='_MQTT_TOPIC_' "
+                        "<input id='mt' name='mt' placeholder='_TXT_MQTT_PH_TOPIC_' maxlength='64' value='_MQTT_TOPIC_' "
 						"autocomplete='off' autocorrect='off' autocapitalize='off' spellcheck='false'>"
                     "</p>"
                     "<p><b>_TXT_MQTT_ROOT_CA_CERT_</b>"
@@ -103,7 +112,7 @@ const char html_page_others[] PROGMEM =
                     "</p>"
                     "<p><b>_TXT_OTHERS_HATOPIC_</b>"
                         "<br/>"
-                        "<input id='haat' name='haat' placeholder=' ' value='_HAA_TOPIC_' "
+                        "<input id='haat' name='haat' placeholder=' ' maxlength='64' value='_HAA_TOPIC_' "
 						"autocomplete='off' autocorrect='off' autocapitalize='off' spellcheck='false'>"
                     "</p>"
                     "<p><b>_TXT_OTHERS_DEBUG_LOGS_</b>"
@@ -160,6 +169,7 @@ const char html_page_status[] PROGMEM =
             "<legend><b>&nbsp; _TXT_STATUS_TITLE_ &nbsp;</b></legend>"
             "_TXT_STATUS_HVAC_ => _HVAC_STATUS_"
              "<br />_TXT_RETRIES_HVAC_ => _HVAC_RETRIES_"
+            "<br /> _TXT_LATENCY_HVAC_ => _HVAC_LATENCY_"
             "<br /> _TXT_STATUS_MQTT_ => _MQTT_STATUS_"
             "<br /> _TXT_STATUS_WIFI_IP_ => _WIFI_IP_"
             "<br /> WIFI BSSID => _WIFI_BSSID_"
@@ -170,6 +180,10 @@ const char html_page_status[] PROGMEM =
             "<br /> _TXT_STATUS_FREEHEAP_ => _FREE_HEAP_"
             "<br /> _TXT_CURRENT_TIME_ => _CURRENT_TIME_"
             "<br /> _TXT_BOOT_TIME => _BOOT_TIME_"
+            "<br /> _TXT_STARTUP_ => _STARTUP_"
+            "<br /> _TXT_LOOP_STATS_ => _LOOP_STATS_"
+            "<br /> _TXT_WEB_CLIENTS_ => _WEB_CLIENTS_"
+            "<br /> _TXT_TELEMETRY_ => _TELEMETRY_"
             "</fieldset>"
             "<br />"
             "<p>"
@@ -264,7 +278,7 @@ const char html_page_control[] PROGMEM =
                 "<div class='ctrlrow'>"
                 "<p>"
                     "<b>_TXT_CTRL_POWER_</b>"
-                    "<form id='form' onchange='this.submit()' method='post'>"
+                    "<form id='form' onchange='formControl(this)' method='post'>"
                       "<input name='PWRCHK' type='hidden' value=''>"
                       "<label class='switch'>"
                         "<input id='POWER' name='POWER' type='checkbox' value='ON' _POWER_>"
@@ -277,7 +291,7 @@ const char html_page_control[] PROGMEM =
 const char html_page_control_mode[] PROGMEM =
                 "<div class='ctrlrow'>"
                 "<p><b>_TXT_CTRL_MODE_</b>"
-                    "<form onchange='this.submit()' method='post'>"
+                    "<form onchange='formControl(this)' method='post'>"
                         "<select name='MODE' id='MODE'>"
                             "<option value='AUTO' _MODE_A_>&#9851; _TXT_F_AUTO_</option>"
                             "<option value='DRY' _MODE_D_>&#128167; _TXT_F_DRY_</option>"
@@ -292,7 +306,7 @@ const char html_page_control_mode[] PROGMEM =
 const char html_page_control_fan[] PROGMEM =
                 "<div class='ctrlrow'>"
                 "<p><b>_TXT_CTRL_FAN_</b>"
-                    "<form onchange='this.submit()' method='post'>"
+                    "<form onchange='formControl(this)' method='post'>"
                         "<select name='FAN' id='FAN'>"
                             "<option value='AUTO' _FAN_A_>&#9851; _TXT_F_AUTO_</option>"
                             "<option _QUIET_HIDDEN_ value='QUIET' _FAN_Q_>.... _TXT_F_QUIET_</option>"
@@ -308,7 +322,7 @@ const char html_page_control_fan[] PROGMEM =
 const char html_page_control_vane[] PROGMEM =
                 "<div class='ctrlrow' _VANE_STYLE_>"
                 "<p><b>_TXT_CTRL_VANE_</b>"
-                    "<form onchange='this.submit()' method='post'>"
+                    "<form onchange='formControl(this)' method='post'>"
                         "<select name='VANE' id='VANE'>"
                             "<option value='AUTO' _VANE_A_>&#9851; _TXT_F_AUTO_</option>"
                             "<option value='SWING' _VANE_S_>&#9887; _TXT_F_SWING_</option>"
@@ -325,7 +339,7 @@ const char html_page_control_vane[] PROGMEM =
 const char html_page_control_widevane[] PROGMEM =
                 "<div class='ctrlrow' _WIDE_VANE_STYLE_>"
                 "<p><b>_TXT_CTRL_WVANE_</b>"
-                    "<form onchange='this.submit()' method='post'>"
+                    "<form onchange='formControl(this)' method='post'>"
                         "<select name='WIDEVANE' id='WIDEVANE'>"
                             "<option value='SWING' _WVANE_S_>&#9887; _TXT_F_SWING_</option>"
                             "<option value='<<' _WVANE_1_><< _TXT_F_POS_ 1</option>"
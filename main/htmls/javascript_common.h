@@ -166,8 +166,53 @@ const char control_script_events[] PROGMEM =
             "} else if (!b && t.value > _MIN_TEMP_) {"
                 "t.value = Number(t.value) - _TEMP_STEP_;"
             "}"
-            "document.getElementById('FTEMP_').submit();"
+            "if (!sendControl('TEMP', Number(t.value))) {"
+                "document.getElementById('FTEMP_').submit();"
+            "}"
+        "}"
+
+        "/*commands go on the web socket when it is open, else the form reload the page*/"
+        "var ws;"
+        "function sendControl(name, value) {"
+            "if (!ws || ws.readyState != 1) {"
+                "return false;"
+            "}"
+            "var command = {};"
+            "command[name] = value;"
+            "ws.send(JSON.stringify(command));"
+            "return true;"
         "}"
+
+        "function formControl(form) {"
+            "var e = form.elements[form.elements.length - 1];"
+            "if (!sendControl(e.name, e.type == 'checkbox' ? (e.checked ? 'ON' : 'OFF') : e.value)) {"
+                "form.submit();"
+            "}"
+        "}"
+
+        "function showState(state) {"
+            "for (var id in state) {"
+                "var e = document.getElementById(id);"
+                "if (!e) continue;"
+                "if (e.type == 'checkbox') e.checked = (state[id] == 'ON');"
+                "else if (e.tagName == 'SPAN') e.innerHTML = state[id];"
+                "else e.value = state[id];"
+            "}"
+        "}"
+#ifdef WEBSOCKET_ENABLE
+        "function openControl() {"
+            "ws = new WebSocket('ws://' + location.host + '/ws');"
+            "ws.onmessage = function(e) {"
+#if CONFIG_ENABLE_HP_DEBUG
+                "console.log('state', e.data);"
+#endif
+                "if (e.data[0] == '{') showState(JSON.parse(e.data));"
+            "};"
+            "ws.onclose = function() {"
+                "setTimeout(openControl, 4000);"
+            "};"
+        "}"
+#endif
  
         "window.onload = function() {"
          "if ($_GET('TEMP')) {"
@@ -185,6 +230,9 @@ const char control_script_events[] PROGMEM =
            "var options = document.getElementById('FAN').options;"
            "options[1].hide = (options[1].value == 'QUIET');"
           "}"
+#ifdef WEBSOCKET_ENABLE
+          "openControl();"
+#else
           "/*web event*/"
           "if (!!window.EventSource) {"
            "var source = new EventSource('/events');"
@@ -256,6 +304,7 @@ const char control_script_events[] PROGMEM =
             "document.getElementById('WIDEVANE').value = e.data;"
            "}, false);"
           "}"
+#endif
          "}"
         "}"
  
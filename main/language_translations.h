@@ -101,6 +101,7 @@ MAKE_WORD_TRANSLATION(txt_m_reboot, en::txt_m_reboot, vi::txt_m_reboot, da::txt_
 MAKE_WORD_TRANSLATION(txt_m_reset, en::txt_m_reset, vi::txt_m_reset, da::txt_m_reset, de::txt_m_reset, es::txt_m_reset, fr::txt_m_reset, it::txt_m_reset, ja::txt_m_reset, zh::txt_m_reset, ca::txt_m_reset)                       // TODO translate
 MAKE_WORD_TRANSLATION(txt_m_reset_1, en::txt_m_reset_1, vi::txt_m_reset_1, da::txt_m_reset_1, de::txt_m_reset_1, es::txt_m_reset_1, fr::txt_m_reset_1, it::txt_m_reset_1, ja::txt_m_reset_1, zh::txt_m_reset_1, ca::txt_m_reset_1) // TODO translate
 MAKE_WORD_TRANSLATION(txt_m_save, en::txt_m_save, vi::txt_m_save, da::txt_m_save, de::txt_m_save, es::txt_m_save, fr::txt_m_save, it::txt_m_save, ja::txt_m_save, zh::txt_m_save, ca::txt_m_save)                                  // TODO translate
+MAKE_WORD_TRANSLATION(txt_m_save_apply, en::txt_m_save_apply, vi::txt_m_save_apply, da::txt_m_save_apply, de::txt_m_save_apply, es::txt_m_save_apply, fr::txt_m_save_apply, it::txt_m_save_apply, ja::txt_m_save_apply, zh::txt_m_save_apply, ca::txt_m_save_apply)                      // TODO translate
 
 // Page MQTT
 MAKE_WORD_TRANSLATION(txt_mqtt_title, en::txt_mqtt_title, vi::txt_mqtt_title, da::txt_mqtt_title, de::txt_mqtt_title, es::txt_mqtt_title, fr::txt_mqtt_title, it::txt_mqtt_title, ja::txt_mqtt_title, zh::txt_mqtt_title, ca::txt_mqtt_title)                                             // TODO translate
@@ -134,6 +135,7 @@ MAKE_WORD_TRANSLATION(txt_others_web_panel, en::txt_others_web_panel, vi::txt_ot
 MAKE_WORD_TRANSLATION(txt_status_title, en::txt_status_title, vi::txt_status_title, da::txt_status_title, de::txt_status_title, es::txt_status_title, fr::txt_status_title, it::txt_status_title, ja::txt_status_title, zh::txt_status_title, ca::txt_status_title)                                                                   // TODO translate
 MAKE_WORD_TRANSLATION(txt_status_hvac, en::txt_status_hvac, vi::txt_status_hvac, da::txt_status_hvac, de::txt_status_hvac, es::txt_status_hvac, fr::txt_status_hvac, it::txt_status_hvac, ja::txt_status_hvac, zh::txt_status_hvac, ca::txt_status_hvac)                                                                              // TODO translate
 MAKE_WORD_TRANSLATION(txt_retries_hvac, en::txt_retries_hvac, vi::txt_retries_hvac, da::txt_retries_hvac, de::txt_retries_hvac, es::txt_retries_hvac, fr::txt_retries_hvac, it::txt_retries_hvac, ja::txt_retries_hvac, zh::txt_retries_hvac, ca::txt_retries_hvac)                                                                   // TODO translate
+MAKE_WORD_TRANSLATION(txt_latency_hvac, en::txt_latency_hvac, vi::txt_latency_hvac, da::txt_latency_hvac, de::txt_latency_hvac, es::txt_latency_hvac, fr::txt_latency_hvac, it::txt_latency_hvac, ja::txt_latency_hvac, zh::txt_latency_hvac, ca::txt_latency_hvac)                                                                   // TODO translate
 MAKE_WORD_TRANSLATION(txt_status_mqtt, en::txt_status_mqtt, vi::txt_status_mqtt, da::txt_status_mqtt, de::txt_status_mqtt, es::txt_status_mqtt, fr::txt_status_mqtt, it::txt_status_mqtt, ja::txt_status_mqtt, zh::txt_status_mqtt, ca::txt_status_mqtt)                                                                              // TODO translate
 MAKE_WORD_TRANSLATION(txt_status_wifi_ip, en::txt_status_wifi_ip, vi::txt_status_wifi_ip, da::txt_status_wifi_ip, de::txt_status_wifi_ip, es::txt_status_wifi_ip, fr::txt_status_wifi_ip, it::txt_status_wifi_ip, ja::txt_status_wifi_ip, zh::txt_status_wifi_ip, ca::txt_status_wifi_ip)                                             // TODO translate
 MAKE_WORD_TRANSLATION(txt_failed_get_wifi_ip, en::txt_failed_get_wifi_ip, vi::txt_failed_get_wifi_ip, da::txt_failed_get_wifi_ip, de::txt_failed_get_wifi_ip, es::txt_failed_get_wifi_ip, fr::txt_failed_get_wifi_ip, it::txt_failed_get_wifi_ip, ja::txt_failed_get_wifi_ip, zh::txt_failed_get_wifi_ip, ca::txt_failed_get_wifi_ip) // TODO translate
@@ -143,6 +145,10 @@ MAKE_WORD_TRANSLATION(txt_build_date, en::txt_build_date, vi::txt_build_date, da
 MAKE_WORD_TRANSLATION(txt_status_freeheap, en::txt_status_freeheap, vi::txt_status_freeheap, da::txt_status_freeheap, de::txt_status_freeheap, es::txt_status_freeheap, fr::txt_status_freeheap, it::txt_status_freeheap, ja::txt_status_freeheap, zh::txt_status_freeheap, ca::txt_status_freeheap)                                  // TODO translate
 MAKE_WORD_TRANSLATION(txt_current_time, en::txt_current_time, vi::txt_current_time, da::txt_current_time, de::txt_current_time, es::txt_current_time, fr::txt_current_time, it::txt_current_time, ja::txt_current_time, zh::txt_current_time, ca::txt_current_time)                                                                   // TODO translate
 MAKE_WORD_TRANSLATION(txt_boot_time, en::txt_boot_time, vi::txt_boot_time, da::txt_boot_time, de::txt_boot_time, es::txt_boot_time, fr::txt_boot_time, it::txt_boot_time, ja::txt_boot_time, zh::txt_boot_time, ca::txt_boot_time)                                                                                                    // TODO translate
+MAKE_WORD_TRANSLATION(txt_startup, en::txt_startup, vi::txt_startup, da::txt_startup, de::txt_startup, es::txt_startup, fr::txt_startup, it::txt_startup, ja::txt_startup, zh::txt_startup, ca::txt_startup)                                                                                                                          // TODO translate
+MAKE_WORD_TRANSLATION(txt_loop_stats, en::txt_loop_stats, vi::txt_loop_stats, da::txt_loop_stats, de::txt_loop_stats, es::txt_loop_stats, fr::txt_loop_stats, it::txt_loop_stats, ja::txt_loop_stats, zh::txt_loop_stats, ca::txt_loop_stats)                                                                                         // TODO translate
+MAKE_WORD_TRANSLATION(txt_web_clients, en::txt_web_clients, vi::txt_web_clients, da::txt_web_clients, de::txt_web_clients, es::txt_web_clients, fr::txt_web_clients, it::txt_web_clients, ja::txt_web_clients, zh::txt_web_clients, ca::txt_web_clients)                                                                              // TODO translate
+MAKE_WORD_TRANSLATION(txt_telemetry, en::txt_telemetry, vi::txt_telemetry, da::txt_telemetry, de::txt_telemetry, es::txt_telemetry, fr::txt_telemetry, it::txt_telemetry, ja::txt_telemetry, zh::txt_telemetry, ca::txt_telemetry)                                                                                                    // TODO translate
 MAKE_WORD_TRANSLATION(txt_status_connect, en::txt_status_connect, vi::txt_status_connect, da::txt_status_connect, de::txt_status_connect, es::txt_status_connect, fr::txt_status_connect, it::txt_status_connect, ja::txt_status_connect, zh::txt_status_connect, ca::txt_status_connect)                                             // TODO translate
 MAKE_WORD_TRANSLATION(txt_status_disconnect, en::txt_status_disconnect, vi::txt_status_disconnect, da::txt_status_disconnect, de::txt_status_disconnect, es::txt_status_disconnect, fr::txt_status_disconnect, it::txt_status_disconnect, ja::txt_status_disconnect, zh::txt_status_disconnect, ca::txt_status_disconnect)            // TODO translate
 
@@ -71,6 +71,7 @@ namespace ca
   const char txt_m_reset[] PROGMEM = "S'està restablint... Connectant a l'SSID";
   const char txt_m_reset_1[] PROGMEM = "Podeu tornar a connectar-vos a l'SSID";
   const char txt_m_save[] PROGMEM = "S'està desant la configuració i s'està reiniciant... Refrescant en";
+  const char txt_m_save_apply[] PROGMEM = "S'ha desat i aplicat la configuració";
 
   // Page MQTT
   const char txt_mqtt_title[] PROGMEM = "Configuració MQTT";
@@ -104,6 +105,7 @@ namespace ca
   const char txt_status_title[] PROGMEM = "Estat";
   const char txt_status_hvac[] PROGMEM = "Estat HVAC";
   const char txt_retries_hvac[] PROGMEM = "Nombre d'intents de connexió HVAC";
+  const char txt_latency_hvac[] PROGMEM = "HVAC Frame Latency";
   const char txt_status_mqtt[] PROGMEM = "Estat MQTT";
   const char txt_status_wifi_ip[] PROGMEM = "IP WIFI";
   const char txt_failed_get_wifi_ip[] PROGMEM = "No s'ha pogut obtenir l'adreça IP";
@@ -113,6 +115,10 @@ namespace ca
   const char txt_status_freeheap[] PROGMEM = "Espai lliure";
   const char txt_current_time[] PROGMEM = "Hora actual";
   const char txt_boot_time[] PROGMEM = "Temps d'arrencada";
+  const char txt_startup[] PROGMEM = "Startup";
+  const char txt_loop_stats[] PROGMEM = "Main Loop";
+  const char txt_web_clients[] PROGMEM = "Clients web";
+  const char txt_telemetry[] PROGMEM = "Telemetria";
   const char txt_status_connect[] PROGMEM = "CONNECTAT";
   const char txt_status_disconnect[] PROGMEM = "DESCONNECTAT";
 
@@ -70,6 +70,7 @@ namespace da
   const char txt_m_reset[] PROGMEM = "Resetting... Connect to SSID";
   const char txt_m_reset_1[] PROGMEM = "Du kan oprette forbindelse til SSID igen";
   const char txt_m_save[] PROGMEM = "Saving configuration and rebooting... Refresh in";
+  const char txt_m_save_apply[] PROGMEM = "Configuration saved and applied";
 
   // Page MQTT
   const char txt_mqtt_title[] PROGMEM = "MQTT Parameters";
@@ -103,6 +104,7 @@ namespace da
   const char txt_status_title[] PROGMEM = "Status";
   const char txt_status_hvac[] PROGMEM = "HVAC Status";
   const char txt_retries_hvac[] PROGMEM = "HVAC Connection Retries";
+  const char txt_latency_hvac[] PROGMEM = "HVAC Frame Latency";
   const char txt_status_mqtt[] PROGMEM = "MQTT Status";
   const char txt_status_wifi[] PROGMEM = "WIFI RSSI";
   const char txt_status_connect[] PROGMEM = "CONNECTED";
@@ -114,6 +116,10 @@ namespace da
   const char txt_status_freeheap[] PROGMEM = "Free Heap";
   const char txt_current_time[] PROGMEM = "Current Time";
   const char txt_boot_time[] PROGMEM = "Boot Time";
+  const char txt_startup[] PROGMEM = "Startup";
+  const char txt_loop_stats[] PROGMEM = "Main Loop";
+  const char txt_web_clients[] PROGMEM = "Webklienter";
+  const char txt_telemetry[] PROGMEM = "Telemetri";
 
   // Page WIFI
   const char txt_wifi_title[] PROGMEM = "WIFI Parameters";
@@ -75,6 +75,7 @@ namespace de
   const char txt_m_reset[] PROGMEM = "Zurücksetzen... Verbinde mit SSID";
   const char txt_m_reset_1[] PROGMEM = "Sie können sich wieder mit der SSID verbinden";
   const char txt_m_save[] PROGMEM = "Einstellungen speichern und neustart... Aktualisierung in";
+  const char txt_m_save_apply[] PROGMEM = "Einstellungen gespeichert und übernommen";
 
   // Page MQTT
   const char txt_mqtt_title[] PROGMEM = "MQTT Parameter";
@@ -103,6 +104,7 @@ namespace de
   const char txt_status_title[] PROGMEM = "Status";
   const char txt_status_hvac[] PROGMEM = "HVAC Status";
   const char txt_retries_hvac[] PROGMEM = "HVAC Verbindungsversuche";
+  const char txt_latency_hvac[] PROGMEM = "HVAC Paketlatenz";
   const char txt_status_mqtt[] PROGMEM = "MQTT Status";
   const char txt_status_wifi[] PROGMEM = "WLAN RSSI";
   const char txt_status_connect[] PROGMEM = "VERBUNDEN";
@@ -114,6 +116,10 @@ namespace de
   const char txt_status_freeheap[] PROGMEM = "Free Heap";
   const char txt_current_time[] PROGMEM = "Akt. Uhrzeit";
   const char txt_boot_time[] PROGMEM = "Betriebszeit";
+  const char txt_startup[] PROGMEM = "Startzeit";
+  const char txt_loop_stats[] PROGMEM = "Hauptschleife";
+  const char txt_web_clients[] PROGMEM = "Web-Clients";
+  const char txt_telemetry[] PROGMEM = "Telemetrie";
 
   // Page WIFI
   const char txt_wifi_title[] PROGMEM = "WLAN Parameter";
@@ -71,6 +71,7 @@ namespace en
   const char txt_m_reset[] PROGMEM = "Resetting in";
   const char txt_m_reset_1[] PROGMEM = "You can re connect to SSID";
   const char txt_m_save[] PROGMEM = "Saving configuration and rebooting... Refresh in";
+  const char txt_m_save_apply[] PROGMEM = "Configuration saved and applied";
 
   // Page MQTT
   const char txt_mqtt_title[] PROGMEM = "MQTT Parameters";
@@ -104,6 +105,7 @@ namespace en
   const char txt_status_title[] PROGMEM = "Status";
   const char txt_status_hvac[] PROGMEM = "HVAC Status";
   const char txt_retries_hvac[] PROGMEM = "HVAC Connection Retries";
+  const char txt_latency_hvac[] PROGMEM = "HVAC Frame Latency";
   const char txt_status_mqtt[] PROGMEM = "MQTT Status";
   const char txt_status_wifi_ip[] PROGMEM = "WIFI IP";
   const char txt_failed_get_wifi_ip[] PROGMEM = "Failed to get IP address";
@@ -113,6 +115,10 @@ namespace en
   const char txt_status_freeheap[] PROGMEM = "Free Heap";
   const char txt_current_time[] PROGMEM = "Current Time";
   const char txt_boot_time[] PROGMEM = "Boot Time";
+  const char txt_startup[] PROGMEM = "Startup";
+  const char txt_loop_stats[] PROGMEM = "Main Loop";
+  const char txt_web_clients[] PROGMEM = "Web Clients";
+  const char txt_telemetry[] PROGMEM = "Telemetry";
   const char txt_status_connect[] PROGMEM = "CONNECTED";
   const char txt_status_disconnect[] PROGMEM = "DISCONNECTED";
 
@@ -71,6 +71,7 @@ namespace es
   const char txt_m_reset[] PROGMEM = "Restableciendo... Sonectando a SSID";
   const char txt_m_reset_1[] PROGMEM = "Puedes volver a conectarte al SSID";
   const char txt_m_save[] PROGMEM = "Guardando configuración and reiniciando... Refrecando en";
+  const char txt_m_save_apply[] PROGMEM = "Configuración guardada y aplicada";
 
   // Page MQTT
   const char txt_mqtt_title[] PROGMEM = "Parametros MQTT";
@@ -104,6 +105,7 @@ namespace es
   const char txt_status_title[] PROGMEM = "Estado";
   const char txt_status_hvac[] PROGMEM = "Estado HVAC";
   const char txt_retries_hvac[] PROGMEM = "HVAC Connection Retries";
+  const char txt_latency_hvac[] PROGMEM = "HVAC Frame Latency";
   const char txt_status_mqtt[] PROGMEM = "Estado MQTT";
   const char txt_status_wifi[] PROGMEM = "WIFI RSSI";
   const char txt_status_connect[] PROGMEM = "CONNECTADO";
@@ -115,6 +117,10 @@ namespace es
   const char txt_status_freeheap[] PROGMEM = "Free Heap";
   const char txt_current_time[] PROGMEM = "Current Time";
   const char txt_boot_time[] PROGMEM = "Boot Time";
+  const char txt_startup[] PROGMEM = "Startup";
+  const char txt_loop_stats[] PROGMEM = "Main Loop";
+  const char txt_web_clients[] PROGMEM = "Clientes web";
+  const char txt_telemetry[] PROGMEM = "Telemetría";
 
   // Page WIFI
   const char txt_wifi_title[] PROGMEM = "Parametros WIFI";
@@ -71,6 +71,7 @@ namespace fr
   const char txt_m_reset[] PROGMEM = "Remise à zéro... Connecter vous au SSID";
   const char txt_m_reset_1[] PROGMEM = "Vous pouvez vous reconnecter au SSID";
   const char txt_m_save[] PROGMEM = "Sauvegarde de la configuration et redémarrage... Rafraichisement dans";
+  const char txt_m_save_apply[] PROGMEM = "Configuration sauvegardée et appliquée";
 
   // Page MQTT
   const char txt_mqtt_title[] PROGMEM = "Paramétres MQTT";
@@ -104,6 +105,7 @@ namespace fr
   const char txt_status_title[] PROGMEM = "Etats";
   const char txt_status_hvac[] PROGMEM = "Etat HVAC";
   const char txt_retries_hvac[] PROGMEM = "HVAC Connection Retries";
+  const char txt_latency_hvac[] PROGMEM = "HVAC Frame Latency";
   const char txt_status_mqtt[] PROGMEM = "Etat MQTT";
   const char txt_status_wifi[] PROGMEM = "WIFI RSSI";
   const char txt_status_connect[] PROGMEM = "CONNECTE";
@@ -115,6 +117,10 @@ namespace fr
   const char txt_status_freeheap[] PROGMEM = "Free Heap";
   const char txt_current_time[] PROGMEM = "Current Time";
   const char txt_boot_time[] PROGMEM = "Boot Time";
+  const char txt_startup[] PROGMEM = "Démarrage";
+  const char txt_loop_stats[] PROGMEM = "Boucle principale";
+  const char txt_web_clients[] PROGMEM = "Clients web";
+  const char txt_telemetry[] PROGMEM = "Télémétrie";
 
   // Page WIFI
   const char txt_wifi_title[] PROGMEM = "Paramétres WIFI";
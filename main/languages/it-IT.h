@@ -71,6 +71,7 @@ namespace it
   const char txt_m_reset[] PROGMEM = "Reset in corso... Connettersi all'SSID";
   const char txt_m_reset_1[] PROGMEM = "Puoi riconnetterti all'SSID";
   const char txt_m_save[] PROGMEM = "Salvataggio configurazione e riavvio... Refresh in";
+  const char txt_m_save_apply[] PROGMEM = "Configurazione salvata e applicata";
 
   // Page MQTT
   const char txt_mqtt_title[] PROGMEM = "Parametri MQTT";
@@ -104,6 +105,7 @@ namespace it
   const char txt_status_title[] PROGMEM = "Stato";
   const char txt_status_hvac[] PROGMEM = "Stato HVAC";
   const char txt_retries_hvac[] PROGMEM = "HVAC Connection Retries";
+  const char txt_latency_hvac[] PROGMEM = "HVAC Frame Latency";
   const char txt_status_mqtt[] PROGMEM = "Stato MQTT";
   const char txt_status_wifi[] PROGMEM = "WIFI RSSI";
   const char txt_status_connect[] PROGMEM = "CONNESSO";
@@ -115,6 +117,10 @@ namespace it
   const char txt_status_freeheap[] PROGMEM = "Free Heap";
   const char txt_current_time[] PROGMEM = "Current Time";
   const char txt_boot_time[] PROGMEM = "Boot Time";
+  const char txt_startup[] PROGMEM = "Startup";
+  const char txt_loop_stats[] PROGMEM = "Main Loop";
+  const char txt_web_clients[] PROGMEM = "Client web";
+  const char txt_telemetry[] PROGMEM = "Telemetria";
 
   // Page WIFI
   const char txt_wifi_title[] PROGMEM = "Parametri WIFI";
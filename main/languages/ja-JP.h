@@ -71,6 +71,7 @@ namespace ja
   const char txt_m_reset[] PROGMEM = "初期化中... SSIDに接続してください";
   const char txt_m_reset_1[] PROGMEM = "SSID に再接続できます";
   const char txt_m_save[] PROGMEM = "設定を保存し、再起動中";
+  const char txt_m_save_apply[] PROGMEM = "設定を保存し、適用しました";
 
   // Page MQTT
   const char txt_mqtt_title[] PROGMEM = "MQTT設定";
@@ -104,6 +105,7 @@ namespace ja
   const char txt_status_title[] PROGMEM = "ステータス";
   const char txt_status_hvac[] PROGMEM = "エアコン本体";
   const char txt_retries_hvac[] PROGMEM = "HVAC Connection Retries";
+  const char txt_latency_hvac[] PROGMEM = "HVAC Frame Latency";
   const char txt_status_mqtt[] PROGMEM = "MQTT";
   const char txt_status_wifi[] PROGMEM = "WIFI RSSI";
   const char txt_status_connect[] PROGMEM = "接続中";
@@ -115,6 +117,10 @@ namespace ja
   const char txt_status_freeheap[] PROGMEM = "Free Heap";
   const char txt_current_time[] PROGMEM = "Current Time";
   const char txt_boot_time[] PROGMEM = "Boot Time";
+  const char txt_startup[] PROGMEM = "Startup";
+  const char txt_loop_stats[] PROGMEM = "Main Loop";
+  const char txt_web_clients[] PROGMEM = "Webクライアント";
+  const char txt_telemetry[] PROGMEM = "テレメトリ";
 
   // Page WIFI
   const char txt_wifi_title[] PROGMEM = "WIFI設定";
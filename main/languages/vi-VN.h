@@ -71,6 +71,7 @@ namespace vi
   const char txt_m_reset[] PROGMEM = "Đang đặt lại trong";
   const char txt_m_reset_1[] PROGMEM = "Bạn có thể kết nối lại với SSID";
   const char txt_m_save[] PROGMEM = "Đang lưu cấu hình và khởi động lại... Làm mới trong";
+  const char txt_m_save_apply[] PROGMEM = "Đã lưu và áp dụng cấu hình";
 
   // Page MQTT
   const char txt_mqtt_title[] PROGMEM = "Thông số MQTT";
@@ -104,6 +105,7 @@ namespace vi
   const char txt_status_title[] PROGMEM = "Trạng thái";
   const char txt_status_hvac[] PROGMEM = "Trạng thái ĐH";
   const char txt_retries_hvac[] PROGMEM = "ĐH thử lại kết nối";
+  const char txt_latency_hvac[] PROGMEM = "Độ trễ xử lý gói HVAC";
   const char txt_status_mqtt[] PROGMEM = "Trạng thái MQTT";
   const char txt_status_wifi_ip[] PROGMEM = "WIFI IP";
   const char txt_failed_get_wifi_ip[] PROGMEM = "Lỗi khi lấy địa chỉ IP";
@@ -113,6 +115,10 @@ namespace vi
   const char txt_status_freeheap[] PROGMEM = "Bộ nhớ trống";
   const char txt_current_time[] PROGMEM = "Ngày tháng";
   const char txt_boot_time[] PROGMEM = "Thời gian khởi động";
+  const char txt_startup[] PROGMEM = "Khởi động";
+  const char txt_loop_stats[] PROGMEM = "Vòng lặp chính";
+  const char txt_web_clients[] PROGMEM = "Máy khách web";
+  const char txt_telemetry[] PROGMEM = "Đo lường từ xa";
   const char txt_status_connect[] PROGMEM = "KẾT NỐI";
   const char txt_status_disconnect[] PROGMEM = "MẤT KẾT NỐI";
 
@@ -71,6 +71,7 @@ namespace zh
   const char txt_m_reset[] PROGMEM = "重新配置中... 连接至SSID";
   const char txt_m_reset_1[] PROGMEM = "您可以重新连接到 SSID";
   const char txt_m_save[] PROGMEM = "保持配置并重启中... 刷新";
+  const char txt_m_save_apply[] PROGMEM = "配置已保存并应用";
 
   // Page MQTT
   const char txt_mqtt_title[] PROGMEM = "MQTT 参数";
@@ -104,6 +105,7 @@ namespace zh
   const char txt_status_title[] PROGMEM = "状态";
   const char txt_status_hvac[] PROGMEM = "空调状态";
   const char txt_retries_hvac[] PROGMEM = "HVAC Connection Retries";
+  const char txt_latency_hvac[] PROGMEM = "HVAC Frame Latency";
   const char txt_status_mqtt[] PROGMEM = "MQTT状态";
   const char txt_status_wifi[] PROGMEM = "WIFI信号";
   const char txt_status_connect[] PROGMEM = "已连接";
@@ -115,6 +117,10 @@ namespace zh
   const char txt_status_freeheap[] PROGMEM = "Free Heap";
   const char txt_current_time[] PROGMEM = "Current Time";
   const char txt_boot_time[] PROGMEM = "Boot Time";
+  const char txt_startup[] PROGMEM = "Startup";
+  const char txt_loop_stats[] PROGMEM = "Main Loop";
+  const char txt_web_clients[] PROGMEM = "网页客户端";
+  const char txt_telemetry[] PROGMEM = "遥测";
 
   // Page WIFI
   const char txt_wifi_title[] PROGMEM = "WIFI参数";
@@ -0,0 +1,143 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Timing of loop() and its stages in fixed histogram buckets, to find what freeze the device.
+// A record is two micros() calls and a short bucket scan, so it cost nothing next to the work measured.
+// A loop pass slower than LOOP_STALL_US is a stall and is blamed on its slowest stage.
+
+#define LOOP_STATS_BUCKETS 8
+#define LOOP_STALL_US 100000 // 100 ms
+
+enum LoopStage : uint8_t
+{
+  STAGE_LOOP, // whole loop() pass without the idle sleep
+  STAGE_HP_SYNC,
+  STAGE_HP_EVENTS,
+  STAGE_MQTT_RECONNECT,
+  STAGE_MQTT_LOOP,
+  STAGE_WIFI_SCAN,
+  STAGE_KEEP_ALIVE,
+  STAGE_DNS,
+  STAGE_WS_CLEANUP,
+  STAGE_OTA,
+  STAGE_COUNT
+};
+
+static const char *const loopStageName[STAGE_COUNT] = {
+    /* STAGE_LOOP */ "loop",
+    /* STAGE_HP_SYNC */ "hp_sync",
+    /* STAGE_HP_EVENTS */ "hp_events",
+    /* STAGE_MQTT_RECONNECT */ "mqtt_reconnect",
+    /* STAGE_MQTT_LOOP */ "mqtt_loop",
+    /* STAGE_WIFI_SCAN */ "wifi_scan",
+    /* STAGE_KEEP_ALIVE */ "keep_alive",
+    /* STAGE_DNS */ "dns",
+    /* STAGE_WS_CLEANUP */ "ws_cleanup",
+    /* STAGE_OTA */ "ota"};
+
+// Upper bound of each bucket in us but the last one, it take everything above
+static const uint32_t loopStatsBucketUs[LOOP_STATS_BUCKETS - 1] = {1000, 5000, 10000, 50000, 100000, 500000, 1000000};
+
+struct LoopStageStats
+{
+  uint32_t count;
+  uint32_t maxUs;
+  uint64_t sumUs;
+  uint32_t buckets[LOOP_STATS_BUCKETS];
+};
+
+struct LoopStall
+{
+  LoopStage stage;
+  uint32_t us;
+  uint32_t at; // millis() when it ended
+};
+
+TelemetryHistogramSet<STAGE_COUNT, LOOP_STATS_BUCKETS - 1> loopStageSeconds("loop_stage_seconds", "Time spent in loop() and its stages",
+                                                                          loopStatsBucketUs, 1000000, "stage", loopStageName);
+TelemetryGaugeSet<STAGE_COUNT> loopStageMaxSeconds("loop_stage_max_seconds", "Longest run of loop() and its stages", "stage", loopStageName, 1000000);
+TelemetryCounter loopStalls("loop_stalls_total", "loop() passes slower than 100 ms");
+LoopStall loopLastStall = {STAGE_LOOP, 0, 0};
+LoopStage loopPassWorstStage = STAGE_LOOP; // slowest stage of the current loop() pass
+uint32_t loopPassWorstUs = 0;
+#ifdef ESP32
+portMUX_TYPE loopStatsMux = portMUX_INITIALIZER_UNLOCKED; // hp_sync is recorded from the HP task
+#define LOOP_STATS_LOCK() portENTER_CRITICAL(&loopStatsMux)
+#define LOOP_STATS_UNLOCK() portEXIT_CRITICAL(&loopStatsMux)
+#define LOOP_STAGE_OUTSIDE_LOOP(stage) ((stage) == STAGE_HP_SYNC) // the HP task stalls are its own
+#else
+#define LOOP_STATS_LOCK()
+#define LOOP_STATS_UNLOCK()
+#define LOOP_STAGE_OUTSIDE_LOOP(stage) false
+#endif
+
+void loopStatsRecord(LoopStage stage, uint32_t us)
+{
+  LoopStall stall = {stage, us, millis()};
+  if (stage == STAGE_LOOP)
+  {
+    stall.stage = loopPassWorstStage;
+    loopPassWorstStage = STAGE_LOOP;
+    loopPassWorstUs = 0;
+  }
+  else if (!LOOP_STAGE_OUTSIDE_LOOP(stage) && us > loopPassWorstUs)
+  {
+    loopPassWorstStage = stage;
+    loopPassWorstUs = us;
+  }
+  LOOP_STATS_LOCK();
+  loopStageSeconds.record(stage, us);
+  if (us > (uint32_t)loopStageMaxSeconds.get(stage))
+    loopStageMaxSeconds.set(stage, us);
+  if (us > LOOP_STALL_US && (stage == STAGE_LOOP || LOOP_STAGE_OUTSIDE_LOOP(stage)))
+  {
+    loopStalls.add();
+    loopLastStall = stall;
+  }
+  LOOP_STATS_UNLOCK();
+}
+
+// Time the rest of the scope as one stage
+struct LoopStageTimer
+{
+  LoopStage stage;
+  uint32_t start;
+
+  explicit LoopStageTimer(LoopStage stage) : stage(stage), start(micros()) {}
+  ~LoopStageTimer() { loopStatsRecord(stage, micros() - start); }
+};
+
+#define LOOP_STAGE(stage) LoopStageTimer loopStageTimer_(stage)
+
+// Copy the stats of a stage from the registry for the web and MQTT reports
+LoopStageStats loopStatsGet(LoopStage stage)
+{
+  LoopStageStats stats;
+  LOOP_STATS_LOCK();
+  stats.count = loopStageSeconds.count[stage];
+  stats.maxUs = loopStageMaxSeconds.get(stage);
+  stats.sumUs = loopStageSeconds.total[stage];
+  memcpy(stats.buckets, loopStageSeconds.counts[stage], sizeof(stats.buckets));
+  LOOP_STATS_UNLOCK();
+  return stats;
+}
+
+LoopStall loopStatsLastStall()
+{
+  LOOP_STATS_LOCK();
+  LoopStall stall = loopLastStall;
+  LOOP_STATS_UNLOCK();
+  return stall;
+}
@@ -20,21 +20,26 @@
 #include "htmls/html_init.h"         // code html for initial config
 #include "htmls/html_menu.h"         // code html for menu
 #include "htmls/html_pages.h"        // code html for pages
-#ifdef METRICS
-#include "htmls/html_metrics.h" // prometheus metrics
-#endif
 
 // Start header for build with IDF and Platformio
 bool loadWifi();
 bool loadMqtt();
 bool loadUnit();
 bool loadOthers();
-void saveMqtt(String mqttFn, const String& mqttHost, String mqttPort, const String& mqttUser, const String& mqttPwd, String mqttTopic, const String& mqttRootCaCert);
-void saveUnit(String tempUnit, String supportMode, String supportFanMode, String loginPassword, String tempStep, String languageIndex);
-void saveWifi(String apSsid, const String& apPwd, String hostName, const String& otaPwd, const String& local_ip, const String& gw_ip, const String& subnet_ip, const String& dns_ip);
-void saveOthers(const String& haa, const String& haat, const String& debugPckts, const String& debugLogs, const String& webPanel, const String& txPin, const String& rxPin, const String& tz, const String &ntp);
+bool saveMqtt(String mqttFn, const String& mqttHost, String mqttPort, const String& mqttUser, const String& mqttPwd, String mqttTopic, const String& mqttRootCaCert);
+bool saveUnit(String tempUnit, String supportMode, String supportFanMode, String loginPassword, String tempStep, String languageIndex, JsonObjectConst api = JsonObjectConst());
+bool saveWifi(String apSsid, const String& apPwd, String hostName, const String& otaPwd, const String& local_ip, const String& gw_ip, const String& subnet_ip, const String& dns_ip);
+bool saveOthers(const String& haa, const String& haat, const String& debugPckts, const String& debugLogs, const String& webPanel, const String& txPin, const String& rxPin, const String& tz, const String &ntp, JsonObjectConst api = JsonObjectConst());
 void saveCurrentOthers();
+bool writeConfigFile(const char *path, const JsonDocument &doc);
+void recoverConfigFile(const char *path);
+void loadConfigWrites();
+void saveConfigWrites();
+uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t len);
 void initCaptivePortal();
+void initCaptiveRoutes();
+void initWebServer();
+void initHaTopics();
 void initMqtt();
 void initOTA();
 void setDefaults();
@@ -54,22 +59,67 @@ void handleStatus(AsyncWebServerRequest *request);
 void handleControl(AsyncWebServerRequest *request);
 void handleMetrics(AsyncWebServerRequest *request);
 void handleLogin(AsyncWebServerRequest *request);
+void handleApiConfig(AsyncWebServerRequest *request);
+void handleApiConfigImport(AsyncWebServerRequest *request);
+void handleApiConfigBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+bool checkApiLogin(AsyncWebServerRequest *request);
+void handleApiCapture(AsyncWebServerRequest *request);
+void handleApiCaptureDownload(AsyncWebServerRequest *request);
 void handleUpgrade(AsyncWebServerRequest *request);
 void handleUploadDone(AsyncWebServerRequest *request);
 void handleUploadLoop(AsyncWebServerRequest *request, const String& filename, size_t index, uint8_t *data, size_t len, bool final);
 void write_log(const String& log);
 heatpumpSettings change_states(AsyncWebServerRequest *request, heatpumpSettings settings);
-void hpSettingsChanged();
+String getControlState(const heatpumpSettings &settings, const heatpumpStatus &status);
+void sendControlState(const heatpumpSettings &settings, const heatpumpStatus &status);
+void sendControlStateStale();
+void controlCommand(char *json, size_t length);
+void hpSettingsChanged(uint8_t unit);
 String hpGetMode(heatpumpSettings hpSettings);
 String hpGetAction(heatpumpStatus hpStatus, heatpumpSettings hpSettings);
-void hpStatusChanged(heatpumpStatus currentStatus);
+void hpStatusChanged(uint8_t unit, heatpumpStatus currentStatus);
 void hpCheckRemoteTemp();
-void hpPacketDebug(byte *packet, unsigned int length, const char *packetDirection);
-void hpSendLocalState();
+void hpRemoteTempReading(uint8_t unit, float celsius);
+void tempFusionCheck();
+void sendTempFusion(const float fused[HP_UNIT_MAX]);
+void tempFusionSubscribe(bool subscribe);
+void hpPacketDebug(uint8_t unit, byte *packet, unsigned int length, const char *packetDirection);
+void hpSendLocalState(uint8_t unit);
+void hpSendCommand(uint8_t unit, HpCommandType type, const char *text = nullptr, float value = 0);
+void hpSendCustomPacket(uint8_t unit, const byte *packet, int length);
+void hpExecuteCommand(const HpCommand &command);
+void hpRequestUpdate(uint8_t unit);
+void hpPoll(uint8_t unit);
+void hpPollBoost(uint8_t unit);
+void hpPollStatus(uint8_t unit, const heatpumpStatus &status);
+heatpumpSettings hpGetSettings(uint8_t unit = 0);
+heatpumpStatus hpGetStatus(uint8_t unit = 0);
+bool hpIsConnected(uint8_t unit = 0);
+bool hpHasUart(uint8_t unit);
+unsigned long hpGetLastWanted(uint8_t unit);
+#ifdef ESP32
+void hpTaskAttach(uint8_t unit);
+#ifdef HP_EXTRA_UNIT_PINS
+void hpConnectExtraUnit(uint8_t unit);
+#endif
+void hpTaskStart();
+void hpTask(void *parameter);
+void hpPublishState(uint8_t unit);
+void hpTaskSettingsChanged(uint8_t unit);
+void hpTaskStatusChanged(uint8_t unit, heatpumpStatus currentStatus);
+void hpTaskPacket(uint8_t unit, byte *packet, unsigned int length, const char *packetDirection);
+void hpSerialReceive(uint8_t unit);
+void hpWaitEvents(uint32_t waitMs);
+void hpDispatchEvents();
+#endif
 void mqttCallback(const char *topic, const uint8_t *payload, const unsigned int length);
 void sendHaConfig();
+void haConfigExtended(uint8_t unit, uint8_t fields);
 void mqttConnect();
-bool connectWifi();
+void startAccessPoint(bool firstSetup);
+void onWifiReady();
+void onWifiConnectTimeout();
+void configWifiStation();
 float toFahrenheit(float fromCelcius);
 float toCelsius(float fromFahrenheit);
 float convertCelsiusToLocalUnit(float temperature, bool isFahrenheit);
@@ -97,11 +147,43 @@ void onMqttPublish(uint16_t packetId);
 
 String getValueBySeparator(const String& data, char separator, int index);
 void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
+void wsLanguageCommand(AsyncWebSocketClient *client, char *message, size_t length);
+void wsControlCommand(AsyncWebSocketClient *client, char *message, size_t length);
 
 void sendRebootRequest(unsigned long nextSeconds);
-void checkRebootRequest();
-void checkHpUpdateRequest();
-void checkWifiScanRequest();
+void onRebootRequest();
+void sendConfigApplyRequest(uint8_t applyFlags);
+void onConfigApplyRequest();
+void sendConfigSaveRequest(uint8_t saveFlags);
+void flushConfigSave();
+void applyWifiConfig();
+void applyMqttConfig();
+void mqttCloseWait();
+void applyUnitConfig();
+bool applyOthersConfig();
+void applyWebPanel();
+void sendSaveApplyPage(AsyncWebServerRequest *request);
+void onHpUpdateRequest(uint8_t unit);
+void startWifiScan();
+void readWifiScan();
+#ifdef ESP8266
+void hpSyncRetry();
+#endif
+void wifiWatchdog();
+void mqttReconnect();
+void keepAliveTask();
+void sendKeepAlive();
+void sendLoopStats();
+void sendTelemetry();
+void sendPacketLog();
+void sendCommandTrace(const CmdTrace &trace);
+String getLoopStallText();
+String getWebClientsText();
+String getTelemetryText();
+void bootMilestone(BootPhase phase);
+void bootDeferredWork();
+void initUpgradeRoutes();
+String getBootProfileText();
 
 String getWifiOptions(bool send);
 void getWifiList();
@@ -114,6 +196,9 @@ time_t getUpTimeSeconds();
 String getUpTime();
 uint32_t getFreeHeapBytes();
 uint32_t getTotalHeapBytes();
+uint32_t getMinFreeHeapBytes();
+uint32_t getLargestFreeBlockBytes();
+uint16_t mqttPublish(const char *topic, uint8_t qos, bool retain, const char *payload);
 void tick(); // led blink tick
 void factoryReset();
 void otaUpdateProgress(size_t prg, size_t sz);
@@ -142,6 +227,9 @@ void setup()
 #ifdef ESP32
   Serial.setDebugOutput(true);
   initNVS();
+  rootInfoMutex = xSemaphoreCreateRecursiveMutex();
+  webClientsMutex = xSemaphoreCreateRecursiveMutex();
+  tempFusionConfigMutex = xSemaphoreCreateRecursiveMutex();
 #endif
   ESP_LOGD(TAG, "Starting  %s", appName);
   // Mount SPIFFS filesystem
@@ -158,6 +246,13 @@ void setup()
       ESP_LOGD(TAG, "Mounted file system after formating");
     }
   }
+  // finish or drop config writes interrupted by power loss
+  recoverConfigFile(wifi_conf);
+  recoverConfigFile(mqtt_conf);
+  recoverConfigFile(unit_conf);
+  recoverConfigFile(others_conf);
+  loadConfigWrites();
+  bootMark(BOOT_FS);
   // set led pin as output
   pinMode(blueLedPin, OUTPUT);
   ticker.attach(1, tick); // every seconds
@@ -171,42 +266,18 @@ void setup()
   }
   loadOthers();
   loadUnit();
+  bootMark(BOOT_CONFIG);
 #ifdef ESP32
   WiFi.setHostname(hostname.c_str());
 #else
   WiFi.hostname(hostname.c_str());
 #endif
   wifi_reconnect_timeout = 0;
-  mqtt_reconnect_timeout = 0;
+  lastMqttRetry = millis() - MQTT_RECONNECT_INTERVAL_MS; // allow connect now
   if (loadMqtt())
   {
     // write_log("Starting MQTT");
-    //  setup HA topics
-    String main_topic = mqtt_topic + F("/") + mqtt_fn;
-    
-    ha_power_set_topic = main_topic + F("/power/set");
-    ha_mode_set_topic = main_topic + F("/mode/set");
-    ha_temp_set_topic = main_topic + F("/temp/set");
-    ha_remote_temp_set_topic = main_topic + F("/remote_temp/set");
-    ha_fan_set_topic = main_topic + F("/fan/set");
-    ha_vane_set_topic = main_topic + F("/vane/set");
-    ha_wide_vane_set_topic = main_topic + F("/wide-vane/set");
-    //
-    ha_debug_pckts_topic = main_topic + F("/debug/packets");
-    ha_debug_pckts_set_topic = main_topic + F("/debug/packets/set");
-    ha_debug_logs_topic = main_topic + F("/debug/logs");
-    ha_debug_logs_set_topic = main_topic + F("/debug/logs/set");
-    //
-    ha_state_topic = main_topic + F("/state");
-    ha_system_info_topic = main_topic + F("/system/info");          // for device info
-    ha_system_set_topic = main_topic + F("/system/set");            // for control over mqtt
-    ha_system_setting_info = main_topic + F("/system/info");        // for control over mqtt
-    ha_system_setting_request = main_topic + F("/system/opt/rqt");  // for control over mqtt
-    ha_system_setting_respond = main_topic + F("/system/opt/rps");  // for control over mqtt
-    ha_custom_packet = main_topic + F("/custom/send");
-    ha_availability_topic = main_topic + F("/availability");
-    //
-    ha_birth_topic = (others_haa ? others_haa_topic : F("homeassistant")) + F("/status");
+    initHaTopics();
     // startup mqtt connection
     initMqtt();
   }
@@ -214,85 +285,94 @@ void setup()
   {
     // write_log("Not found MQTT config go to configuration page");
   }
-  if (initWifi())
+  bootMark(BOOT_MQTT_INIT);
+  bool station = initWifi();
+  bootMark(BOOT_WIFI_INIT);
+  if (station)
   {
-    if (SPIFFS.exists(console_file))
-    {
-      SPIFFS.remove(console_file);
-    }
     // write_log("Starting Mitsubishi2MQTT");
-    MDNS.begin(hostname); // DNS service for .local address access
     // Web interface
-    if (!_webPanelDisable) {
-        server.on("/", handleRoot);
-        server.on("/control", handleControl);
-        server.on("/setup", handleSetup);
-        server.on("/mqtt", handleMqtt);
-        server.on("/wifi", handleWifi);
-        server.on("/unit", handleUnit);
-        server.on("/status", handleStatus);
-        server.on("/others", handleOthers);
-#ifdef METRICS
-        server.on("/metrics", handleMetrics);
-#endif
-        server.onNotFound(handleNotFound);
-        if (login_password.length() > 0) {
-            server.on("/login", handleLogin);
-        }
-        if (!isSecureEnable()) {
-            server.on("/upgrade", handleUpgrade);
-            server.on("/upload", WebRequestMethod::HTTP_ANY, handleUploadDone, handleUploadLoop);
-#ifdef ESP32
-            Update.onProgress(otaUpdateProgress);
-#endif
-        }
-        // web socket
-#ifdef WEBSOCKET_ENABLE
-        ws.onEvent(onWsEvent);
-        server.addHandler(&ws);
+    initWebServer();
+    applyWebPanel();
+#ifdef FAST_BOOT
+    schedAt(TASK_BOOT_DEFERRED, BOOT_DEFER_MAX_MS, bootDeferredWork);
+#else
+    bootDeferredWork();
 #endif
-        // event source client
-        events.onConnect([](AsyncEventSourceClient *client) { client->send("hello!", NULL, millis(), 1000); });
-        server.addHandler(&events);
-        server.begin();
-    }
+    bootMark(BOOT_WEB);
 
     ESP_LOGD(TAG, "Connection to HVAC. Stop serial log.");
     // write_log("Connection to HVAC");
-    lastMqttRetry = 0;
-    lastHpSync = 0;
-    hpConnectionRetries = 0;
-    hpConnectionTotalRetries = 0;
-    hp.setSettingsChangedCallback(hpSettingsChanged);
-    hp.setStatusChangedCallback(hpStatusChanged);
-    hp.setPacketCallback(hpPacketDebug);
-    // Allow Remote/Panel
-    hp.enableExternalUpdate();
-    hp.enableAutoUpdate();
-#if defined(ESP32)
+#ifdef ESP32
+    hpTaskAttach(0);
     if (HP_TX > 0 && HP_RX > 0)
     {
-      hp.connect(&Serial1, HP_RX, HP_TX);
+      hpSerial[0] = &Serial1;
+      hp[0].connect(&Serial1, HP_RX, HP_TX);
+      hpLinkBegin(0, HP_RX);
     }
     else
     {
-      hp.connect(&Serial);
+      hpSerial[0] = &Serial;
+      hp[0].connect(&Serial);
+      hpLinkBegin(0, 3); // UART0 RX
       esp_log_level_set("*", ESP_LOG_NONE); // disable all logs because we use UART0 connect to HP
     }
+#ifdef HP_EXTRA_UNIT_PINS
+    for (uint8_t unit = 1; unit < HP_UNIT_MAX; unit++)
+      hpConnectExtraUnit(unit);
+#endif
 #else
-    hp.connect(&Serial);
+    hp[0].setSettingsChangedCallback([]() { hpSettingsChanged(0); });
+    hp[0].setStatusChangedCallback([](heatpumpStatus currentStatus) {
+      bootMilestone(BOOT_HP_STATUS);
+      hpPollStatus(0, currentStatus);
+      hpStatusChanged(0, currentStatus);
+    });
+    hp[0].setPacketCallback([](byte *packet, unsigned int length, const char *packetDirection) { hpPacketDebug(0, packet, length, packetDirection); });
+    // Allow Remote/Panel
+    hp[0].enableExternalUpdate();
+    hp[0].enableAutoUpdate();
+    hp[0].connect(&Serial);
+    hpLinkBegin(0, 3); // UART0 RX
+#endif
+    for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+    {
+      hp[unit].setFastSync(true); // no info pacing in the library, hpPoll() decide when sync() send a request
+      hpPollBoost(unit);
+    }
+    bootMark(BOOT_HP_CONNECT);
+#ifdef ESP32
+    hpTaskStart(); // from here only the HP task touch hp
+#else
+    schedAt(TASK_HP_SYNC_RETRY, 0, hpSyncRetry);
+#endif
+    schedAt(TASK_MQTT_RECONNECT, 0, mqttReconnect, MQTT_RETRY_INTERVAL_MS);
+    schedAt(TASK_KEEP_ALIVE, SEND_ALIVE_MSG_INTERVAL_MS, keepAliveTask, SEND_ALIVE_MSG_INTERVAL_MS);
+    schedAt(TASK_PACKET_LOG, PACKET_LOG_PUBLISH_MS, sendPacketLog, PACKET_LOG_PUBLISH_MS);
+#ifdef ESP8266
+    WiFi.setSleepMode(WIFI_MODEM_SLEEP); // radio sleep between beacons while loop() idles
 #endif
-    hp.setFastSync(true); // enable fast sync because we are not care about timer and other package 
-    MDNS.addService("http", "tcp", 80);
   }
   else
   {
     dnsServer.start(DNS_PORT, "*", apIP);
     initCaptivePortal();
   }
+  schedAt(TASK_WIFI_WATCHDOG, WIFI_WATCHDOG_INTERVAL_MS, wifiWatchdog, WIFI_WATCHDOG_INTERVAL_MS);
+#if defined(ESP32) && CONFIG_PM_ENABLE
+  // scale CPU down when loop() idles, keep APB at 80MHz so HP UART is not affected
+  esp_pm_config_t pm_config = {};
+  pm_config.max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+  pm_config.min_freq_mhz = 80;
+  pm_config.light_sleep_enable = false;
+  esp_pm_configure(&pm_config);
+#endif
 #ifdef ARDUINO_OTA
   initOTA();
 #endif
+  bootMark(BOOT_SETUP);
+  ESP_LOGI(TAG, "Setup done in %u us", bootPhaseUs[BOOT_SETUP]);
 }
 
 void otaUpdateProgress(size_t prg, size_t sz)
@@ -513,27 +593,24 @@ bool loadUnit()
   }
 
   size_t size = configFile.size();
-  if (size > 1024)
+  if (size > 1536)
   {
     return false;
   }
   // Allocate document capacity.
-  const size_t capacity = JSON_OBJECT_SIZE(3) + 200;
+  const size_t capacity = JSON_OBJECT_SIZE(15) + 760;
   DynamicJsonDocument doc(capacity);
   deserializeJson(doc, configFile);
-  // unit
+  // unit, assign both ways because it is also reloaded at run time
   String unit_tempUnit = doc["unit_tempUnit"].as<String>();
-  if (unit_tempUnit == "fah")
-    useFahrenheit = true;
+  useFahrenheit = (unit_tempUnit == "fah");
   temp_step = doc["temp_step"].as<String>();
   // mode
   String supportMode = doc["support_mode"].as<String>();
-  if (supportMode == "nht")
-    supportHeatMode = false;
+  supportHeatMode = (supportMode != "nht");
   // quiet
   String quietMode = doc["quiet_mode"].as<String>();
-  if (quietMode == "nqm")
-    supportQuietMode = false;
+  supportQuietMode = (quietMode != "nqm");
   // prevent login password is "null" if not exist key
   if (doc.containsKey("login_password"))
   {
@@ -551,6 +628,23 @@ bool loadUnit()
   {
     system_language_index = 0;
   }
+  // info request polling, out of range values are clamped
+  hpPollMinMs = doc.containsKey("poll_min_ms") ? doc["poll_min_ms"].as<String>().toInt() : HP_POLL_MIN_MS;
+  hpPollMinMs = constrain(hpPollMinMs, HP_POLL_FLOOR_MS, HP_POLL_LIMIT_MS);
+  hpPollOnMaxMs = doc.containsKey("poll_on_max_ms") ? doc["poll_on_max_ms"].as<String>().toInt() : HP_POLL_ON_MAX_MS;
+  hpPollOnMaxMs = constrain(hpPollOnMaxMs, hpPollMinMs, HP_POLL_LIMIT_MS);
+  hpPollOffMaxMs = doc.containsKey("poll_off_max_ms") ? doc["poll_off_max_ms"].as<String>().toInt() : HP_POLL_OFF_MAX_MS;
+  hpPollOffMaxMs = constrain(hpPollOffMaxMs, hpPollMinMs, HP_POLL_LIMIT_MS);
+  // remote temperature, a missing key keep the default
+  remoteTempFilter = doc.containsKey("rt_filter") ? remoteTempFilterFromName(doc["rt_filter"].as<String>()) : REMOTE_TEMP_FILTER_EMA;
+  remoteTempDeadband = doc.containsKey("rt_deadband") ? doc["rt_deadband"].as<String>().toFloat() : 0.2;
+  remoteTempIntervalS = doc.containsKey("rt_interval") ? doc["rt_interval"].as<String>().toInt() : 60;
+  for (uint8_t index = 0; index < TEMP_FUSION_SOURCES; index++)
+  {
+    String key = "rt_src" + String(index + 1);
+    tempFusionConfigure(index, doc.containsKey(key) ? doc[key].as<String>() : String());
+  }
+  tempFusionReset();
   return true;
 }
 
@@ -573,34 +667,19 @@ bool loadOthers()
     return false;
   }
   // Allocate document capacity.
-  const size_t capacity = JSON_OBJECT_SIZE(10) + 401;
+  const size_t capacity = JSON_OBJECT_SIZE(13) + 480;
   DynamicJsonDocument doc(capacity);
   deserializeJson(doc, configFile);
-  // unit
-  String unit_tempUnit = doc["unit_tempUnit"].as<String>();
-  if (unit_tempUnit == "fah")
-    useFahrenheit = true;
   others_haa_topic = doc["haat"].as<String>();
   String haa = doc["haa"].as<String>();
   String debugPckts = doc["debugPckts"].as<String>();
   String debugLogs = doc["debugLogs"].as<String>();
   String webPanel = doc["webPanel"].as<String>();
-  if (strcmp(haa.c_str(), "OFF") == 0)
-  {
-    others_haa = false;
-  }
-  if (strcmp(debugPckts.c_str(), "ON") == 0)
-  {
-    _debugModePckts = true;
-  }
-  if (strcmp(debugLogs.c_str(), "ON") == 0)
-  {
-    _debugModeLogs = true;
-  }
-  if (strcmp(webPanel.c_str(), "OFF") == 0)
-  {
-    _webPanelDisable = true;
-  }
+  // assign both ways because it is also reloaded at run time
+  others_haa = strcmp(haa.c_str(), "OFF") != 0;
+  _debugModePckts = strcmp(debugPckts.c_str(), "ON") == 0;
+  _debugModeLogs = strcmp(debugLogs.c_str(), "ON") == 0;
+  _webPanelDisable = strcmp(webPanel.c_str(), "OFF") == 0;
   // custom tx rx pin
   if (doc.containsKey("txPin") && doc.containsKey("rxPin")) // check key to prevent data is "null" if not exist
   {
@@ -620,10 +699,22 @@ bool loadOthers()
   {
     ntpServer = doc["ntp"].as<String>();
   }
+  if (doc.containsKey("ws_clients"))
+    webClientsMax[WEB_CHANNEL_WS] = doc["ws_clients"].as<String>().toInt();
+  if (doc.containsKey("sse_clients"))
+    webClientsMax[WEB_CHANNEL_EVENTS] = doc["sse_clients"].as<String>().toInt();
+  if (doc.containsKey("slow_clients"))
+    webSlowPolicy = webSlowPolicyFromName(doc["slow_clients"].as<String>());
   return true;
 }
 
-void saveMqtt(String mqttFn, const String& mqttHost, String mqttPort, const String& mqttUser, const String& mqttPwd, String mqttTopic, const String& mqttRootCaCert)
+// Value of a config API only key: imported in api, else the current one is kept
+static String apiConfigKeep(JsonObjectConst api, const char *key, const String &current)
+{
+  return api.containsKey(key) ? api[key].as<String>() : current;
+}
+
+bool saveMqtt(String mqttFn, const String& mqttHost, String mqttPort, const String& mqttUser, const String& mqttPwd, String mqttTopic, const String& mqttRootCaCert)
 {
   // Allocate document capacity.
   const size_t capacity = JSON_OBJECT_SIZE(7) + 400 + 2560;
@@ -645,6 +736,12 @@ void saveMqtt(String mqttFn, const String& mqttHost, String mqttPort, const Stri
     // set default topic if empty
     mqttTopic = default_mqtt_topic;
   }
+  if (mqttFn.length() > HA_TOPIC_PREFIX_MAX || mqttTopic.length() > HA_TOPIC_PREFIX_MAX)
+  {
+    ESP_LOGW(TAG, "MQTT topic or friendly name over %d chars, cut", HA_TOPIC_PREFIX_MAX);
+    mqttFn = mqttFn.substring(0, HA_TOPIC_PREFIX_MAX);
+    mqttTopic = mqttTopic.substring(0, HA_TOPIC_PREFIX_MAX);
+  }
   doc["mqtt_fn"] = mqttFn;
   doc["mqtt_host"] = mqttHost;
   doc["mqtt_port"] = mqttPort;
@@ -655,19 +752,13 @@ void saveMqtt(String mqttFn, const String& mqttHost, String mqttPort, const Stri
   {
     doc["mqtt_root_ca_cert"] = mqttRootCaCert;
   }
-  File configFile = SPIFFS.open(mqtt_conf, "w");
-  if (!configFile)
-  {
-    ESP_LOGD(TAG, "Failed to open config file for writing");
-  }
-  serializeJson(doc, configFile);
-  configFile.close();
+  return writeConfigFile(mqtt_conf, doc);
 }
 
-void saveUnit(String tempUnit, String supportMode, String supportFanMode, String loginPassword, String tempStep, String languageIndex)
+bool saveUnit(String tempUnit, String supportMode, String supportFanMode, String loginPassword, String tempStep, String languageIndex, JsonObjectConst api)
 {
   // Allocate document capacity.
-  const size_t capacity = JSON_OBJECT_SIZE(6) + 200;
+  const size_t capacity = JSON_OBJECT_SIZE(15) + 760;
   DynamicJsonDocument doc(capacity);
   // if temp unit is empty, we use default celcius
   if (tempUnit.isEmpty())
@@ -693,16 +784,23 @@ void saveUnit(String tempUnit, String supportMode, String supportFanMode, String
   if (languageIndex.isEmpty())
     languageIndex = "0";
   doc["language_index"] = languageIndex;
-  File configFile = SPIFFS.open(unit_conf, "w");
-  if (!configFile)
-  {
-    // Serial.println(F("Failed to open config file for writing"));
-  }
-  serializeJson(doc, configFile);
-  configFile.close();
+  // info request polling is set by the config API only
+  doc["poll_min_ms"] = apiConfigKeep(api, "poll_min_ms", String(hpPollMinMs));
+  doc["poll_on_max_ms"] = apiConfigKeep(api, "poll_on_max_ms", String(hpPollOnMaxMs));
+  doc["poll_off_max_ms"] = apiConfigKeep(api, "poll_off_max_ms", String(hpPollOffMaxMs));
+  // remote temperature is set by the config API only
+  doc["rt_filter"] = apiConfigKeep(api, "rt_filter", remoteTempFilterName[remoteTempFilter]);
+  doc["rt_deadband"] = apiConfigKeep(api, "rt_deadband", String(remoteTempDeadband, 2));
+  doc["rt_interval"] = apiConfigKeep(api, "rt_interval", String(remoteTempIntervalS));
+  for (uint8_t index = 0; index < TEMP_FUSION_SOURCES; index++)
+  {
+    String key = "rt_src" + String(index + 1);
+    doc[key] = apiConfigKeep(api, key.c_str(), tempFusionSpec(index));
+  }
+  return writeConfigFile(unit_conf, doc);
 }
 
-void saveWifi(String apSsid, const String& apPwd, String hostName, const String& otaPwd, const String& local_ip, const String& gw_ip, const String& subnet_ip, const String& dns_ip)
+bool saveWifi(String apSsid, const String& apPwd, String hostName, const String& otaPwd, const String& local_ip, const String& gw_ip, const String& subnet_ip, const String& dns_ip)
 {
   // Allocate document capacity.
   const size_t capacity = JSON_OBJECT_SIZE(8) + 130 + 4*(16 /*ipv4 addr*/ + 15 /*max key size*/);
@@ -723,22 +821,18 @@ void saveWifi(String apSsid, const String& apPwd, String hostName, const String&
           doc["static_dns_ip"] = dns_ip;
       }
   }
-  File configFile = SPIFFS.open(wifi_conf, "w");
-  if (!configFile)
-  {
-    ESP_LOGD(TAG, "Failed to open wifi file for writing");
-  }
-  serializeJson(doc, configFile);
-  configFile.close();
+  return writeConfigFile(wifi_conf, doc);
 }
 
-void saveOthers(const String& haa, const String& haat, const String& debugPckts, const String& debugLogs, const String& webPanel, const String& txPin, const String& rxPin, const String& tz, const String &ntp)
+bool saveOthers(const String& haa, const String& haat, const String& debugPckts, const String& debugLogs, const String& webPanel, const String& txPin, const String& rxPin, const String& tz, const String &ntp, JsonObjectConst api)
 {
   // Allocate document capacity.
-  const size_t capacity = JSON_OBJECT_SIZE(10) + 401;
+  const size_t capacity = JSON_OBJECT_SIZE(13) + 480;
   DynamicJsonDocument doc(capacity);
   doc["haa"] = haa;
-  doc["haat"] = haat;
+  if (haat.length() > HA_TOPIC_PREFIX_MAX)
+    ESP_LOGW(TAG, "HA discovery prefix over %d chars, cut", HA_TOPIC_PREFIX_MAX);
+  doc["haat"] = haat.substring(0, HA_TOPIC_PREFIX_MAX);
   doc["debugPckts"] = debugPckts;
   doc["debugLogs"] = debugLogs;
   doc["webPanel"] = webPanel;
@@ -746,13 +840,12 @@ void saveOthers(const String& haa, const String& haat, const String& debugPckts,
   doc["rxPin"] = rxPin;
   doc["tz"] = tz;
   doc["ntp"] = ntp;
-  File configFile = SPIFFS.open(others_conf, "w");
-  if (!configFile)
-  {
-    ESP_LOGD(TAG, "Failed to open other config file for writing");
-  }
-  serializeJson(doc, configFile);
-  configFile.close();
+  // web client limits are set by the config API only
+  doc["ws_clients"] = apiConfigKeep(api, "ws_clients", String(webClientsMax[WEB_CHANNEL_WS]));
+  doc["sse_clients"] = apiConfigKeep(api, "sse_clients", String(webClientsMax[WEB_CHANNEL_EVENTS]));
+  doc["slow_clients"] = apiConfigKeep(api, "slow_clients", webSlowPolicyName[webSlowPolicy]);
+  requestConfigSave &= ~APPLY_OTHERS; // this write supersedes pending changes
+  return writeConfigFile(others_conf, doc);
 }
 
 void saveCurrentOthers()
@@ -764,10 +857,143 @@ void saveCurrentOthers()
   saveOthers(haa, others_haa_topic, debugPckts, debugLogs, webPanel, String(HP_TX), String(HP_RX), timezone, ntpServer);
 }
 
+uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t len)
+{
+  crc = ~crc;
+  while (len--)
+  {
+    crc ^= *data++;
+    for (uint8_t i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+// Write config to temp file, verify CRC read back then replace the old file. Only a verified temp
+// file is renamed to .new, that name mark it complete for recoverConfigFile()
+bool writeConfigFile(const char *path, const JsonDocument &doc)
+{
+  String output;
+  serializeJson(doc, output);
+  uint32_t crc = crc32Update(0, (const uint8_t *)output.c_str(), output.length());
+  String tmpPath = String(path) + ".tmp";
+  String newPath = String(path) + ".new";
+  File tmpFile = SPIFFS.open(tmpPath, "w");
+  if (!tmpFile)
+  {
+    ESP_LOGE(TAG, "Failed to open %s for writing", tmpPath.c_str());
+    return false;
+  }
+  size_t written = tmpFile.write((const uint8_t *)output.c_str(), output.length());
+  tmpFile.close();
+  configWrites.add();
+  saveConfigWrites();
+  uint32_t readCrc = 0;
+  size_t readLen = 0;
+  tmpFile = SPIFFS.open(tmpPath, "r");
+  if (tmpFile)
+  {
+    uint8_t buf[64];
+    int n;
+    while ((n = tmpFile.read(buf, sizeof(buf))) > 0)
+    {
+      readCrc = crc32Update(readCrc, buf, n);
+      readLen += n;
+    }
+    tmpFile.close();
+  }
+  if (written != output.length() || readLen != output.length() || readCrc != crc)
+  {
+    ESP_LOGE(TAG, "Verify %s failed, keep old config", tmpPath.c_str());
+    SPIFFS.remove(tmpPath);
+    return false;
+  }
+  if (!SPIFFS.rename(tmpPath, newPath))
+  {
+    ESP_LOGE(TAG, "Failed to rename %s", tmpPath.c_str());
+    SPIFFS.remove(tmpPath);
+    return false;
+  }
+  SPIFFS.remove(path);
+  if (!SPIFFS.rename(newPath, path))
+  {
+    ESP_LOGE(TAG, "Failed to rename %s", newPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Finish a write interrupted by power loss: a .new file was verified and replace the config, a .tmp
+// file may be partial and is dropped
+void recoverConfigFile(const char *path)
+{
+  String tmpPath = String(path) + ".tmp";
+  String newPath = String(path) + ".new";
+  if (SPIFFS.exists(tmpPath))
+  {
+    ESP_LOGI(TAG, "Drop unverified %s", tmpPath.c_str());
+    SPIFFS.remove(tmpPath);
+  }
+  if (SPIFFS.exists(newPath))
+  {
+    ESP_LOGI(TAG, "Recover %s", path);
+    SPIFFS.remove(path);
+    SPIFFS.rename(newPath, path);
+  }
+}
+
+// Config writes of the previous boots, lost if the file is damaged: it is only a wear statistic
+void loadConfigWrites()
+{
+  File file = SPIFFS.open(writes_file, "r");
+  if (!file)
+    return;
+  configWrites.add(file.readString().toInt());
+  file.close();
+}
+
+void saveConfigWrites()
+{
+  File file = SPIFFS.open(writes_file, "w");
+  if (!file)
+    return;
+  file.print(configWrites.get());
+  file.close();
+}
+
 // Initialize captive portal page
 void initCaptivePortal()
 {
   ESP_LOGD(TAG, "Starting captive portal");
+  initCaptiveRoutes();
+  server.on("/others", handleOthers);
+  server.on("/unit", handleUnit);
+  server.on("/control", handleControl);
+  server.on("/status", handleStatus);
+  server.on("/api/v1/config", WebRequestMethod::HTTP_GET, handleApiConfig);
+  server.on("/api/v1/config", WebRequestMethod::HTTP_POST, handleApiConfigImport, nullptr, handleApiConfigBody);
+  if (!isSecureEnable())
+  {
+    server.on("/upgrade", handleUpgrade);
+    server.on("/upload", WebRequestMethod::HTTP_ANY, handleUploadDone, handleUploadLoop);
+#ifdef ESP32
+    Update.onProgress(otaUpdateProgress);
+#endif
+  }
+  server.onNotFound(handleNotFound);
+  // web socket
+#ifdef WEBSOCKET_ENABLE
+  ws.onEvent(onWsEvent);
+  server.addHandler(&ws);
+#endif
+  server.begin();
+  captive = true;
+}
+
+// Routes of the setup portal, also registered with the station routes for the fallback to AP:
+// "/" serve the setup page while captive
+void initCaptiveRoutes()
+{
   // Required
   server.on("/connecttest.txt", [](AsyncWebServerRequest *request)
             { request->redirect("http://logout.net"); }); // windows 11 captive portal workaround
@@ -789,29 +1015,75 @@ void initCaptivePortal()
   server.on("/ncsi.txt", [](AsyncWebServerRequest *request)
             { request->redirect(localApIpUrl); }); // windows call home
 
-  server.on("/", handleInitSetup);
+  server.on("/", [](AsyncWebServerRequest *request)
+            { captive ? handleInitSetup(request) : handleRoot(request); });
   server.on("/save", handleSaveWifiAndMqtt);
   server.on("/reboot", handleReboot);
-  server.on("/others", handleOthers);
-  server.on("/unit", handleUnit);
+}
+
+// Register web panel routes, the server only listens when web panel is enabled
+void initWebServer()
+{
+  initCaptiveRoutes(); // "/" too
   server.on("/control", handleControl);
+  server.on("/setup", handleSetup);
+  server.on("/mqtt", handleMqtt);
+  server.on("/wifi", handleWifi);
+  server.on("/unit", handleUnit);
   server.on("/status", handleStatus);
-  if (!isSecureEnable())
-  {
-    server.on("/upgrade", handleUpgrade);
-    server.on("/upload", WebRequestMethod::HTTP_ANY, handleUploadDone, handleUploadLoop);
-#ifdef ESP32
-    Update.onProgress(otaUpdateProgress);
-#endif
-  }
+  server.on("/others", handleOthers);
+  server.on("/api/v1/config", WebRequestMethod::HTTP_GET, handleApiConfig);
+  server.on("/api/v1/config", WebRequestMethod::HTTP_POST, handleApiConfigImport, nullptr, handleApiConfigBody);
+  server.on("/api/v1/capture/download", WebRequestMethod::HTTP_GET, handleApiCaptureDownload); // before /api/v1/capture, it match sub paths
+  server.on("/api/v1/capture", handleApiCapture);
+  server.on("/metrics", handleMetrics);
+  initUpgradeRoutes();
   server.onNotFound(handleNotFound);
+  server.on("/login", handleLogin); // always register, login password can be set at run time
   // web socket
 #ifdef WEBSOCKET_ENABLE
   ws.onEvent(onWsEvent);
   server.addHandler(&ws);
 #endif
-  server.begin();
-  captive = true;
+  // event source client
+  events.onConnect([](AsyncEventSourceClient *client) {
+    if (!webClientAdd(WEB_CHANNEL_EVENTS, client))
+      client->close(); // channel full
+    else
+      client->send("hello!", NULL, millis(), 1000);
+  });
+  events.onDisconnect([](AsyncEventSourceClient *client) { webClientRemove(WEB_CHANNEL_EVENTS, client); });
+  server.addHandler(&events);
+}
+
+// Start or stop the web panel to match _webPanelDisable
+void applyWebPanel()
+{
+  if (captive)
+    return; // captive portal always need the web server
+  if (!_webPanelDisable && !webServerStarted)
+  {
+    server.begin();
+    webServerStarted = true;
+    ESP_LOGI(TAG, "Web panel started");
+  }
+  else if (_webPanelDisable && webServerStarted)
+  {
+    server.end();
+    webServerStarted = false;
+    ESP_LOGI(TAG, "Web panel stopped");
+  }
+}
+
+// setup HA topics from mqtt_topic and mqtt_fn
+void initHaTopics()
+{
+  String main_topic = mqtt_topic + F("/") + mqtt_fn;
+  String discovery_prefix = others_haa ? others_haa_topic : F("homeassistant");
+  if (!haTopicsInit(main_topic.c_str(), discovery_prefix.c_str()))
+  {
+    ESP_LOGE(TAG, "MQTT topic or HA discovery prefix too long");
+  }
 }
 
 void initMqtt()
@@ -844,7 +1116,7 @@ void initMqtt()
     static_cast<espMqttClientSecure *>(mqttClient)->setServer(mqtt_server.c_str(), atoi(mqtt_port.c_str()));
     static_cast<espMqttClientSecure *>(mqttClient)->setCredentials(mqtt_username.c_str(), mqtt_password.c_str());
     static_cast<espMqttClientSecure *>(mqttClient)->setClientId(mqtt_client_id.c_str());
-    static_cast<espMqttClientSecure *>(mqttClient)->setWill(ha_availability_topic.c_str(), 1, false, mqtt_payload_unavailable);
+    static_cast<espMqttClientSecure *>(mqttClient)->setWill(haTopicWill(), 1, false, mqtt_payload_unavailable);
 #endif
   }
   else
@@ -860,7 +1132,7 @@ void initMqtt()
     static_cast<espMqttClient *>(mqttClient)->setServer(mqtt_server.c_str(), atoi(mqtt_port.c_str()));
     static_cast<espMqttClient *>(mqttClient)->setCredentials(mqtt_username.c_str(), mqtt_password.c_str());
     static_cast<espMqttClient *>(mqttClient)->setClientId(mqtt_client_id.c_str());
-    static_cast<espMqttClient *>(mqttClient)->setWill(ha_availability_topic.c_str(), 1, false, mqtt_payload_unavailable);
+    static_cast<espMqttClient *>(mqttClient)->setWill(haTopicWill(), 1, false, mqtt_payload_unavailable);
   }
 
   const char *apipch = mqtt_server.c_str();
@@ -935,42 +1207,51 @@ void setDefaults()
   mqtt_client_id.toLowerCase();
 }
 
+// Start wifi without waiting, return false when there is no station config and the setup AP is started
 boolean initWifi()
 {
-  bool connectWifiSuccess = true;
-  if (!ap_ssid.isEmpty())
-  {
-    // wifi connection handle
+  // wifi connection handle
 #ifdef ESP32
-    mqttReconnectTimer = xTimerCreate("mqttTimer", pdMS_TO_TICKS(2000), pdFALSE, (void *)0, reinterpret_cast<TimerCallbackFunction_t>(mqttConnect));
-    // wifiReconnectTimer = xTimerCreate("wifiTimer", pdMS_TO_TICKS(2000), pdFALSE, (void *)0, reinterpret_cast<TimerCallbackFunction_t>(connectWifi));
-    WiFi.onEvent(WiFiEvent);
+  mqttReconnectTimer = xTimerCreate("mqttTimer", pdMS_TO_TICKS(2000), pdFALSE, (void *)0, reinterpret_cast<TimerCallbackFunction_t>(mqttConnect));
+  // wifiReconnectTimer = xTimerCreate("wifiTimer", pdMS_TO_TICKS(2000), pdFALSE, (void *)0, reinterpret_cast<TimerCallbackFunction_t>(connectWifi));
+  WiFi.onEvent(WiFiEvent);
 #elif defined(ESP8266)
-    wifiConnectHandler = WiFi.onStationModeGotIP(onWifiConnect);
-    wifiDisconnectHandler = WiFi.onStationModeDisconnected(onWifiDisconnect); // timer for esp8266 AsyncMqttClient
+  wifiConnectHandler = WiFi.onStationModeGotIP(onWifiConnect);
+  wifiDisconnectHandler = WiFi.onStationModeDisconnected(onWifiDisconnect); // timer for esp8266 AsyncMqttClient
 #endif
-    connectWifiSuccess = connectWifi();
-    if (connectWifiSuccess)
-    {
-      return true;
-    }
-    else
-    {
-      // reset hostname back to default before starting AP mode for privacy
-      hostname = hostnamePrefix;
-      hostname += getId();
-    }
+  if (ap_ssid.isEmpty())
+  {
+    startAccessPoint(true);
+    return false;
+  }
+  configWifiStation();
+  ESP_LOGD(TAG, "Connecting to %s", ap_ssid.c_str());
+  wifiState = WIFI_STATE_CONNECTING;
+  wifi_timeout = millis() + WIFI_CONNECT_TIMEOUT_MS + WIFI_RETRY_INTERVAL_MS; // watchdog wait for the AP fallback
+  ticker.attach(0.25, tick); // flashing the blue LED to indicate WiFi connecting...
+  schedAt(TASK_WIFI_CONNECT, WIFI_CONNECT_TIMEOUT_MS, onWifiConnectTimeout);
+  return true;
+}
+
+// Start the setup AP without waiting, it is password protected when we fall back from a station config
+void startAccessPoint(bool firstSetup)
+{
+  if (!firstSetup)
+  {
+    // reset hostname back to default before starting AP mode for privacy
+    hostname = hostnamePrefix;
+    hostname += getId();
   }
   ESP_LOGE(TAG, "Starting in AP mode, host name: %s", hostname.c_str());
-  // WiFi.disconnect(true);
-  // delay(1000);
+  wifiState = WIFI_STATE_AP;
   WiFi.mode(WIFI_AP);
-  // delay(1000);
   wifi_timeout = millis() + WIFI_RETRY_INTERVAL_MS;
 #ifdef ESP32
   WiFi.persistent(false); // fix crash esp32 https://github.com/espressif/arduino-esp32/issues/2025
+#else
+  WiFi.softAPConfig(apIP, apIP, netMsk); // ESP32 set it on the AP start event
 #endif
-  if (!connectWifiSuccess)
+  if (!firstSetup)
   {
     // Set AP password when falling back to AP on fail
     WiFi.softAP(hostname.c_str(), login_password.isEmpty() ? hostname.c_str() : login_password.c_str());
@@ -980,13 +1261,46 @@ boolean initWifi()
     // First time setup does not require password
     WiFi.softAP(hostname.c_str());
   }
-  delay(2000); // VERY IMPORTANT
-  WiFi.softAPConfig(apIP, apIP, netMsk);
-  ESP_LOGE(TAG, "IP address: %s", WiFi.softAPIP().toString().c_str());
   ticker.attach(0.2, tick); // Start LED to flash rapidly to indicate we are ready for setting up the wifi-connection (entered captive portal).
   WiFi.scanNetworks(true);
-  delay(2000); // VERY IMPORTANT
-  return false;
+}
+
+// Station got an address, run from loop() after the wifi event
+void onWifiReady()
+{
+  if (wifiState != WIFI_STATE_CONNECTING)
+    return;
+  wifiState = WIFI_STATE_CONNECTED;
+  schedCancel(TASK_WIFI_CONNECT);
+  bootMark(BOOT_WIFI_READY);
+  ESP_LOGI(TAG, "Connected to %s, IP address: %s in %u ms", ap_ssid.c_str(), WiFi.localIP().toString().c_str(), bootPhaseUs[BOOT_WIFI_READY] / 1000);
+  ticker.detach(); // Stop blinking the LED because now we are connected:)
+  // keep LED off
+  digitalWrite(blueLedPin, blueLedDisabled);
+  // Auto reconnected
+  WiFi.setAutoReconnect(true);
+  WiFi.persistent(true);
+}
+
+// No address after WIFI_CONNECT_TIMEOUT_MS, switch to the captive portal. The portal routes were
+// registered with the station ones, the HP link keep running
+void onWifiConnectTimeout()
+{
+  if (wifiState != WIFI_STATE_CONNECTING)
+    return;
+  ESP_LOGD(TAG, "Failed to connect to wifi");
+  schedCancel(TASK_BOOT_DEFERRED); // boot in AP mode skip the station extras
+  schedCancel(TASK_MQTT_RECONNECT);
+  schedCancel(TASK_KEEP_ALIVE);
+  schedCancel(TASK_PACKET_LOG);
+  startAccessPoint(false);
+  dnsServer.start(DNS_PORT, "*", apIP);
+  captive = true;
+  if (!webServerStarted)
+  {
+    server.begin(); // captive portal always need the web server
+    webServerStarted = true;
+  }
 }
 
 // Handler webserver response
@@ -1043,7 +1357,7 @@ void handleNotFound(AsyncWebServerRequest *request)
     String menuRootPage = FPSTR(html_menu_root);
     menuRootPage.replace(F("_SHOW_LOGOUT_"), (String)(login_password.length() > 0));
     // not show control button if hp not connected
-    menuRootPage.replace(F("_SHOW_CONTROL_"), (String)(hp.isConnected()));
+    menuRootPage.replace(F("_SHOW_CONTROL_"), (String)(hpIsConnected()));
     sendWrappedHTML(request, menuRootPage);
   }
 }
@@ -1095,6 +1409,15 @@ void handleReboot(AsyncWebServerRequest *request)
   sendRebootRequest(3); // Reboot after 3 seconds
 }
 
+// Page for settings saved and applied without reboot
+void sendSaveApplyPage(AsyncWebServerRequest *request)
+{
+  String saveApplyPage = FPSTR(html_page_save_apply);
+  // localize
+  saveApplyPage.replace(F("_TXT_M_SAVE_APPLY_"), translatedWord(FL_(txt_m_save_apply)));
+  sendWrappedHTML(request, saveApplyPage);
+}
+
 void handleRoot(AsyncWebServerRequest *request)
 {
   if (!checkLogin(request)) {
@@ -1123,7 +1446,7 @@ void handleRoot(AsyncWebServerRequest *request)
     // set data
     menuRootPage.replace(F("_SHOW_LOGOUT_"), (String)(login_password.length() > 0));
     // not show control button if hp not connected
-    menuRootPage.replace(F("_SHOW_CONTROL_"), (String)(hp.isConnected()));
+    menuRootPage.replace(F("_SHOW_CONTROL_"), (String)(hpIsConnected()));
     sendWrappedHTML(request, menuRootPage);
   }
 }
@@ -1234,12 +1557,8 @@ void handleOthers(AsyncWebServerRequest *request)
   if (request->hasArg("save"))
   {
     saveOthers(request->arg("HAA"), request->arg("haat"), request->arg("DebugPckts"), request->arg("DebugLogs"), request->arg("web_p"), request->arg("tx_pin"), request->arg("rx_pin"), request->arg("tz"), request->arg("ntp"));
-    String saveRebootPage = FPSTR(html_page_save_reboot);
-    // localize
-    saveRebootPage.replace(F("_TXT_M_SAVE_"), translatedWord(FL_(txt_m_save)));
-    String countDown = FPSTR(count_down_script);
-    sendWrappedHTML(request, saveRebootPage + countDown);
-    sendRebootRequest(5); // Reboot after 5 seconds
+    sendSaveApplyPage(request);
+    sendConfigApplyRequest(APPLY_OTHERS); // only reboot if UART pins changed
   }
   else
   {
@@ -1316,12 +1635,8 @@ void handleMqtt(AsyncWebServerRequest *request)
   if (request->hasArg("save"))
   {
     saveMqtt(request->arg("fn"), request->arg("mh"), request->arg("ml"), request->arg("mu"), request->arg("mp"), request->arg("mt"), request->arg("mrcc"));
-    String saveRebootPage = FPSTR(html_page_save_reboot);
-    // localize
-    saveRebootPage.replace(F("_TXT_M_SAVE_"), translatedWord(FL_(txt_m_save)));
-    String countDown = FPSTR(count_down_script);
-    sendWrappedHTML(request, saveRebootPage + countDown);
-    sendRebootRequest(5); // Reboot after 5 seconds
+    sendSaveApplyPage(request);
+    sendConfigApplyRequest(APPLY_MQTT);
   }
   else
   {
@@ -1366,12 +1681,8 @@ void handleUnit(AsyncWebServerRequest *request)
     if (loginPassword == confirmLoginPassword)
     {
       saveUnit(request->arg("tu"), request->arg("md"), request->arg("mdf"), loginPassword, request->arg("temp_step"), request->arg("language"));
-      String saveRebootPage = FPSTR(html_page_save_reboot);
-      // localize
-      saveRebootPage.replace(F("_TXT_M_SAVE_"), translatedWord(FL_(txt_m_save)));
-      String countDown = FPSTR(count_down_script);
-      sendWrappedHTML(request, saveRebootPage + countDown);
-      sendRebootRequest(5); // Reboot after 5 seconds
+      sendSaveApplyPage(request);
+      sendConfigApplyRequest(APPLY_UNIT);
     }
     else
     {
@@ -1460,19 +1771,14 @@ void handleWifi(AsyncWebServerRequest *request)
     }
     ESP_LOGD(TAG, "handleWifi: %s", ssid.c_str());
     saveWifi(ssid, request->arg("psk"), request->arg("hn"), request->arg("otapwd"), request->arg("stip"), request->arg("stgw"), request->arg("stmask"), request->arg("stdns"));
-    String saveRebootPage = FPSTR(html_page_save_reboot);
-    // localize
-    saveRebootPage.replace(F("_TXT_M_SAVE_"), translatedWord(FL_(txt_m_save)));
-    String countDown = FPSTR(count_down_script);
-    sendWrappedHTML(request, saveRebootPage + countDown);
-    sendRebootRequest(5); // reboot after 5 seconds
+    sendSaveApplyPage(request);
+    sendConfigApplyRequest(APPLY_WIFI);
   }
   else
   {
     if (wifi_list.isEmpty() || millis() - lastWifiScanMillis > WIFI_SCAN_PERIOD) // only scan every WIFI_SCAN_PERIOD
     {
-      requestWifiScan = true;
-      requestWifiScanTime = millis() + 50;
+      schedAt(TASK_WIFI_SCAN, 50, startWifiScan);
     }
 
     String wifiPageHtml = FPSTR(html_page_wifi);
@@ -1531,6 +1837,11 @@ void handleStatus(AsyncWebServerRequest *request)
   statusPage.replace(F("_TXT_STATUS_TITLE_"), translatedWord(FL_(txt_status_title)));
   statusPage.replace(F("_TXT_STATUS_HVAC_"), translatedWord(FL_(txt_status_hvac)));
   statusPage.replace(F("_TXT_RETRIES_HVAC_"), translatedWord(FL_(txt_retries_hvac)));
+  statusPage.replace(F("_TXT_LATENCY_HVAC_"), translatedWord(FL_(txt_latency_hvac)));
+  statusPage.replace(F("_TXT_LOOP_STATS_"), translatedWord(FL_(txt_loop_stats)));
+  statusPage.replace(F("_TXT_WEB_CLIENTS_"), translatedWord(FL_(txt_web_clients)));
+  statusPage.replace(F("_TXT_TELEMETRY_"), translatedWord(FL_(txt_telemetry)));
+  statusPage.replace(F("_TXT_STARTUP_"), translatedWord(FL_(txt_startup)));
   statusPage.replace(F("_TXT_STATUS_MQTT_"), translatedWord(FL_(txt_status_mqtt)));
   statusPage.replace(F("_TXT_STATUS_WIFI_IP_"), translatedWord(FL_(txt_status_wifi_ip)));
   statusPage.replace(F("_TXT_STATUS_WIFI_"), translatedWord(FL_(txt_status_wifi)));
@@ -1550,7 +1861,7 @@ void handleStatus(AsyncWebServerRequest *request)
   disconnected += translatedWord(FL_(txt_status_disconnect));
   disconnected += F("</b>(_MQTT_REASON_)</font>");
   disconnected.replace(F("_MQTT_REASON_"), String(mqtt_disconnect_reason));
-  if (hp.isConnected())
+  if (hpIsConnected())
   {
     statusPage.replace(F("_HVAC_STATUS_"), connected);
   }
@@ -1558,7 +1869,27 @@ void handleStatus(AsyncWebServerRequest *request)
   {
     statusPage.replace(F("_HVAC_STATUS_"), disconnected);
   }
-  statusPage.replace(F("_HVAC_RETRIES_"), String(hpConnectionTotalRetries));
+  String retries = String(hpLink[0].retries);
+  if (!hpIsConnected())
+  {
+    retries += F(" (backoff stage ");
+    retries += String(hpLink[0].stage);
+    retries += F(", next in ");
+    retries += String(hpLinkRetryInMs(0) / 1000);
+    retries += F(" s)");
+  }
+  statusPage.replace(F("_HVAC_RETRIES_"), retries);
+#ifdef ESP32
+  String latency = String(hpFrameLatencyLastUs / 1000.0f, 1);
+  latency += F(" ms (max ");
+  latency += String(hpFrameLatencyMaxUs / 1000.0f, 1);
+  latency += F(" ms, ");
+  latency += String(hpFrames.get());
+  latency += F(" frames)");
+  statusPage.replace(F("_HVAC_LATENCY_"), latency);
+#else
+  statusPage.replace(F("_HVAC_LATENCY_"), F("-")); // serial is polled from loop()
+#endif
   if (WiFi.localIP().toString() == "0.0.0.0" || WiFi.localIP().toString() == "")
   {
     ESP_LOGD(TAG, "Failed to get IP address");
@@ -1590,6 +1921,10 @@ void handleStatus(AsyncWebServerRequest *request)
   statusPage.replace(F("_FREE_HEAP_"), heap);
   statusPage.replace(F("_CURRENT_TIME_"), F("<font color='blue'><b>") + getCurrentTime() + F("</b></font>"));
   statusPage.replace(F("_BOOT_TIME_"), F("<font color='orange'><b>") + getUpTime() + F("</b></font>"));
+  statusPage.replace(F("_LOOP_STATS_"), getLoopStallText());
+  statusPage.replace(F("_STARTUP_"), getBootProfileText());
+  statusPage.replace(F("_WEB_CLIENTS_"), getWebClientsText());
+  statusPage.replace(F("_TELEMETRY_"), getTelemetryText());
   sendWrappedHTML(request, statusPage);
 }
 
@@ -1689,7 +2024,7 @@ void handleControl(AsyncWebServerRequest *request)
       return;
   }
   // not connected to hp, redirect to status page
-  if (!hp.isConnected())
+  if (!hpIsConnected())
   {
     AsyncWebServerResponse *response = request->beginResponse(301);
     response->addHeader("Location", "/status");
@@ -1698,7 +2033,8 @@ void handleControl(AsyncWebServerRequest *request)
     return;
   }
 
-  heatpumpSettings settings = hp.getSettings();
+  heatpumpSettings settings = hpGetSettings();
+  heatpumpStatus status = hpGetStatus();
   settings = change_states(request, settings);
 
   String controlPage = FPSTR(control_script_events);
@@ -1720,9 +2056,9 @@ void handleControl(AsyncWebServerRequest *request)
   htmlControlPage.replace(F("_TXT_F_ON_"), translatedWord(FL_(txt_f_on)));
   htmlControlPage.replace(F("_TXT_F_OFF_"), translatedWord(FL_(txt_f_off)));
   // set data
-  htmlControlPage.replace(F("_ROOMTEMP_"), String(convertCelsiusToLocalUnit(hp.getRoomTemperature(), useFahrenheit)));
+  htmlControlPage.replace(F("_ROOMTEMP_"), String(convertCelsiusToLocalUnit(status.roomTemperature, useFahrenheit)));
   htmlControlPage.replace(F("_TEMP_SCALE_"), getTemperatureScale());
-  htmlControlPage.replace(F("_TEMP_"), String(convertCelsiusToLocalUnit(hp.getTemperature(), useFahrenheit)));
+  htmlControlPage.replace(F("_TEMP_"), String(convertCelsiusToLocalUnit(settings.temperature, useFahrenheit)));
 
   if (!(String(settings.power).isEmpty())) // null may crash with multitask
   {
@@ -1748,115 +2084,753 @@ void handleControl(AsyncWebServerRequest *request)
   // time (approx 6k).
 }
 
-#ifdef METRICS
-void handleMetrics(AsyncWebServerRequest *request)
+// Command latency percentiles in Prometheus format
+void getCommandLatencyMetrics(String &metrics)
 {
-  String metrics = FPSTR(html_metrics);
-
-  heatpumpSettings currentSettings = hp.getSettings();
-  heatpumpStatus currentStatus = hp.getStatus();
-
-  String hppower = strcmp(currentSettings.power, "ON") == 0 ? "1" : "0";
-
-  String hpfan = currentSettings.fan;
-  if (hpfan == "AUTO")
-    hpfan = "-1";
-  if (hpfan == "QUIET")
-    hpfan = "0";
-
-  String hpvane = currentSettings.vane;
-  if (hpvane == "AUTO")
-    hpvane = "-1";
-  if (hpvane == "SWING")
-    hpvane = "0";
-
-  String hpwidevane = "-2";
-  if (strcmp(currentSettings.wideVane, "SWING") == 0)
-    hpwidevane = "0";
-  if (strcmp(currentSettings.wideVane, "<<") == 0)
-    hpwidevane = "1";
-  if (strcmp(currentSettings.wideVane, "<") == 0)
-    hpwidevane = "2";
-  if (strcmp(currentSettings.wideVane, "|") == 0)
-    hpwidevane = "3";
-  if (strcmp(currentSettings.wideVane, ">") == 0)
-    hpwidevane = "4";
-  if (strcmp(currentSettings.wideVane, ">>") == 0)
-    hpwidevane = "5";
-  if (strcmp(currentSettings.wideVane, "<>") == 0)
-    hpwidevane = "6";
-
-  String hpmode = "-2";
-  if (strcmp(currentSettings.mode, "AUTO") == 0)
-    hpmode = "-1";
-  if (strcmp(currentSettings.mode, "COOL") == 0)
-    hpmode = "1";
-  if (strcmp(currentSettings.mode, "DRY") == 0)
-    hpmode = "2";
-  if (strcmp(currentSettings.mode, "HEAT") == 0)
-    hpmode = "3";
-  if (strcmp(currentSettings.mode, "FAN") == 0)
-    hpmode = "4";
-  if (hppower == "0")
-    hpmode = "0";
-
-  metrics.replace(F("_UNIT_NAME_"), hostname);
-  metrics.replace(F("_VERSION_"), m2mqtt_version);
-  metrics.replace(F("_POWER_"), hppower);
-  metrics.replace(F("_ROOMTEMP_"), (String)currentStatus.roomTemperature);
-  metrics.replace(F("_TEMP_"), (String)currentSettings.temperature);
-  metrics.replace(F("_FAN_"), hpfan);
-  metrics.replace(F("_VANE_"), hpvane);
-  metrics.replace(F("_WIDEVANE_"), hpwidevane);
-  metrics.replace(F("_MODE_"), hpmode);
-  metrics.replace(F("_OPER_"), (String)currentStatus.operating);
-  metrics.replace(F("_COMPFREQ_"), (String)currentStatus.compressorFrequency);
-  sendWrappedHTML(request, metrics);
+  metrics += F("# HELP mitsubishi2mqtt_command_latency_seconds MQTT set command to unit ack and to state publish, last 16 commands\n"
+               "# TYPE mitsubishi2mqtt_command_latency_seconds summary\n");
+  for (uint8_t kind = 0; kind < CMD_TRACE_KIND_COUNT; kind++)
+  {
+    for (uint8_t ack = 0; ack < 2; ack++)
+    {
+      CmdLatencyPercentiles latency = cmdLatencyGet((CmdTraceKind)kind, ack);
+      if (latency.size == 0)
+        continue;
+      String labels = F("hostname=\"_UNIT_NAME_\",cmd=\"");
+      labels += cmdTraceKindName[kind];
+      labels += ack ? F("\",stage=\"ack\"") : F("\",stage=\"state\"");
+      const uint16_t values[] = {latency.p50, latency.p95, latency.p99};
+      const char *const quantiles[] = {"0.5", "0.95", "0.99"};
+      for (uint8_t i = 0; i < 3; i++)
+      {
+        metrics += F("mitsubishi2mqtt_command_latency_seconds{");
+        metrics += labels + F(",quantile=\"") + quantiles[i] + F("\"} ");
+        metrics += String(values[i] / 1000.0f, 3);
+        metrics += '\n';
+      }
+      metrics += F("mitsubishi2mqtt_command_latency_seconds_count{");
+      metrics += labels + F("} ") + String(cmdLatencyCount((CmdTraceKind)kind)) + '\n';
+    }
+  }
 }
-#endif
 
-// login page, also called for logout
-void handleLogin(AsyncWebServerRequest *request)
+// Label of the samples of an extra unit, the first unit has none
+String metricsUnitLabel(uint8_t unit)
 {
-  bool loginSuccess = false;
-  String msg;
-  String loginPage = FPSTR(html_page_login);
-  // localize
-  loginPage.replace(F("_TXT_LOGIN_TITLE_"), translatedWord(FL_(txt_login_title)));
-  loginPage.replace(F("_TXT_LOGIN_PH_USER_"), translatedWord(FL_(txt_login_ph_user)));
-  loginPage.replace(F("_TXT_LOGIN_PH_PWD_"), translatedWord(FL_(txt_login_ph_pwd)));
-  loginPage.replace(F("_TXT_LOGIN_USERNAME_"), translatedWord(FL_(txt_login_username)));
-  loginPage.replace(F("_TXT_LOGIN_PASSWORD_"), translatedWord(FL_(txt_login_password)));
-  loginPage.replace(F("_TXT_LOGIN_OPEN_STATUS_"), translatedWord(FL_(txt_login_open_status)));
-  loginPage.replace(F("_TXT_LOGIN_"), translatedWord(FL_(txt_login)));
-  if (request->hasHeader("Cookie"))
-  {
-    // Found cookie;
-    String cookie = request->header("Cookie");
-  }
-  if (request->hasArg("USERNAME") || request->hasArg("PASSWORD") || request->hasArg("LOGOUT"))
-  {
-    if (request->hasArg("LOGOUT"))
+  return unit > 0 ? ",unit=\"" + String(unit + 1) + "\"" : String();
+}
+
+// CN105 reconnect times and backoff in Prometheus format, one sample per connected unit
+void getHpLinkMetrics(String &metrics)
+{
+  metrics += F("# HELP mitsubishi2mqtt_hp_reconnect_seconds CN105 link lost to reconnect, last 16 outages\n"
+               "# TYPE mitsubishi2mqtt_hp_reconnect_seconds summary\n");
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+  {
+    if (!hpHasUart(unit))
+      continue;
+    String label = metricsUnitLabel(unit);
+    HpLinkPercentiles reconnect = hpLinkReconnectGet(unit);
+    if (reconnect.size > 0)
     {
-      // logout
-      loginSuccess = false;
+      metrics += "mitsubishi2mqtt_hp_reconnect_seconds{hostname=\"_UNIT_NAME_\"" + label + ",quantile=\"0.5\"} ";
+      metrics += String(reconnect.p50 / 1000.0f, 3) + '\n';
+      metrics += "mitsubishi2mqtt_hp_reconnect_seconds{hostname=\"_UNIT_NAME_\"" + label + ",quantile=\"0.95\"} ";
+      metrics += String(reconnect.p95 / 1000.0f, 3) + '\n';
+      metrics += "mitsubishi2mqtt_hp_reconnect_seconds{hostname=\"_UNIT_NAME_\"" + label + ",quantile=\"1\"} ";
+      metrics += String(reconnect.max / 1000.0f, 3) + '\n';
     }
-    if (request->hasArg("USERNAME") && request->hasArg("PASSWORD"))
+    metrics += "mitsubishi2mqtt_hp_reconnect_seconds_count{hostname=\"_UNIT_NAME_\"" + label + "} ";
+    metrics += String(hpLink[unit].reconnects) + '\n';
+  }
+  const struct
+  {
+    const char *name;
+    const char *help;
+    const char *type;
+    uint32_t HpLink::*value;
+  } counters[] = {
+      {"hp_backoff_stage", "CN105 reconnect backoff stage, 0 while connected", "gauge", &HpLink::stage},
+      {"hp_retries_total", "CN105 connect retries", "counter", &HpLink::retries},
+      {"hp_activity_wakes_total", "Backoff restarts on UART activity while the link was down", "counter", &HpLink::wakes}};
+  for (const auto &counter : counters)
+  {
+    metrics += String("# HELP mitsubishi2mqtt_") + counter.name + ' ' + counter.help + '\n';
+    metrics += String("# TYPE mitsubishi2mqtt_") + counter.name + ' ' + counter.type + '\n';
+    for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
     {
-      if (request->arg("USERNAME") == login_username && request->arg("PASSWORD") == login_password)
+      if (!hpHasUart(unit))
+        continue;
+      metrics += String("mitsubishi2mqtt_") + counter.name + "{hostname=\"_UNIT_NAME_\"" + metricsUnitLabel(unit) + "} ";
+      metrics += String(hpLink[unit].*counter.value) + '\n';
+    }
+  }
+}
+
+// Extended CN105 fields in Prometheus format, only the fields a unit reported
+void getHpExtendedMetrics(String &metrics)
+{
+  HpExtended ext[HP_UNIT_MAX];
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+    ext[unit] = hpExtGet(unit);
+  const struct
+  {
+    uint8_t field;
+    const char *name;
+    const char *help;
+    const char *type;
+  } gauges[] = {
+      {HP_EXT_HAS_OUTDOOR_TEMP, "outdoor_temperature_celsius", "Outdoor unit air temperature", "gauge"},
+      {HP_EXT_HAS_POWER, "input_power_watts", "Input power reported by the unit", "gauge"},
+      {HP_EXT_HAS_ENERGY, "energy_kwh_total", "Energy counter of the unit", "counter"},
+      {HP_EXT_HAS_ERROR, "error_code", "Unit error code, 0 without error", "gauge"},
+      {HP_EXT_HAS_RUNTIME, "runtime_seconds_total", "Unit operating time", "counter"}};
+  for (const auto &gauge : gauges)
+  {
+    bool header = false;
+    for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+    {
+      if (!(ext[unit].has & gauge.field))
+        continue;
+      if (!header)
       {
-        loginSuccess = true;
-        msg = F("<b><font color='red'>");
-        msg += translatedWord(FL_(txt_login_sucess));
-        msg += F("</font></b>");
-        loginPage += F("<script>");
-        loginPage += F("setTimeout(function () {");
-        loginPage += F("window.location.href= '/';");
-        loginPage += F("}, 3000);");
-        loginPage += F("</script>");
-        // Log in Successful;
+        metrics += String("# HELP mitsubishi2mqtt_") + gauge.name + ' ' + gauge.help + '\n';
+        metrics += String("# TYPE mitsubishi2mqtt_") + gauge.name + ' ' + gauge.type + '\n';
+        header = true;
       }
-      else
+      metrics += String("mitsubishi2mqtt_") + gauge.name + "{hostname=\"_UNIT_NAME_\"" + metricsUnitLabel(unit) + "} ";
+      switch (gauge.field)
+      {
+      case HP_EXT_HAS_OUTDOOR_TEMP:
+        metrics += String(ext[unit].outdoorTemperature, 1);
+        break;
+      case HP_EXT_HAS_POWER:
+        metrics += String(ext[unit].inputPower);
+        break;
+      case HP_EXT_HAS_ENERGY:
+        metrics += String(ext[unit].energy, 1);
+        break;
+      case HP_EXT_HAS_ERROR:
+        metrics += String(ext[unit].errorCode);
+        break;
+      case HP_EXT_HAS_RUNTIME:
+        metrics += String(ext[unit].runtimeMinutes * 60);
+        break;
+      }
+      metrics += '\n';
+    }
+  }
+}
+
+#define HVAC_METRICS 9
+static const char *const hvacMetricName[HVAC_METRICS][2] = {
+    {"power", "Heat pump power setting"},
+    {"temperature_room_celsius", "Current room temperature"},
+    {"temperature_target_celsius", "Target room temperature"},
+    {"fan_speed", "Heat pump fan speed"},
+    {"vane", "Heat pump vane setting"},
+    {"widevane", "Heat pump wide vane setting"},
+    {"mode", "Heat pump operating mode"},
+    {"operating", "Heat pump operational status"},
+    {"compressor_frequency", "Heat pump compressor frequency"}};
+
+// Sample values of a unit in hvacMetricName order, false when the unit did not answer yet
+static bool getHvacMetricValues(uint8_t unit, String values[HVAC_METRICS])
+{
+  heatpumpSettings settings = hpGetSettings(unit);
+  heatpumpStatus status = hpGetStatus(unit);
+  if (String(settings.power).isEmpty()) // not connected yet, null may crash with multitask
+    return false;
+  static const char *const wideVanes[] = {"SWING", "<<", "<", "|", ">", ">>", "<>"};
+  static const char *const modes[] = {"AUTO", "", "COOL", "DRY", "HEAT", "FAN"}; // -1 to 4
+  bool power = strcmp(settings.power, "ON") == 0;
+  String fan = settings.fan;
+  if (fan == "AUTO")
+    fan = "-1";
+  else if (fan == "QUIET")
+    fan = "0";
+  String vane = settings.vane;
+  if (vane == "AUTO")
+    vane = "-1";
+  else if (vane == "SWING")
+    vane = "0";
+  int wideVane = 0;
+  for (uint8_t i = 0; i < sizeof(wideVanes) / sizeof(wideVanes[0]); i++)
+    if (strcmp(settings.wideVane, wideVanes[i]) == 0)
+      wideVane = i;
+  int mode = -2;
+  for (uint8_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    if (modes[i][0] != '\0' && strcmp(settings.mode, modes[i]) == 0)
+      mode = i - 1;
+  if (!power)
+    mode = 0;
+  values[0] = power ? "1" : "0";
+  values[1] = String(status.roomTemperature);
+  values[2] = String(settings.temperature);
+  values[3] = fan;
+  values[4] = vane;
+  values[5] = String(wideVane);
+  values[6] = String(mode);
+  values[7] = String(status.operating);
+  values[8] = String(status.compressorFrequency);
+  return true;
+}
+
+// Settings and status of each unit in Prometheus format, the mitsubishi_ names are kept for old dashboards
+void getHvacMetrics(String &metrics)
+{
+  String values[HP_UNIT_MAX][HVAC_METRICS];
+  bool answered[HP_UNIT_MAX];
+  bool any = false;
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+  {
+    answered[unit] = hpHasUart(unit) && getHvacMetricValues(unit, values[unit]);
+    any |= answered[unit];
+  }
+  if (!any)
+    return;
+  for (uint8_t sample = 0; sample < HVAC_METRICS; sample++)
+  {
+    metrics += F("# HELP mitsubishi_");
+    metrics += hvacMetricName[sample][0];
+    metrics += ' ';
+    metrics += hvacMetricName[sample][1];
+    metrics += F("\n# TYPE mitsubishi_");
+    metrics += hvacMetricName[sample][0];
+    metrics += F(" gauge\n");
+    for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+    {
+      if (!answered[unit])
+        continue;
+      metrics += F("mitsubishi_");
+      metrics += hvacMetricName[sample][0];
+      metrics += F("{hostname=\"_UNIT_NAME_\"");
+      metrics += metricsUnitLabel(unit);
+      metrics += F("} ");
+      metrics += values[unit][sample];
+      metrics += '\n';
+    }
+  }
+}
+
+// Sample the telemetry gauges that are read rather than recorded
+void telemetryRefresh()
+{
+  uptimeGauge.set(getUpTimeSeconds());
+  heapFreeGauge.set(getFreeHeapBytes());
+  heapMinFreeGauge.set(getMinFreeHeapBytes());
+  heapLargestBlockGauge.set(getLargestFreeBlockBytes());
+  wifiRssiGauge.set(WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0);
+  mqttConnectedGauge.set(mqtt_connected);
+  for (uint8_t channel = 0; channel < WEB_CHANNEL_COUNT; channel++)
+  {
+    webClientsGauge.set(channel, webClientCount((WebChannel)channel));
+    webClientQueuedGauge.set(channel, webClientQueued((WebChannel)channel));
+  }
+}
+
+// TelemetryWrite into a String
+void telemetryAppend(void *out, const char *text)
+{
+  *(String *)out += text;
+}
+
+// Version then one telemetry series per part in Prometheus format
+bool getTelemetryMetrics(String &metrics, uint8_t part)
+{
+  if (part == 0)
+  {
+    telemetryRefresh();
+    metrics += F("# HELP mitsubishi2mqtt_version Mitsubishi2MQTT version\n"
+                 "# TYPE mitsubishi2mqtt_version gauge\n"
+                 "mitsubishi2mqtt_version{hostname=\"_UNIT_NAME_\",version=\"");
+    metrics += m2mqtt_version;
+    metrics += F("\"} 1\n");
+    metrics += F("# HELP mitsubishi2mqtt_up Always 1, the device answered\n"
+                 "# TYPE mitsubishi2mqtt_up gauge\n"
+                 "mitsubishi2mqtt_up{hostname=\"_UNIT_NAME_\"} 1\n");
+  }
+  uint8_t series;
+  TelemetryMetric *metric = telemetryAt(part, series);
+  if (metric != nullptr)
+    telemetryFormat(*metric, series, TELEMETRY_PROMETHEUS, "hostname=\"_UNIT_NAME_\"", telemetryAppend, &metrics);
+  return part + 1 < telemetrySeriesCount;
+}
+
+// A section append its families to the exposition, after the telemetry registry streamed a part at a time
+typedef void (*MetricsSection)(String &metrics);
+
+static const MetricsSection metricsSections[] = {
+    getHvacMetrics,
+    getCommandLatencyMetrics,
+    getHpLinkMetrics,
+    getHpExtendedMetrics};
+static constexpr uint8_t METRICS_SECTIONS = sizeof(metricsSections) / sizeof(metricsSections[0]);
+
+struct MetricsStream
+{
+  uint8_t section; // 0 for the telemetry registry, then metricsSections from 1
+  uint8_t part;    // of the telemetry registry
+  String pending; // part rendered, not all sent yet
+  size_t sent;
+};
+
+// Fill a chunk of the response, rendering the next part when the pending one is sent. 0 at the end
+size_t metricsStreamRead(MetricsStream &stream, uint8_t *buffer, size_t maxLen)
+{
+  size_t length = 0;
+  while (length < maxLen)
+  {
+    if (stream.sent == stream.pending.length())
+    {
+      if (stream.section > METRICS_SECTIONS)
+        break;
+      stream.pending = "";
+      stream.sent = 0;
+      if (stream.section > 0)
+        metricsSections[stream.section++ - 1](stream.pending);
+      else if (!getTelemetryMetrics(stream.pending, stream.part++))
+        stream.section++;
+      stream.pending.replace(F("_UNIT_NAME_"), hostname);
+      continue;
+    }
+    size_t chunk = min(maxLen - length, stream.pending.length() - stream.sent);
+    memcpy(buffer + length, stream.pending.c_str() + stream.sent, chunk);
+    stream.sent += chunk;
+    length += chunk;
+  }
+  return length;
+}
+
+// GET /metrics, Prometheus text exposition streamed one family or stage at a time
+void handleMetrics(AsyncWebServerRequest *request)
+{
+  if (!checkApiLogin(request))
+  {
+    return;
+  }
+  MetricsStream stream = {0, 0, String(), 0};
+  AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain; version=0.0.4; charset=utf-8",
+                                                                   [stream](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t
+                                                                   { return metricsStreamRead(stream, buffer, maxLen); });
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+// Bulk config API, sections use the same keys as the config files
+static const char *const apiConfigSections[] = {"wifi", "mqtt", "unit", "others"}; // index i is flag (1 << i), APPLY_WIFI...APPLY_OTHERS
+static const char *const apiConfigWifiKeys[] = {"ap_ssid", "ap_pwd", "hostname", "ota_pwd", "static_ip", "static_gw_ip", "static_subnet", "static_dns_ip", nullptr};
+static const char *const apiConfigMqttKeys[] = {"mqtt_fn", "mqtt_host", "mqtt_port", "mqtt_user", "mqtt_pwd", "mqtt_topic", "mqtt_root_ca_cert", nullptr};
+static const char *const apiConfigUnitKeys[] = {"unit_tempUnit", "temp_step", "support_mode", "quiet_mode", "login_password", "language_index", "rt_filter", "rt_deadband", "rt_interval", "rt_src1", "rt_src2", "rt_src3", "poll_min_ms", "poll_on_max_ms", "poll_off_max_ms", nullptr};
+static const char *const apiConfigOthersKeys[] = {"haa", "haat", "debugPckts", "debugLogs", "webPanel", "txPin", "rxPin", "tz", "ntp", "ws_clients", "sse_clients", "slow_clients", nullptr};
+static const char *const *const apiConfigKeys[] = {apiConfigWifiKeys, apiConfigMqttKeys, apiConfigUnitKeys, apiConfigOthersKeys}; // rows end with nullptr
+static const char *const apiConfigSecrets[] = {"ap_pwd", "ota_pwd", "mqtt_pwd", "login_password"};
+static constexpr uint8_t API_CONFIG_SECTIONS = sizeof(apiConfigSections) / sizeof(const char *);
+// all keys of all sections, sizes the import filter and document
+static constexpr size_t API_CONFIG_KEYS = sizeof(apiConfigWifiKeys) / sizeof(const char *) + sizeof(apiConfigMqttKeys) / sizeof(const char *) +
+                                          sizeof(apiConfigUnitKeys) / sizeof(const char *) + sizeof(apiConfigOthersKeys) / sizeof(const char *) - API_CONFIG_SECTIONS;
+static_assert(sizeof(apiConfigKeys) / sizeof(apiConfigKeys[0]) == API_CONFIG_SECTIONS, "one key row per config section");
+
+const char *apiConfigFile(uint8_t section)
+{
+  switch (section)
+  {
+  case 0:
+    return wifi_conf;
+  case 1:
+    return mqtt_conf;
+  case 2:
+    return unit_conf;
+  default:
+    return others_conf;
+  }
+}
+
+size_t apiConfigCapacity(uint8_t section)
+{
+  if (section == 1)
+    return JSON_OBJECT_SIZE(7) + 400 + 2650;
+  return section == 2 ? JSON_OBJECT_SIZE(15) + 1100 : JSON_OBJECT_SIZE(12) + 512; // unit: sensor topics
+}
+
+void apiConfigLoad(uint8_t section, JsonDocument &doc)
+{
+  if (!SPIFFS.exists(apiConfigFile(section)))
+    return;
+  File configFile = SPIFFS.open(apiConfigFile(section), "r");
+  if (configFile)
+  {
+    deserializeJson(doc, configFile);
+    configFile.close();
+  }
+}
+
+// Config files store all values as string, accept JSON numbers too
+bool apiConfigValue(JsonVariantConst value, String &out)
+{
+  if (value.is<const char *>())
+    out = value.as<const char *>();
+  else if (value.is<long>())
+    out = String(value.as<long>());
+  else if (value.is<float>())
+    out = String(value.as<float>(), 1);
+  else
+    return false;
+  return true;
+}
+
+bool apiConfigInList(const String &value, const char *a, const char *b)
+{
+  return value == a || value == b;
+}
+
+bool apiConfigValidIp(const String &value)
+{
+  IPAddress ip;
+  return value.isEmpty() || ip.fromString(value);
+}
+
+// Host name or IPv4 address of the broker or NTP server
+bool apiConfigValidHost(const String &value)
+{
+  if (value.isEmpty() || value.length() > 64)
+    return false;
+  for (unsigned int i = 0; i < value.length(); i++)
+    if (!isalnum(value[i]) && value[i] != '.' && value[i] != '-' && value[i] != '_')
+      return false;
+  return true;
+}
+
+// POSIX TZ string like CET-1CEST,M3.5.0,M10.5.0/3, empty for UTC
+bool apiConfigValidTz(const String &value)
+{
+  if (value.length() > 64)
+    return false;
+  for (unsigned int i = 0; i < value.length(); i++)
+    if (!isgraph(value[i]))
+      return false;
+  return true;
+}
+
+// String of a config file key, empty when missing
+static String apiConfigString(JsonObjectConst values, const char *key)
+{
+  return values.containsKey(key) ? values[key].as<String>() : String();
+}
+
+// Save a whole section through the save function of its web page, values are the file merged with the import
+bool apiConfigSave(uint8_t section, JsonObjectConst values)
+{
+  switch (section)
+  {
+  case 0:
+    return saveWifi(apiConfigString(values, "ap_ssid"), apiConfigString(values, "ap_pwd"), apiConfigString(values, "hostname"),
+                    apiConfigString(values, "ota_pwd"), apiConfigString(values, "static_ip"), apiConfigString(values, "static_gw_ip"),
+                    apiConfigString(values, "static_subnet"), apiConfigString(values, "static_dns_ip"));
+  case 1:
+    return saveMqtt(apiConfigString(values, "mqtt_fn"), apiConfigString(values, "mqtt_host"), apiConfigString(values, "mqtt_port"),
+                    apiConfigString(values, "mqtt_user"), apiConfigString(values, "mqtt_pwd"), apiConfigString(values, "mqtt_topic"),
+                    apiConfigString(values, "mqtt_root_ca_cert"));
+  case 2:
+    return saveUnit(apiConfigString(values, "unit_tempUnit"), apiConfigString(values, "support_mode"), apiConfigString(values, "quiet_mode"),
+                    apiConfigString(values, "login_password"), apiConfigString(values, "temp_step"), apiConfigString(values, "language_index"), values);
+  default:
+    return saveOthers(apiConfigString(values, "haa"), apiConfigString(values, "haat"), apiConfigString(values, "debugPckts"),
+                      apiConfigString(values, "debugLogs"), apiConfigString(values, "webPanel"), apiConfigString(values, "txPin"),
+                      apiConfigString(values, "rxPin"), apiConfigString(values, "tz"), apiConfigString(values, "ntp"), values);
+  }
+}
+
+// Return the name of the first invalid key, or nullptr if the section is valid
+const char *apiConfigValidate(uint8_t section, JsonObject values)
+{
+  for (uint8_t k = 0; apiConfigKeys[section][k] != nullptr; k++)
+  {
+    const char *key = apiConfigKeys[section][k];
+    if (!values.containsKey(key))
+      continue;
+    String value;
+    if (!apiConfigValue(values[key], value))
+      return key;
+    bool valid = true;
+    if (strcmp(key, "ap_ssid") == 0)
+      valid = value.length() > 0 && value.length() <= 32;
+    else if (strcmp(key, "ap_pwd") == 0)
+      valid = value.isEmpty() || (value.length() >= 8 && value.length() <= 63);
+    else if (strncmp(key, "static_", 7) == 0)
+      valid = apiConfigValidIp(value);
+    else if (strcmp(key, "mqtt_host") == 0 || strcmp(key, "ntp") == 0)
+      valid = apiConfigValidHost(value);
+    else if (strcmp(key, "tz") == 0)
+      valid = apiConfigValidTz(value);
+    else if (strcmp(key, "mqtt_port") == 0)
+      valid = value.toInt() > 0 && value.toInt() <= 65535;
+    else if (strcmp(key, "mqtt_fn") == 0 || strcmp(key, "mqtt_topic") == 0 || strcmp(key, "haat") == 0 || strcmp(key, "hostname") == 0)
+      valid = value.length() <= 64;
+    else if (strcmp(key, "unit_tempUnit") == 0)
+      valid = apiConfigInList(value, "cel", "fah");
+    else if (strcmp(key, "support_mode") == 0)
+      valid = apiConfigInList(value, "all", "nht");
+    else if (strcmp(key, "quiet_mode") == 0)
+      valid = apiConfigInList(value, "allf", "nqm");
+    else if (strcmp(key, "temp_step") == 0)
+      valid = value.toFloat() >= 0.1 && value.toFloat() <= 1.0;
+    else if (strcmp(key, "language_index") == 0)
+      valid = value.toInt() >= 0 && value.toInt() < NUM_LANGUAGES;
+    else if (strncmp(key, "poll_", 5) == 0)
+      valid = value.toInt() >= (long)HP_POLL_FLOOR_MS && value.toInt() <= (long)HP_POLL_LIMIT_MS;
+    else if (strcmp(key, "rt_filter") == 0)
+      valid = value == "none" || apiConfigInList(value, "ema", "median");
+    else if (strcmp(key, "rt_deadband") == 0)
+      valid = value.toFloat() >= 0 && value.toFloat() <= 2.0;
+    else if (strcmp(key, "rt_interval") == 0)
+      valid = value.toInt() >= 0 && value.toInt() <= 600;
+    else if (strncmp(key, "rt_src", 6) == 0)
+      valid = tempFusionSpecValid(value);
+    else if (strcmp(key, "haa") == 0 || strncmp(key, "debug", 5) == 0 || strcmp(key, "webPanel") == 0)
+      valid = apiConfigInList(value, "ON", "OFF");
+    else if (strcmp(key, "txPin") == 0 || strcmp(key, "rxPin") == 0)
+      valid = value.toInt() >= 0 && value.toInt() <= 48;
+    else if (strcmp(key, "ws_clients") == 0 || strcmp(key, "sse_clients") == 0)
+      valid = value.toInt() >= 1 && value.toInt() <= WEB_CLIENTS_MAX;
+    else if (strcmp(key, "slow_clients") == 0)
+      valid = apiConfigInList(value, "drop", "disconnect");
+    if (!valid)
+      return key;
+  }
+  return nullptr;
+}
+
+bool checkApiLogin(AsyncWebServerRequest *request)
+{
+  httpRequests.add();
+  if (login_password.length() > 0 && !is_authenticated(request) && !request->authenticate(login_username.c_str(), login_password.c_str()))
+  {
+    httpAuthFailures.add();
+    request->requestAuthentication();
+    return false;
+  }
+  return true;
+}
+
+// GET /api/v1/config, secrets are left out unless ?secrets=1
+void handleApiConfig(AsyncWebServerRequest *request)
+{
+  if (!checkApiLogin(request))
+  {
+    return;
+  }
+  bool withSecrets = request->hasArg("secrets") && request->arg("secrets") == "1";
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->print(F("{\"version\":\""));
+  response->print(m2mqtt_version);
+  response->print('"');
+  for (uint8_t i = 0; i < API_CONFIG_SECTIONS; i++)
+  {
+    // one section in memory at a time
+    DynamicJsonDocument doc(apiConfigCapacity(i));
+    apiConfigLoad(i, doc);
+    if (!withSecrets)
+    {
+      for (const char *secret : apiConfigSecrets)
+        doc.remove(secret);
+    }
+    response->print(F(",\""));
+    response->print(apiConfigSections[i]);
+    response->print(F("\":"));
+    if (doc.isNull())
+      response->print(F("{}"));
+    else
+      serializeJson(doc, *response);
+  }
+  response->print('}');
+  request->send(response);
+}
+
+// /api/v1/capture return the capture state, ?action=arm|trigger|stop|off change it, trigger take ?pre=<packets of history>
+void handleApiCapture(AsyncWebServerRequest *request)
+{
+  if (!checkApiLogin(request))
+  {
+    return;
+  }
+  if (request->hasArg("action"))
+  {
+    String action = request->arg("action");
+    bool ok = true;
+    if (action == "arm")
+      ok = captureArm();
+    else if (action == "trigger")
+      ok = captureTrigger(request->hasArg("pre") ? constrain(request->arg("pre").toInt(), 0L, (long)UINT16_MAX) : CAPTURE_PRE_TRIGGER);
+    else if (action == "stop")
+      captureStop();
+    else if (action == "off")
+      captureOff();
+    else
+    {
+      request->send(400, F("text/plain"), F("Unknown action"));
+      return;
+    }
+    if (!ok)
+    {
+      request->send(500, F("text/plain"), F("Not enough memory for the capture"));
+      return;
+    }
+  }
+  uint32_t first, end, trigger;
+  captureRange(first, end, trigger);
+  char json[96];
+  snprintf(json, sizeof(json), "{\"state\":\"%s\",\"packets\":%lu,\"trigger\":%ld,\"size\":%u}", captureStateName[captureState],
+           (unsigned long)(end - first), trigger == UINT32_MAX ? -1L : (long)(trigger - first), (unsigned)CAPTURE_SIZE);
+  request->send(200, F("application/json"), json);
+}
+
+// GET /api/v1/capture/download?format=bin|pcap, streamed from the ring in chunks
+void handleApiCaptureDownload(AsyncWebServerRequest *request)
+{
+  if (!checkApiLogin(request))
+  {
+    return;
+  }
+  if (captureRing == nullptr)
+  {
+    request->send(404, F("text/plain"), F("No capture"));
+    return;
+  }
+  bool pcap = request->arg("format") == "pcap";
+  CaptureStream stream;
+  captureStreamBegin(stream, pcap);
+  AsyncWebServerResponse *response = request->beginChunkedResponse(pcap ? "application/vnd.tcpdump.pcap" : "application/octet-stream",
+                                                                   [stream](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t
+                                                                   { return captureStreamRead(stream, buffer, maxLen); });
+  response->addHeader("Content-Disposition", pcap ? "attachment; filename=cn105.pcap" : "attachment; filename=cn105.cap");
+  request->send(response);
+}
+
+// Collect POST body, too large body is dropped and rejected in handleApiConfigImport
+void handleApiConfigBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  if (index == 0 && total <= API_CONFIG_MAX_SIZE)
+  {
+    request->_tempObject = malloc(total + 1); // freed with the request
+  }
+  if (request->_tempObject != nullptr && index + len <= total)
+  {
+    memcpy((uint8_t *)request->_tempObject + index, data, len);
+    if (index + len == total)
+      ((char *)request->_tempObject)[total] = '\0';
+  }
+}
+
+// POST /api/v1/config, sections and keys not in the document keep their current value
+void handleApiConfigImport(AsyncWebServerRequest *request)
+{
+  if (!checkApiLogin(request))
+  {
+    return;
+  }
+  if (request->_tempObject == nullptr)
+  {
+    request->send(413, F("application/json"), F("{\"error\":\"body empty or too large\"}"));
+    return;
+  }
+  // only known keys are kept, values stay in the request buffer
+  StaticJsonDocument<JSON_OBJECT_SIZE(API_CONFIG_SECTIONS) + JSON_OBJECT_SIZE(API_CONFIG_KEYS)> filter;
+  for (uint8_t i = 0; i < API_CONFIG_SECTIONS; i++)
+  {
+    for (uint8_t k = 0; apiConfigKeys[i][k] != nullptr; k++)
+      filter[apiConfigSections[i]][apiConfigKeys[i][k]] = true;
+  }
+  DynamicJsonDocument input(JSON_OBJECT_SIZE(API_CONFIG_SECTIONS) + JSON_OBJECT_SIZE(API_CONFIG_KEYS));
+  DeserializationError error = deserializeJson(input, (char *)request->_tempObject, request->contentLength(), DeserializationOption::Filter(filter));
+  if (error)
+  {
+    request->send(400, F("application/json"), String(F("{\"error\":\"")) + error.c_str() + F("\"}"));
+    return;
+  }
+  // validate everything before writing anything
+  for (uint8_t i = 0; i < API_CONFIG_SECTIONS; i++)
+  {
+    const char *invalidKey = apiConfigValidate(i, input[apiConfigSections[i]]);
+    if (invalidKey != nullptr)
+    {
+      request->send(400, F("application/json"), String(F("{\"error\":\"invalid value\",\"key\":\"")) + invalidKey + F("\"}"));
+      return;
+    }
+  }
+  uint8_t applyFlags = 0;
+  bool reboot = captive; // leave AP mode for the new wifi
+  for (uint8_t i = 0; i < API_CONFIG_SECTIONS; i++)
+  {
+    JsonObject values = input[apiConfigSections[i]];
+    if (values.isNull() || values.size() == 0)
+      continue;
+    DynamicJsonDocument doc(apiConfigCapacity(i));
+    apiConfigLoad(i, doc);
+    for (JsonPair kv : values)
+    {
+      String value;
+      apiConfigValue(kv.value(), value);
+      if ((strcmp(kv.key().c_str(), "txPin") == 0 && value.toInt() != HP_TX) || (strcmp(kv.key().c_str(), "rxPin") == 0 && value.toInt() != HP_RX))
+        reboot = true; // HP serial can not be moved at run time
+      doc[kv.key()] = value;
+    }
+    if (apiConfigSave(i, doc.as<JsonObjectConst>()))
+      applyFlags |= (1 << i);
+  }
+  String response = F("{\"status\":\"ok\",\"reboot\":");
+  response += (reboot && applyFlags) ? F("true}") : F("false}");
+  request->send(200, F("application/json"), response);
+  if (applyFlags == 0)
+    return;
+  if (captive)
+    sendRebootRequest(3);
+  else
+    sendConfigApplyRequest(applyFlags); // reboot once only if UART pins changed
+}
+
+// login page, also called for logout
+void handleLogin(AsyncWebServerRequest *request)
+{
+  bool loginSuccess = false;
+  String msg;
+  String loginPage = FPSTR(html_page_login);
+  // localize
+  loginPage.replace(F("_TXT_LOGIN_TITLE_"), translatedWord(FL_(txt_login_title)));
+  loginPage.replace(F("_TXT_LOGIN_PH_USER_"), translatedWord(FL_(txt_login_ph_user)));
+  loginPage.replace(F("_TXT_LOGIN_PH_PWD_"), translatedWord(FL_(txt_login_ph_pwd)));
+  loginPage.replace(F("_TXT_LOGIN_USERNAME_"), translatedWord(FL_(txt_login_username)));
+  loginPage.replace(F("_TXT_LOGIN_PASSWORD_"), translatedWord(FL_(txt_login_password)));
+  loginPage.replace(F("_TXT_LOGIN_OPEN_STATUS_"), translatedWord(FL_(txt_login_open_status)));
+  loginPage.replace(F("_TXT_LOGIN_"), translatedWord(FL_(txt_login)));
+  if (request->hasHeader("Cookie"))
+  {
+    // Found cookie;
+    String cookie = request->header("Cookie");
+  }
+  if (request->hasArg("USERNAME") || request->hasArg("PASSWORD") || request->hasArg("LOGOUT"))
+  {
+    if (request->hasArg("LOGOUT"))
+    {
+      // logout
+      loginSuccess = false;
+    }
+    if (request->hasArg("USERNAME") && request->hasArg("PASSWORD"))
+    {
+      if (request->arg("USERNAME") == login_username && request->arg("PASSWORD") == login_password)
+      {
+        loginSuccess = true;
+        msg = F("<b><font color='red'>");
+        msg += translatedWord(FL_(txt_login_sucess));
+        msg += F("</font></b>");
+        loginPage += F("<script>");
+        loginPage += F("setTimeout(function () {");
+        loginPage += F("window.location.href= '/';");
+        loginPage += F("}, 3000);");
+        loginPage += F("</script>");
+        // Log in Successful;
+      }
+      else
       {
         msg = F("<b><font color='red'>");
         msg += translatedWord(FL_(txt_login_fail));
@@ -2032,7 +3006,7 @@ void handleUploadLoop(AsyncWebServerRequest *request, const String& filename, si
     if (mqttClient != nullptr && mqttClient->connected())
     {
       mqttClient->disconnect();
-      mqtt_reconnect_timeout = millis() + MQTT_RECONNECT_INTERVAL_MS;
+      lastMqttRetry = millis();
     }
     ota_content_len = request->contentLength();
     // if filename includes spiffs, update the spiffs partition
@@ -2104,6 +3078,7 @@ heatpumpSettings change_states(AsyncWebServerRequest *request, heatpumpSettings
   if (request->hasArg(F("PWRCHK")))
   {
     settings.power = request->hasArg(F("POWER")) ? "ON" : "OFF";
+    hpSendCommand(0, HP_CMD_POWER, settings.power);
     update = true;
   }
   if (request->hasArg(F("MODE")))
@@ -2111,6 +3086,7 @@ heatpumpSettings change_states(AsyncWebServerRequest *request, heatpumpSettings
     //ESP_LOGD(TAG, "Settings Mode before: %s", request->arg("MODE").c_str());
     settings.mode = request->arg(F("MODE")).c_str();
     //ESP_LOGD(TAG, "Settings Mode after: %s", settings.mode);
+    hpSendCommand(0, HP_CMD_MODE, settings.mode);
     update = true;
 
   }
@@ -2120,6 +3096,7 @@ heatpumpSettings change_states(AsyncWebServerRequest *request, heatpumpSettings
     if (new_temp != settings.temperature)
     {
       settings.temperature = new_temp;
+      hpSendCommand(0, HP_CMD_TEMPERATURE, nullptr, new_temp);
       update = true;
     }
   }
@@ -2128,44 +3105,164 @@ heatpumpSettings change_states(AsyncWebServerRequest *request, heatpumpSettings
     //ESP_LOGD(TAG, "Settings Fan before: %s", request->arg("FAN").c_str());
     settings.fan = request->arg(F("FAN")).c_str();
     //ESP_LOGD(TAG, "Settings Fan after: %s", settings.fan);
+    hpSendCommand(0, HP_CMD_FAN, settings.fan);
     update = true;
   }
   if (request->hasArg(F("VANE")))
   {
     settings.vane = request->arg(F("VANE")).c_str();
+    hpSendCommand(0, HP_CMD_VANE, settings.vane);
     update = true;
   }
   if (request->hasArg(F("WIDEVANE")))
   {
     settings.wideVane = request->arg(F("WIDEVANE")).c_str();
+    hpSendCommand(0, HP_CMD_WIDE_VANE, settings.wideVane);
     update = true;
   }
   if (update)
   {
-    hp.setSettings(settings);
-    if (hp.getSettings() == hp.getWantedSettings()) // only update it settings change
+    hpSendCommand(0, HP_CMD_UPDATE);
+  }
+  return settings;
+}
+
+// Control page fields, by the name of their form input
+struct ControlField
+{
+  const char *name;
+  HpCommandType command;
+};
+
+static const ControlField controlFields[] = {
+    {"POWER", HP_CMD_POWER},
+    {"MODE", HP_CMD_MODE},
+    {"TEMP", HP_CMD_TEMPERATURE},
+    {"FAN", HP_CMD_FAN},
+    {"VANE", HP_CMD_VANE},
+    {"WIDEVANE", HP_CMD_WIDE_VANE}};
+
+// State of the first unit for the control page, keyed by the id of the element that show it
+String getControlState(const heatpumpSettings &settings, const heatpumpStatus &status)
+{
+  DynamicJsonDocument doc(JSON_OBJECT_SIZE(7));
+  doc["room_temperature"] = convertCelsiusToLocalUnit(status.roomTemperature, useFahrenheit);
+  doc["TEMP"] = convertCelsiusToLocalUnit(settings.temperature, useFahrenheit);
+  const char *const values[] = {settings.power, settings.mode, settings.fan, settings.vane, settings.wideVane};
+  const char *const names[] = {"POWER", "MODE", "FAN", "VANE", "WIDEVANE"};
+  for (uint8_t field = 0; field < 5; field++)
+  {
+    if (!(String(values[field]).isEmpty())) // null may crash with multitask
+      doc[names[field]] = values[field];
+  }
+  String state;
+  serializeJson(doc, state);
+  return state;
+}
+
+#ifndef WEBSOCKET_ENABLE
+#define CONTROL_EVENTS 7
+
+// The state as one event source message per field, temperatures points to text. Return the count
+uint8_t getControlEvents(const heatpumpSettings &settings, const heatpumpStatus &status, String text[2], WebMessage messages[CONTROL_EVENTS])
+{
+  uint8_t count = 0;
+  text[0] = String(convertCelsiusToLocalUnit(status.roomTemperature, useFahrenheit));
+  text[1] = String(convertCelsiusToLocalUnit(settings.temperature, useFahrenheit));
+  messages[count++] = {text[0].c_str(), "room_temperature"};
+  messages[count++] = {text[1].c_str(), "temperature"};
+  if (!(String(settings.fan).isEmpty())) // null may crash with multitask
+    messages[count++] = {settings.fan, "fan"};
+  if (!(String(settings.vane).isEmpty()))
+    messages[count++] = {settings.vane, "vane"};
+  if (!(String(settings.wideVane).isEmpty()))
+    messages[count++] = {settings.wideVane, "wideVane"};
+  if (!(String(settings.mode).isEmpty()))
+    messages[count++] = {settings.mode, "mode"};
+  if (!(String(settings.power).isEmpty()))
+    messages[count++] = {settings.power, "power"};
+  return count;
+}
+#endif
+
+// Push the state to the open control pages
+void sendControlState(const heatpumpSettings &settings, const heatpumpStatus &status)
+{
+#ifdef WEBSOCKET_ENABLE
+  if (webClientCount(WEB_CHANNEL_WS) > 0)
+    webClientsSend(WEB_CHANNEL_WS, getControlState(settings, status).c_str());
+#else
+  if (webClientCount(WEB_CHANNEL_EVENTS) == 0)
+    return;
+  String text[2];
+  WebMessage messages[CONTROL_EVENTS];
+  uint8_t count = getControlEvents(settings, status, text, messages);
+  for (uint8_t index = 0; index < count; index++)
+    webClientsSend(WEB_CHANNEL_EVENTS, messages[index].message, messages[index].event, millis()); // send data to browser
+#endif
+}
+
+// Slow control pages that caught up get the whole state they missed, not only the messages after it
+void sendControlStateStale()
+{
+#ifdef WEBSOCKET_ENABLE
+  if (!webClientsStale[WEB_CHANNEL_WS] || !webClientsStaleReady(WEB_CHANNEL_WS))
+    return;
+  String state = getControlState(hpGetSettings(), hpGetStatus());
+  WebMessage message = {state.c_str(), nullptr};
+  webClientsSendStale(WEB_CHANNEL_WS, &message, 1);
+#else
+  if (!webClientsStale[WEB_CHANNEL_EVENTS] || !webClientsStaleReady(WEB_CHANNEL_EVENTS))
+    return;
+  heatpumpSettings settings = hpGetSettings();
+  heatpumpStatus status = hpGetStatus();
+  String text[2];
+  WebMessage messages[CONTROL_EVENTS];
+  uint8_t count = getControlEvents(settings, status, text, messages);
+  webClientsSendStale(WEB_CHANNEL_EVENTS, messages, count);
+#endif
+}
+
+// Control page command from the web socket, one JSON object with the form fields that changed:
+// {"TEMP":22.5} or {"MODE":"COOL","FAN":"2"}. Applied to the first unit like a /control form
+void controlCommand(char *json, size_t length)
+{
+  DynamicJsonDocument doc(JSON_OBJECT_SIZE(6)); // zero copy, the strings stay in json
+  if (deserializeJson(doc, json, length) != DeserializationError::Ok)
+    return;
+  bool update = false;
+  for (const ControlField &field : controlFields)
+  {
+    if (!doc.containsKey(field.name))
+      continue;
+    if (field.command == HP_CMD_TEMPERATURE)
     {
-      ESP_LOGW(TAG, "Same Settings to HP, Igrore");
+      float temperature = convertLocalUnitToCelsius(doc[field.name].as<float>(), useFahrenheit);
+      hpSendCommand(0, HP_CMD_TEMPERATURE, nullptr, constrain(temperature, (float)min_temp, (float)max_temp));
     }
     else
     {
-      ESP_LOGI(TAG, "Send Settings to HP");
-      requestHpUpdate = true;
-      requestHpUpdateTime = millis() + 10;
+      hpSendCommand(0, field.command, doc[field.name].as<const char *>());
     }
+    update = true;
   }
-  return settings;
+  if (update)
+    hpSendCommand(0, HP_CMD_UPDATE);
 }
 
-void hpSettingsChanged()
+void hpSettingsChanged(uint8_t unit)
 {
-  if (millis() - hp.getLastWanted() < PREVENT_UPDATE_INTERVAL_MS) // prevent HA setting change after send update interval we wait for 1 seconds before udpate data
+#ifdef ESP8266
+  cmdTraceMark(unit, CMD_TRACE_SETTINGS);
+  hpPollBoost(unit);
+#endif
+  if (millis() - hpGetLastWanted(unit) < PREVENT_UPDATE_INTERVAL_MS) // prevent HA setting change after send update interval we wait for 1 seconds before udpate data
   {
     return;
   }
 
   // send room temp, operating info and all information
-  hpStatusChanged(hp.getStatus());
+  hpStatusChanged(unit, hpGetStatus(unit));
 }
 
 // Convert mode for home assistant
@@ -2289,138 +3386,483 @@ String hpGetAction(heatpumpStatus hpStatus, heatpumpSettings hpSettings)
     return hpmode; // unknown
 }
 
-void hpStatusChanged(heatpumpStatus currentStatus)
+void hpStatusChanged(uint8_t unit, heatpumpStatus currentStatus)
 {
-  if (millis() - hp.getLastWanted() < PREVENT_UPDATE_INTERVAL_MS) // prevent HA setting change after send update interval we wait for 1 seconds before udpate data
+  if (millis() - hpGetLastWanted(unit) < PREVENT_UPDATE_INTERVAL_MS) // prevent HA setting change after send update interval we wait for 1 seconds before udpate data
   {
     return;
   }
-  hpCheckRemoteTemp(); // if the remote temperature feed from mqtt is stale, disable it and revert to the internal thermometer.
 
   // send room temp, operating info and all information
-  heatpumpSettings currentSettings = hp.getSettings();
+  heatpumpSettings currentSettings = hpGetSettings(unit);
 
   if (currentStatus.roomTemperature == 0)
     return;
 
-  rootInfo.clear();
+  ROOT_INFO_LOCK();
+  JsonDocument &unitInfo = rootInfo[unit];
+  unitInfo.clear();
   float roomTemperature = convertCelsiusToLocalUnit(currentStatus.roomTemperature, useFahrenheit);
   float temperature = convertCelsiusToLocalUnit(currentSettings.temperature, useFahrenheit);
-  rootInfo[getEntityTag(ENT_ROOM_TEMPERATURE)] = roomTemperature;
-  rootInfo["temperature"] = temperature;
-  events.send(String(roomTemperature).c_str(), "room_temperature", millis(), 50); // send data to browser
-  events.send(String(temperature).c_str(), "temperature", millis(), 60);
+  unitInfo[getEntityTag(ENT_ROOM_TEMPERATURE)] = roomTemperature;
+  unitInfo["temperature"] = temperature;
+  if (unit == 0) // the web pages show the first unit
+    sendControlState(currentSettings, currentStatus);
   if (!(String(currentSettings.fan).isEmpty())) // null may crash with multitask
-  {
-    rootInfo["fan"] = getFanModeFromHp(currentSettings.fan);
-    events.send(currentSettings.fan, "fan", millis(), 70);
-  }
+    unitInfo["fan"] = getFanModeFromHp(currentSettings.fan);
   if (!(String(currentSettings.vane).isEmpty()))
-  {
-    rootInfo["vane"] = currentSettings.vane;
-    events.send(currentSettings.vane, "vane", millis(), 80);
-  }
+    unitInfo["vane"] = currentSettings.vane;
   if (!(String(currentSettings.wideVane).isEmpty()))
-  {
-    rootInfo["wideVane"] = currentSettings.wideVane;
-    events.send(currentSettings.wideVane, "wideVane", millis(), 90);
-  }
-  rootInfo["mode"] = hpGetMode(currentSettings);
-  rootInfo["action"] = hpGetAction(currentStatus, currentSettings);
-  events.send(currentSettings.mode, "mode", millis(), 100);
-  events.send(currentSettings.power, "power", millis(), 110);
-  rootInfo[getEntityTag(ENT_COMPR_FRQ)] = currentStatus.compressorFrequency;
+    unitInfo["wideVane"] = currentSettings.wideVane;
+  unitInfo["mode"] = hpGetMode(currentSettings);
+  unitInfo["action"] = hpGetAction(currentStatus, currentSettings);
+  unitInfo[getEntityTag(ENT_COMPR_FRQ)] = currentStatus.compressorFrequency;
+  HpExtended ext = hpExtGet(unit);
+  if (ext.has & HP_EXT_HAS_OUTDOOR_TEMP)
+    unitInfo[getEntityTag(ENT_OUTDOOR_TEMPERATURE)] = convertCelsiusToLocalUnit(ext.outdoorTemperature, useFahrenheit);
+  if (ext.has & HP_EXT_HAS_POWER)
+    unitInfo[getEntityTag(ENT_INPUT_POWER)] = ext.inputPower;
+  if (ext.has & HP_EXT_HAS_ENERGY)
+    unitInfo[getEntityTag(ENT_ENERGY)] = ext.energy;
+  if (ext.has & HP_EXT_HAS_ERROR)
+    unitInfo[getEntityTag(ENT_ERROR_CODE)] = ext.errorCode;
+  if (ext.has & HP_EXT_HAS_RUNTIME)
+    unitInfo[getEntityTag(ENT_RUNTIME)] = round(ext.runtimeMinutes / 6.0f) / 10.0f; // hours, one decimal
+  CmdTrace trace;
+  uint16_t traceId = cmdTraceComplete(unit, trace);
+  if (traceId != 0)
+    unitInfo["trace_id"] = traceId; // the state that confirm a command carry its trace id
   if (mqttClient != nullptr && mqttClient->connected())
   {
     String mqttOutput;
-    serializeJson(rootInfo, mqttOutput);
-    if (!mqttClient->publish(ha_state_topic.c_str(), 1, false, mqttOutput.c_str()))
+    serializeJson(unitInfo, mqttOutput);
+    if (!mqttPublish(HaTopic(HA_TOPIC_STATE, unit).c_str(), 1, false, mqttOutput.c_str()))
     {
       if (_debugModeLogs)
-        mqttClient->publish(ha_debug_logs_topic.c_str(), 1, false, (char *)("Failed to publish hp status change"));
+        mqttPublish(HaTopic(HA_TOPIC_DEBUG_LOGS).c_str(), 1, false, (char *)("Failed to publish hp status change"));
     }
   }
+  unitInfo.remove("trace_id"); // local state publish must not repeat it
+  ROOT_INFO_UNLOCK();
+  if (traceId != 0)
+    sendCommandTrace(trace);
+  if (mqttClient != nullptr && mqttClient->connected())
+    haConfigExtended(unit, hpExtTakeNew(unit, ext.has)); // a field seen for the first time
+}
+
+// A finished command trace with the latencies of its kind on the latency topic, in ms from recv
+void sendCommandTrace(const CmdTrace &trace)
+{
+  if (mqttClient == nullptr || !mqttClient->connected())
+    return;
+  const size_t capacity = JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(CMD_TRACE_STAGE_COUNT) + 2 * JSON_OBJECT_SIZE(4);
+  DynamicJsonDocument doc(capacity);
+  doc["id"] = trace.id;
+  if (trace.unit > 0)
+    doc["unit"] = trace.unit + 1;
+  doc["cmd"] = cmdTraceKindName[trace.kind];
+  JsonObject stages = doc.createNestedObject("ms");
+  for (uint8_t stage = CMD_TRACE_SENT; stage < CMD_TRACE_STAGE_COUNT; stage++)
+  {
+    if (trace.stageUs[stage] != 0)
+      stages[cmdTraceStageName[stage]] = cmdTraceStageMs(trace, (CmdTraceStage)stage);
+  }
+  for (uint8_t ack = 0; ack < 2; ack++)
+  {
+    CmdLatencyPercentiles latency = cmdLatencyGet(trace.kind, ack);
+    JsonObject item = doc.createNestedObject(ack ? "ack" : "state");
+    item["p50"] = latency.p50;
+    item["p95"] = latency.p95;
+    item["p99"] = latency.p99;
+    item["n"] = latency.size;
+  }
+  String mqttOutput;
+  serializeJson(doc, mqttOutput);
+  mqttPublish(HaTopic(HA_TOPIC_CMD_LATENCY).c_str(), 1, false, mqttOutput.c_str());
 }
 
+// Remote temp timer: write the values held by the rate limit and revert the units without readings
+// for CHECK_REMOTE_TEMP_INTERVAL_MS to their own sensor. Run again at the next of these of any unit
 void hpCheckRemoteTemp()
 {
-  if (remoteTempActive && (millis() - lastRemoteTemp > CHECK_REMOTE_TEMP_INTERVAL_MS))
-  { // if it's been 5 minutes since last remote_temp message, revert back to HP internal temp sensor
-    remoteTempActive = false;
-    float temperature = 0;
-    hp.setRemoteTemperature(temperature);
-    hp.update();
+  uint32_t nextMs = UINT32_MAX;
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+  {
+    bool stale;
+    float temperature;
+    if (remoteTempCheck(unit, stale, temperature, nextMs))
+    {
+      cmdTraceBegin(unit, CMD_TRACE_REMOTE_TEMP); // before the send, the HP task stamp sent and ack
+      hpSendCommand(unit, HP_CMD_REMOTE_TEMP, nullptr, temperature);
+    }
+    else if (stale)
+    {
+      hpSendCommand(unit, HP_CMD_REMOTE_TEMP, nullptr, 0);
+    }
   }
+  if (nextMs != UINT32_MAX)
+    schedAt(TASK_REMOTE_TEMP_CHECK, nextMs, hpCheckRemoteTemp);
 }
 
-void sendKeepAlive(bool force = false)
+// A remote temperature reading in °C, from remote_temp/set or the fused sensor sources
+void hpRemoteTempReading(uint8_t unit, float celsius)
 {
-  if ((millis() - lastAliveMsgSend < SEND_ALIVE_MSG_INTERVAL_MS) && !force)
+  float filtered;
+  if (remoteTempReading(unit, celsius, filtered))
   {
+    cmdTraceBegin(unit, CMD_TRACE_REMOTE_TEMP);
+    hpSendCommand(unit, HP_CMD_REMOTE_TEMP, nullptr, filtered); // written at once, no update needed
+  }
+  // a held value or the staleness expiry, the check run at the next of them
+  schedAt(TASK_REMOTE_TEMP_CHECK, 0, hpCheckRemoteTemp);
+}
+
+// Drop the stale sensor sources, feed the units whose fused value changed and publish the diagnostics
+void tempFusionCheck()
+{
+  float fused[HP_UNIT_MAX];
+  uint8_t changed = tempFusionExpire(fused);
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+  {
+    if (isnan(fused[unit]))
+      continue;
+    if (changed & (1 << unit))
+      hpRemoteTempReading(unit, fused[unit]);
+    else
+      remoteTempTouch(unit); // sources slower than the remote temp staleness
+  }
+  if (tempFusionChanged)
+    sendTempFusion(fused);
+}
+
+// Fused value of each unit and the state of each source on the remote temp diagnostics topic
+void sendTempFusion(const float fused[HP_UNIT_MAX])
+{
+  if (mqttClient == nullptr || !mqttClient->connected())
     return;
+  tempFusionChanged = false;
+  const size_t capacity = JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(HP_UNIT_MAX) + JSON_ARRAY_SIZE(TEMP_FUSION_SOURCES) + TEMP_FUSION_SOURCES * JSON_OBJECT_SIZE(7);
+  DynamicJsonDocument doc(capacity);
+  JsonArray units = doc.createNestedArray("fused");
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+  {
+    if (isnan(fused[unit]))
+      units.add(nullptr);
+    else
+      units.add(convertCelsiusToLocalUnit(fused[unit], useFahrenheit));
+  }
+  JsonArray sources = doc.createNestedArray("sources");
+  for (uint8_t index = 0; index < TEMP_FUSION_SOURCES; index++)
+  {
+    const TempFusionSource &source = tempFusionSource[index];
+    if (source.topic.isEmpty())
+      continue;
+    JsonObject item = sources.createNestedObject();
+    item["topic"] = source.topic.c_str();
+    item["unit"] = source.unit + 1;
+    item["weight"] = source.weight;
+    item["fresh"] = source.fresh;
+    item["readings"] = source.readings;
+    if (source.readings > 0)
+    {
+      item["value"] = convertCelsiusToLocalUnit(source.value, useFahrenheit);
+      item["age_s"] = (millis() - source.receivedAt) / 1000;
+    }
+  }
+  String mqttOutput;
+  serializeJson(doc, mqttOutput);
+  mqttPublish(HaTopic(HA_TOPIC_DEBUG_REMOTE_TEMP).c_str(), 1, false, mqttOutput.c_str());
+}
+
+// Subscribe or unsubscribe the sensor source topics, the fusion timer run while there are any
+void tempFusionSubscribe(bool subscribe)
+{
+  for (uint8_t index = 0; index < TEMP_FUSION_SOURCES; index++)
+  {
+    const String &topic = tempFusionSource[index].topic;
+    if (topic.isEmpty() || mqttClient == nullptr || !mqttClient->connected())
+      continue;
+    if (subscribe)
+      mqttClient->subscribe(topic.c_str(), 0);
+    else
+      mqttClient->unsubscribe(topic.c_str());
   }
-  lastAliveMsgSend = millis();
+  if (tempFusionConfigured())
+    schedAt(TASK_TEMP_FUSION, TEMP_FUSION_CHECK_MS, tempFusionCheck, TEMP_FUSION_CHECK_MS);
+  else
+    schedCancel(TASK_TEMP_FUSION);
+}
 
+void sendKeepAlive()
+{
   // send keep alive message
   if (mqttClient != nullptr && mqttClient->connected())
   {
-    if (!mqttClient->publish(ha_availability_topic.c_str(), 1, false, mqtt_payload_available))
+    if (!mqttPublish(HaTopic(HA_TOPIC_AVAILABILITY).c_str(), 1, false, mqtt_payload_available))
     {
       if (_debugModeLogs)
-        mqttClient->publish(ha_debug_logs_topic.c_str(), 1, false, (char *)"Failed to publish avialable status");
+        mqttPublish(HaTopic(HA_TOPIC_DEBUG_LOGS).c_str(), 1, false, (char *)"Failed to publish avialable status");
     }
     sendDeviceInfo();
-    if (hp.isConnected())
+    for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
     {
-        hpStatusChanged(hp.getStatus());
+      if (hpIsConnected(unit))
+        hpStatusChanged(unit, hpGetStatus(unit));
     }
   }
 }
 
-void hpPacketDebug(byte *packet, unsigned int length, const char *packetDirection)
+// Loop stage histograms on the diagnostics topic, bucket counts follow le_ms
+void sendLoopStats()
 {
-  if (_debugModePckts)
+  if (mqttClient == nullptr || !mqttClient->connected())
+    return;
+  const size_t capacity = JSON_OBJECT_SIZE(7) + JSON_ARRAY_SIZE(LOOP_STATS_BUCKETS) + 2 * JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(8) + JSON_OBJECT_SIZE(STAGE_COUNT) +
+                          STAGE_COUNT * (JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(LOOP_STATS_BUCKETS));
+  DynamicJsonDocument doc(capacity);
+  JsonArray le = doc.createNestedArray("le_ms");
+  for (uint8_t bucket = 0; bucket < LOOP_STATS_BUCKETS - 1; bucket++)
+    le.add(loopStatsBucketUs[bucket] / 1000);
+  doc["stalls"] = loopStalls.get();
+  doc["hp_poll_ms"] = hpPollIntervalMs[0]; // first unit, the others are on /metrics
+  HpLinkPercentiles reconnect = hpLinkReconnectGet(0);
+  JsonObject link = doc.createNestedObject("hp_link");
+  link["stage"] = hpLink[0].stage;
+  link["retry_in_ms"] = hpLinkRetryInMs(0);
+  link["retries"] = hpLink[0].retries;
+  link["wakes"] = hpLink[0].wakes;
+  link["reconnects"] = hpLink[0].reconnects;
+  link["reconnect_p50_ms"] = reconnect.p50;
+  link["reconnect_p95_ms"] = reconnect.p95;
+  link["reconnect_max_ms"] = reconnect.max;
+  JsonObject remote = doc.createNestedObject("remote_temp");
+  remote["writes"] = remoteTempWrites.get(0); // first unit, the others are on /metrics
+  remote["deadband_skips"] = remoteTempDeadbandSkips.get(0);
+  remote["rate_skips"] = remoteTempRateSkips.get(0);
+  LoopStall stall = loopStatsLastStall();
+  if (stall.us > 0)
+  {
+    JsonObject last = doc.createNestedObject("last_stall");
+    last["stage"] = loopStageName[stall.stage];
+    last["ms"] = stall.us / 1000;
+    last["age_s"] = (millis() - stall.at) / 1000;
+  }
+  JsonObject stages = doc.createNestedObject("stages");
+  for (uint8_t stage = 0; stage < STAGE_COUNT; stage++)
+  {
+    LoopStageStats stats = loopStatsGet((LoopStage)stage);
+    if (stats.count == 0)
+      continue;
+    JsonObject item = stages.createNestedObject(loopStageName[stage]);
+    item["count"] = stats.count;
+    item["avg_us"] = (uint32_t)(stats.sumUs / stats.count);
+    item["max_us"] = stats.maxUs;
+    JsonArray hist = item.createNestedArray("hist");
+    for (uint8_t bucket = 0; bucket < LOOP_STATS_BUCKETS; bucket++)
+      hist.add(stats.buckets[bucket]);
+  }
+  String mqttOutput;
+  serializeJson(doc, mqttOutput);
+  mqttPublish(HaTopic(HA_TOPIC_DIAGNOSTICS).c_str(), 1, false, mqttOutput.c_str());
+}
+
+// Whole telemetry registry as one JSON object on its diagnostics topic
+void sendTelemetry()
+{
+  if (mqttClient == nullptr || !mqttClient->connected())
+    return;
+  telemetryRefresh();
+  String mqttOutput = "{";
+  for (TelemetryMetric *metric = telemetryFirst; metric != nullptr; metric = metric->next)
   {
-    String message;
-    for (unsigned int idx = 0; idx < length; idx++)
-    {
-      if (packet[idx] < 16)
-      {
-        message += "0"; // pad single hex digits with a 0
-      }
-      message += String(packet[idx], HEX) + " ";
-    }
+    if (metric != telemetryFirst)
+      mqttOutput += ',';
+    telemetryFormatAll(*metric, TELEMETRY_JSON, "", telemetryAppend, &mqttOutput);
+  }
+  mqttOutput += '}';
+  mqttPublish(HaTopic(HA_TOPIC_DEBUG_TELEMETRY).c_str(), 1, false, mqttOutput.c_str());
+}
 
-    const size_t bufferSize = JSON_OBJECT_SIZE(10);
-    StaticJsonDocument<bufferSize> root;
+// Telemetry counters and histograms for the status page, the gauges and the labelled metrics have their own lines
+String getTelemetryText()
+{
+  String text;
+  for (TelemetryMetric *metric = telemetryFirst; metric != nullptr; metric = metric->next)
+  {
+    if (metric->type == TELEMETRY_GAUGE || metric->label != nullptr)
+      continue;
+    if (!text.isEmpty())
+      text += F(", ");
+    telemetryFormat(*metric, 0, TELEMETRY_TEXT, "", telemetryAppend, &text);
+  }
+  return text;
+}
 
-    root[packetDirection] = message;
-    if (mqttClient != nullptr && mqttClient->connected())
+// Loop max and last stall for the status page
+String getLoopStallText()
+{
+  LoopStageStats stats = loopStatsGet(STAGE_LOOP);
+  LoopStall stall = loopStatsLastStall();
+  String text = F("max ");
+  text += String(stats.maxUs / 1000.0f, 1);
+  text += F(" ms, ");
+  text += String(loopStalls.get());
+  text += F(" stalls");
+  if (stall.us > 0)
+  {
+    text += F(", last: ");
+    text += loopStageName[stall.stage];
+    text += ' ';
+    text += String(stall.us / 1000.0f, 1);
+    text += F(" ms, ");
+    text += String((millis() - stall.at) / 1000);
+    text += F(" s ago");
+  }
+  return text;
+}
+
+// Web socket and event source clients for the status page: clients/max, queued messages and counters
+String getWebClientsText()
+{
+  String text;
+  for (uint8_t channel = 0; channel < WEB_CHANNEL_COUNT; channel++)
+  {
+    if (channel > 0)
+      text += F(", ");
+    text += webChannelName[channel];
+    text += ' ';
+    text += String(webClientCount((WebChannel)channel));
+    text += '/';
+    text += String(webClientsMax[channel]);
+    text += F(" (queued ");
+    text += String(webClientQueued((WebChannel)channel));
+    text += F(", dropped ");
+    text += String(webClientDropped.get(channel));
+    text += F(", closed ");
+    text += String(webClientClosed.get(channel));
+    text += F(", rejected ");
+    text += String(webClientRejected.get(channel));
+    text += ')';
+  }
+  text += F(", slow clients: ");
+  text += webSlowPolicyName[webSlowPolicy];
+  return text;
+}
+
+// Boot phases for the status page, setup() phases in ms then the milestones in s
+String getBootProfileText()
+{
+  String text;
+  for (uint8_t phase = 0; phase < BOOT_SETUP_PHASES; phase++)
+  {
+    if (!bootReached((BootPhase)phase))
+      continue;
+    text += bootPhaseName[phase];
+    text += ' ';
+    text += String(bootPhaseDurationUs((BootPhase)phase) / 1000.0f, 1);
+    text += F(" ms, ");
+  }
+  for (uint8_t phase = BOOT_SETUP_PHASES; phase < BOOT_PHASE_COUNT; phase++)
+  {
+    text += bootPhaseName[phase];
+    text += ' ';
+    text += bootReached((BootPhase)phase) ? String(bootPhaseUs[phase] / 1000000.0f, 1) + F(" s") : String('-');
+    if (phase < BOOT_PHASE_COUNT - 1)
+      text += F(", ");
+  }
+  return text;
+}
+
+// Reach a milestone, fast boot run the deferred work once the unit and the broker are both up
+void bootMilestone(BootPhase phase)
+{
+  bootMark(phase);
+#ifdef FAST_BOOT
+  if (bootReached(BOOT_HP_STATUS) && bootReached(BOOT_MQTT_READY) && !bootReached(BOOT_DEFERRED))
+    schedAt(TASK_BOOT_DEFERRED, 0, bootDeferredWork); // HP and MQTT tasks call this, run it from loop()
+#endif
+}
+
+// Boot work the unit control does not need, run from setup() or after the first HP status and MQTT connect
+void bootDeferredWork()
+{
+  if (bootReached(BOOT_DEFERRED))
+    return;
+  schedCancel(TASK_BOOT_DEFERRED);
+  if (SPIFFS.exists(console_file))
+  {
+    SPIFFS.remove(console_file);
+  }
+  MDNS.begin(hostname); // DNS service for .local address access
+  MDNS.addService("http", "tcp", 80);
+  bootMark(BOOT_DEFERRED);
+  if (mqttClient != nullptr && mqttClient->connected())
+    sendHaConfig();
+}
+
+// Web firmware upgrade, not offered when flash encryption and secure boot are on
+void initUpgradeRoutes()
+{
+  if (!isSecureEnable())
+  {
+    server.on("/upgrade", handleUpgrade);
+    server.on("/upload", WebRequestMethod::HTTP_ANY, handleUploadDone, handleUploadLoop);
+#ifdef ESP32
+    Update.onProgress(otaUpdateProgress);
+#endif
+  }
+}
+
+// HP packet callback, run in the HP task on ESP32. Debug packets are only copied here, sendPacketLog publish them
+void hpPacketDebug(uint8_t unit, byte *packet, unsigned int length, const char *packetDirection)
+{
+  bool sent = strcmp(packetDirection, "packetSent") == 0;
+  cmdTracePacket(unit, packet, length, packetDirection);
+  hpExtPacket(unit, packet, length, sent);
+  if (unit == 0)
+    captureAdd(packet, length, sent); // capture is for the first unit
+  if (_debugModePckts)
+    packetLogAdd(unit, packet, length, sent);
+}
+
+// Publish the next batch of debug packets, QoS 0 so a busy unit does not fill the MQTT outbox
+void sendPacketLog()
+{
+  static char text[PACKET_LOG_TEXT_SIZE];
+  if (mqttClient == nullptr || !mqttClient->connected())
+    return;
+  while (packetLogPending() && mqttClient->queueSize() < PACKET_LOG_OUTBOX)
+  {
+    size_t length = packetLogFormat(text, sizeof(text));
+    if (length == 0)
+      return;
+    if (!mqttPublish(HaTopic(HA_TOPIC_DEBUG_PCKTS).c_str(), 0, false, text))
     {
-      String mqttOutput;
-      serializeJson(root, mqttOutput);
-      if (!mqttClient->publish(ha_debug_pckts_topic.c_str(), 1, false, mqttOutput.c_str()))
-      {
-        mqttClient->publish(ha_debug_logs_topic.c_str(), 1, false, (char *)("Failed to publish to heatpump/debug topic"));
-      }
+      if (_debugModeLogs)
+        mqttPublish(HaTopic(HA_TOPIC_DEBUG_LOGS).c_str(), 1, false, (char *)("Failed to publish to heatpump/debug topic"));
+      return;
     }
   }
+  if (packetLogPending())
+    schedAt(TASK_PACKET_LOG, PACKET_LOG_BUSY_MS, sendPacketLog, PACKET_LOG_PUBLISH_MS); // outbox full, keep the period
 }
 
 // Used to send a dummy packet in state topic to validate action in HA interface
 // HA change GUI appareance before having a valid state from the unit
-void hpSendLocalState()
+void hpSendLocalState(uint8_t unit)
 {
   if (mqttClient != nullptr && mqttClient->connected())
   {
     String mqttOutput;
-    serializeJson(rootInfo, mqttOutput);
+    ROOT_INFO_LOCK();
+    serializeJson(rootInfo[unit], mqttOutput);
+    ROOT_INFO_UNLOCK();
     if (_debugModePckts)
-      mqttClient->publish(ha_debug_pckts_topic.c_str(), 1, false, mqttOutput.c_str());
-    if (!mqttClient->publish(ha_state_topic.c_str(), 1, false, mqttOutput.c_str()))
+      mqttPublish(HaTopic(HA_TOPIC_DEBUG_PCKTS).c_str(), 1, false, mqttOutput.c_str());
+    if (!mqttPublish(HaTopic(HA_TOPIC_STATE, unit).c_str(), 1, false, mqttOutput.c_str()))
     {
       if (_debugModeLogs)
-        mqttClient->publish(ha_debug_logs_topic.c_str(), 1, false, (char *)("Failed to publish dummy hp status change"));
+        mqttPublish(HaTopic(HA_TOPIC_DEBUG_LOGS).c_str(), 1, false, (char *)("Failed to publish dummy hp status change"));
     }
   }
   // Restart counter for waiting enought time for the unit to update before sending a state packet
@@ -2434,73 +3876,96 @@ void mqttCallback(const char *topic, const uint8_t *payload, const unsigned int
   memcpy(message, payload, length);
   message[length] = '\0';
   bool update = false;
+  float reading;
+  TEMP_FUSION_CONFIG_LOCK(); // loop() may be loading another source config
+  int source = tempFusionMatch(topic);
+  bool parsed = source >= 0 && tempFusionParse(source, message, reading);
+  TEMP_FUSION_CONFIG_UNLOCK();
+  if (source >= 0)
+  {
+    if (parsed)
+    {
+      float fused;
+      uint8_t unit = tempFusionReading(source, convertLocalUnitToCelsius(reading, useFahrenheit), fused);
+      hpRemoteTempReading(unit, fused);
+    }
+    delete[] message;
+    return;
+  }
+  uint8_t unit;
+  HaTopicId topic_id = haTopicMatch(topic, unit);
+  ROOT_INFO_LOCK();
+  JsonDocument &unitInfo = rootInfo[unit];
   // HA topics
   // Receive power topic
-  if (strcmp(topic, ha_power_set_topic.c_str()) == 0)
+  if (topic_id == HA_TOPIC_POWER_SET)
   {
     String modeUpper = message;
     modeUpper.toUpperCase();
     if (modeUpper == "OFF") {
-        hp.setPowerSetting(modeUpper.c_str());
+        hpSendCommand(unit, HP_CMD_POWER, modeUpper.c_str());
         update = true;
+        cmdTraceBegin(unit, CMD_TRACE_POWER);
     } else if (modeUpper == "ON") {
         // Set temp and mode
-        heatpumpSettings currentSettings = hp.getSettings();
-        hp.setModeSetting(currentSettings.mode);
-        rootInfo["mode"] = hpGetMode(currentSettings);
+        heatpumpSettings currentSettings = hpGetSettings(unit);
+        hpSendCommand(unit, HP_CMD_MODE, currentSettings.mode);
+        unitInfo["mode"] = hpGetMode(currentSettings);
         //
         float temperature_c = convertLocalUnitToCelsius(currentSettings.temperature, useFahrenheit);
         if (temperature_c < min_temp || temperature_c > max_temp) {
             temperature_c = 23;
-            rootInfo["temperature"] = convertCelsiusToLocalUnit(temperature_c, useFahrenheit);
+            unitInfo["temperature"] = convertCelsiusToLocalUnit(temperature_c, useFahrenheit);
         } else {
-            rootInfo["temperature"] = temperature_c;
+            unitInfo["temperature"] = temperature_c;
         }
-        hp.setTemperature(temperature_c);
-        hp.setPowerSetting(modeUpper.c_str());
-        hpSendLocalState();
+        hpSendCommand(unit, HP_CMD_TEMPERATURE, nullptr, temperature_c);
+        hpSendCommand(unit, HP_CMD_POWER, modeUpper.c_str());
+        hpSendLocalState(unit);
         update = true;
+        cmdTraceBegin(unit, CMD_TRACE_POWER);
     }
   }
-  else if (strcmp(topic, ha_mode_set_topic.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_MODE_SET)
   {
     String modeUpper = message;
     modeUpper.toUpperCase();
     if (modeUpper == "OFF")
     {
-      rootInfo["mode"] = F("off");
-      rootInfo["action"] = F("off");
-      hpSendLocalState();
-      hp.setPowerSetting("OFF");
+      unitInfo["mode"] = F("off");
+      unitInfo["action"] = F("off");
+      hpSendLocalState(unit);
+      hpSendCommand(unit, HP_CMD_POWER, "OFF");
       update = true;
+      cmdTraceBegin(unit, CMD_TRACE_MODE);
     }
     else
     {
       if (modeUpper == "HEAT_COOL")
       {
-        rootInfo["mode"] = F("heat_cool");
-        rootInfo["action"] = F("idle");
+        unitInfo["mode"] = F("heat_cool");
+        unitInfo["action"] = F("idle");
         modeUpper = F("AUTO");
       }
       else if (modeUpper == "HEAT")
       {
-        rootInfo["mode"] = F("heat");
-        rootInfo["action"] = F("heating");
+        unitInfo["mode"] = F("heat");
+        unitInfo["action"] = F("heating");
       }
       else if (modeUpper == "COOL")
       {
-        rootInfo["mode"] = F("cool");
-        rootInfo["action"] = F("cooling");
+        unitInfo["mode"] = F("cool");
+        unitInfo["action"] = F("cooling");
       }
       else if (modeUpper == "DRY")
       {
-        rootInfo["mode"] = F("dry");
-        rootInfo["action"] = F("drying");
+        unitInfo["mode"] = F("dry");
+        unitInfo["action"] = F("drying");
       }
       else if (modeUpper == "FAN_ONLY")
       {
-        rootInfo["mode"] = F("fan_only");
-        rootInfo["action"] = F("fan");
+        unitInfo["mode"] = F("fan_only");
+        unitInfo["action"] = F("fan");
         modeUpper = F("FAN");
       }
       else
@@ -2509,105 +3974,107 @@ void mqttCallback(const char *topic, const uint8_t *payload, const unsigned int
       }
 
       if (modeUpper.length() > 0) {
-        hpSendLocalState();
-        hp.setPowerSetting("ON");
-        hp.setModeSetting(modeUpper.c_str());
+        hpSendLocalState(unit);
+        hpSendCommand(unit, HP_CMD_POWER, "ON");
+        hpSendCommand(unit, HP_CMD_MODE, modeUpper.c_str());
         update = true;
+        cmdTraceBegin(unit, CMD_TRACE_MODE);
       }
     }
   }
-  else if (strcmp(topic, ha_temp_set_topic.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_TEMP_SET)
   {
     float temperature = strtof(message, NULL);
     // add to fix HP turn off after change temperature
-    heatpumpSettings currentSettings = hp.getSettings();
-    hp.setPowerSetting(currentSettings.power);
-    hp.setModeSetting(currentSettings.mode);
+    heatpumpSettings currentSettings = hpGetSettings(unit);
+    hpSendCommand(unit, HP_CMD_POWER, currentSettings.power);
+    hpSendCommand(unit, HP_CMD_MODE, currentSettings.mode);
     //
     float temperature_c = convertLocalUnitToCelsius(temperature, useFahrenheit);
     if (temperature_c < min_temp || temperature_c > max_temp)
     {
       temperature_c = 23;
-      rootInfo["temperature"] = convertCelsiusToLocalUnit(temperature_c, useFahrenheit);
+      unitInfo["temperature"] = convertCelsiusToLocalUnit(temperature_c, useFahrenheit);
     }
     else
     {
-      rootInfo["temperature"] = temperature;
+      unitInfo["temperature"] = temperature;
     }
-    hpSendLocalState();
-    hp.setTemperature(temperature_c);
+    hpSendLocalState(unit);
+    hpSendCommand(unit, HP_CMD_TEMPERATURE, nullptr, temperature_c);
     update = true;
+    cmdTraceBegin(unit, CMD_TRACE_TEMP);
   }
-  else if (strcmp(topic, ha_fan_set_topic.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_FAN_SET)
   {
-    rootInfo["fan"] = message;
-    hpSendLocalState();
-    hp.setFanSpeed(getFanModeFromHa(message).c_str());
+    unitInfo["fan"] = message;
+    hpSendLocalState(unit);
+    hpSendCommand(unit, HP_CMD_FAN, getFanModeFromHa(message).c_str());
     update = true;
+    cmdTraceBegin(unit, CMD_TRACE_FAN);
   }
-  else if (strcmp(topic, ha_vane_set_topic.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_VANE_SET)
   {
-    rootInfo["vane"] = message;
-    hpSendLocalState();
-    hp.setVaneSetting(message);
+    unitInfo["vane"] = message;
+    hpSendLocalState(unit);
+    hpSendCommand(unit, HP_CMD_VANE, message);
     update = true;
+    cmdTraceBegin(unit, CMD_TRACE_VANE);
   }
-  else if (strcmp(topic, ha_wide_vane_set_topic.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_WIDE_VANE_SET)
   {
-    rootInfo["wideVane"] = (String)message;
-    hpSendLocalState();
-    hp.setWideVaneSetting(message);
+    unitInfo["wideVane"] = (String)message;
+    hpSendLocalState(unit);
+    hpSendCommand(unit, HP_CMD_WIDE_VANE, message);
     update = true;
+    cmdTraceBegin(unit, CMD_TRACE_WIDE_VANE);
   }
 
-  else if (strcmp(topic, ha_remote_temp_set_topic.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_REMOTE_TEMP_SET)
   {
     float temperature = strtof(message, NULL);
     if (temperature == 0)
-    {                           // Remote temp disabled by mqtt topic set
-      remoteTempActive = false; // clear the remote temp flag
-      hp.setRemoteTemperature(0.0);
+    {                        // Remote temp disabled by mqtt topic set
+      remoteTempStop(unit); // the check task stop when no unit use it
+      cmdTraceBegin(unit, CMD_TRACE_REMOTE_TEMP);
+      hpSendCommand(unit, HP_CMD_REMOTE_TEMP, nullptr, 0.0);
     }
     else
     {
-      remoteTempActive = true;   // Remote temp has been pushed.
-      lastRemoteTemp = millis(); // Note time
-      hp.setRemoteTemperature(convertLocalUnitToCelsius(temperature, useFahrenheit));
+      hpRemoteTempReading(unit, convertLocalUnitToCelsius(temperature, useFahrenheit));
     }
-
-    update = true;
   }
-  else if (strcmp(topic, ha_debug_pckts_set_topic.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_DEBUG_PCKTS_SET)
   { // if the incoming message is on the heatpump_debug_set_topic topic...
     if (strcmp(message, "on") == 0)
     {
       _debugModePckts = true;
-      saveCurrentOthers();
-      mqttClient->publish(ha_debug_pckts_topic.c_str(), 1, false, (char *)("Debug packets mode enabled"));
+      sendConfigSaveRequest(APPLY_OTHERS);
+      mqttPublish(HaTopic(HA_TOPIC_DEBUG_PCKTS).c_str(), 1, false, (char *)("Debug packets mode enabled"));
     }
     else if (strcmp(message, "off") == 0)
     {
       _debugModePckts = false;
-      saveCurrentOthers();
-      mqttClient->publish(ha_debug_pckts_topic.c_str(), 1, false, (char *)("Debug packets mode disabled"));
+      sendConfigSaveRequest(APPLY_OTHERS);
+      mqttPublish(HaTopic(HA_TOPIC_DEBUG_PCKTS).c_str(), 1, false, (char *)("Debug packets mode disabled"));
     }
   }
-  else if (strcmp(topic, ha_debug_logs_set_topic.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_DEBUG_LOGS_SET)
   { // if the incoming message is on the heatpump_debug_set_topic topic...
     if (strcmp(message, "on") == 0)
     {
       _debugModeLogs = true;
-      saveCurrentOthers();
-      mqttClient->publish(ha_debug_logs_topic.c_str(), 1, false, (char *)"Debug mode enabled");
+      sendConfigSaveRequest(APPLY_OTHERS);
+      mqttPublish(HaTopic(HA_TOPIC_DEBUG_LOGS).c_str(), 1, false, (char *)"Debug mode enabled");
     }
     else if (strcmp(message, "off") == 0)
     {
       _debugModeLogs = false;
-      saveCurrentOthers();
-      mqttClient->publish(ha_debug_logs_topic.c_str(), 1, false, (char *)"Debug mode disabled");
+      sendConfigSaveRequest(APPLY_OTHERS);
+      mqttPublish(HaTopic(HA_TOPIC_DEBUG_LOGS).c_str(), 1, false, (char *)"Debug mode disabled");
     }
   }
-  else if (strcmp(topic, ha_system_set_topic.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_SYSTEM_SET)
   { // We receive command for board
     if ((strcmp(message, "restart") == 0) and !requestReboot)
     { // We receive reboot command
@@ -2619,12 +4086,12 @@ void mqttCallback(const char *topic, const uint8_t *payload, const unsigned int
       factoryReset();
     }
   }
-  else if (strcmp(topic, ha_birth_topic.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_BIRTH)
   { // We receive birth topic from ha
     if (strcmp(message, mqtt_payload_available) == 0)
-      sendKeepAlive(true);
+      sendKeepAlive();
   }
-  else if (strcmp(topic, ha_custom_packet.c_str()) == 0)
+  else if (topic_id == HA_TOPIC_CUSTOM_PACKET)
   { // send custom packet for advance user
     String custom = message;
 
@@ -2646,11 +4113,11 @@ void mqttCallback(const char *topic, const uint8_t *payload, const unsigned int
     }
 
     // dump the packet so we can see what it is. handy because you can run the code without connecting the ESP to the heatpump, and test sending custom packets
-    hpPacketDebug(bytes, byteCount, "customPacket");
+    hpPacketDebug(unit, bytes, byteCount, "customPacket");
 
-    hp.sendCustomPacket(bytes, byteCount);
+    hpSendCustomPacket(unit, bytes, byteCount);
   }
-  else if (strcmp(topic, ha_system_setting_request.c_str()) == 0) // We receive command for board
+  else if (topic_id == HA_TOPIC_SYSTEM_SETTING_REQUEST) // We receive command for board
   {
       // Allocate document capacity.
       const size_t capacity = JSON_OBJECT_SIZE(3) + 121;
@@ -2673,11 +4140,11 @@ void mqttCallback(const char *topic, const uint8_t *payload, const unsigned int
                           new_web_panel_disable = true;
                       }
                       if (_webPanelDisable != new_web_panel_disable) {
-                          ESP_LOGI(TAG, "Set Webpanel option and reboot");
+                          ESP_LOGI(TAG, "Set Webpanel option and apply");
                           _webPanelDisable = new_web_panel_disable;
-                          saveCurrentOthers();
-                          sendRebootRequest(5);
-                          mqttClient->publish(ha_system_setting_respond.c_str(), 1, false, message);
+                          sendConfigSaveRequest(APPLY_OTHERS);
+                          sendConfigApplyRequest(APPLY_OTHERS);
+                          mqttPublish(HaTopic(HA_TOPIC_SYSTEM_SETTING_RESPOND).c_str(), 1, false, message);
                       } else {
                           ESP_LOGE(TAG, "Set Web panel option do nothing");
                       }
@@ -2694,19 +4161,14 @@ void mqttCallback(const char *topic, const uint8_t *payload, const unsigned int
   {
     String msg("heatpump: wrong mqtt topic: ");
     msg += topic;
-    mqttClient->publish(ha_debug_logs_topic.c_str(), 1, false, msg.c_str());
+    mqttPublish(HaTopic(HA_TOPIC_DEBUG_LOGS).c_str(), 1, false, msg.c_str());
   }
 
+  ROOT_INFO_UNLOCK();
+
   if (update)
   {
-    if (hp.getSettings() == hp.getWantedSettings()) // only update it settings change
-    {
-      ESP_LOGW(TAG, "Same Settings to HP, Igrore");
-    } else {
-      ESP_LOGI(TAG, "Send Settings to HP");
-      requestHpUpdate = true;
-      requestHpUpdateTime = millis() + 10;
-    }
+    hpSendCommand(unit, HP_CMD_UPDATE);
   }
   delete[] message;
 }
@@ -2721,7 +4183,13 @@ static const char* const entityTagLUT[MAX_ENTITY_ID + 1] = {
     /* 5 */ "bssi",
     /* 6 */ "compressor_freq",
     /* 7 */ "restart",
-    /* 8 */ "webpanel"};
+    /* 8 */ "webpanel",
+    /* 9 */ "config_writes",
+    /* 10 */ "outdoor_temperature",
+    /* 11 */ "input_power",
+    /* 12 */ "energy",
+    /* 13 */ "error_code",
+    /* 14 */ "runtime_hours"};
 
 // Lookup tables for Name lookup
 static const char* const entityNameLUT[MAX_ENTITY_ID + 1] = {
@@ -2733,7 +4201,13 @@ static const char* const entityNameLUT[MAX_ENTITY_ID + 1] = {
     /* 5 */ "BSSI",
     /* 6 */ "Compressor Freq",
     /* 7 */ "Restart",
-    /* 8 */ "WebPanel"};
+    /* 8 */ "WebPanel",
+    /* 9 */ "Config Writes",
+    /* 10 */ "Outdoor Temperature",
+    /* 11 */ "Input Power",
+    /* 12 */ "Energy",
+    /* 13 */ "Error Code",
+    /* 14 */ "Runtime"};
 
 //Fast lookup functions for Tag
 const char* getEntityTag(byte tag_id) {
@@ -2751,23 +4225,22 @@ const char* getEntityName(byte tag_id) {
     return "Unknown";
 }
 
-String haGetConfigTopic(String entity_type, String entity_tag = "")
+// Suffix of the ids and names of an extra unit, empty for the first one
+String haUnitSuffix(uint8_t unit)
 {
-  String ha_topic;
+  return unit > 0 ? "_unit" + String(unit + 1) : String();
+}
 
-  ha_topic = (others_haa ? others_haa_topic : "homeassistant")  + "/" + entity_type + "/";
+HaTopic haGetConfigTopic(const char *entity_type, const char *entity_tag = nullptr, uint8_t unit = 0)
+{
   if (mqtt_fn.isEmpty()) {
       mqtt_fn = getId();
   }
-  ha_topic += mqtt_fn + "/";
-  if (!entity_tag.isEmpty()) {
-      ha_topic += entity_tag + "/";
-  }
-  ha_topic += "config";
-  return ha_topic;
+  return HaTopic(entity_type, (mqtt_fn + haUnitSuffix(unit)).c_str(), entity_tag);
 }
 
-void haConfigureDevice(DynamicJsonDocument &haConfig)
+// Extra units are devices of their own, linked to the first one
+void haConfigureDevice(DynamicJsonDocument &haConfig, uint8_t unit = 0)
 {
   const size_t capacity = JSON_ARRAY_SIZE(15) + JSON_OBJECT_SIZE(30) + 50;
   DynamicJsonDocument haConnInfo(capacity);  
@@ -2778,16 +4251,24 @@ void haConfigureDevice(DynamicJsonDocument &haConfig)
   JsonObject haConfigDevice = haConfig.createNestedObject(F("dev"));
   
   // identifiers array
-  haConfigDevice.createNestedArray(F("ids"))[0] = mqtt_fn + "_" + dev_id;
+  haConfigDevice.createNestedArray(F("ids"))[0] = mqtt_fn + "_" + dev_id + haUnitSuffix(unit);
 
-  // connection info (mac)
-  haConnInfo.createNestedArray();
-  haConnInfo[0] = F("mac");
-  haConnInfo[1] = dev_id;
-  haConfigDevice.createNestedArray("cns")[0] = haConnInfo;
+  if (unit == 0)
+  {
+    // connection info (mac), HA would merge the devices sharing it
+    haConnInfo.createNestedArray();
+    haConnInfo[0] = F("mac");
+    haConnInfo[1] = dev_id;
+    haConfigDevice.createNestedArray("cns")[0] = haConnInfo;
+    haConfigDevice[F("name")] = mqtt_fn;
+  }
+  else
+  {
+    haConfigDevice[F("name")] = mqtt_fn + " unit " + String(unit + 1);
+    haConfigDevice[F("via_device")] = mqtt_fn + "_" + dev_id;
+  }
 
   // other device infos
-  haConfigDevice[F("name")] = mqtt_fn;
   haConfigDevice[F("sw")] = String(appName) + " " + String(getAppVersion());
 #ifdef ESP32
   String hardware = String(CONFIG_IDF_TARGET);
@@ -2802,12 +4283,12 @@ void haConfigureDevice(DynamicJsonDocument &haConfig)
     haConfigDevice[F("cu")] = "http://" + WiFi.localIP().toString();
 
   // availability topic
-  haConfig[F("avty_t")] = ha_availability_topic;
+  haConfig[F("avty_t")] = HaTopic(HA_TOPIC_AVAILABILITY).buf;
   haConfig[F("pl_avail")] = mqtt_payload_available;       // MQTT online message payload
   haConfig[F("pl_not_avail")] = mqtt_payload_unavailable; // MQTT offline message payload
 }
 
-void haConfigSensor(byte tag_id, String unit, String icon, bool is_diagnostic = false)
+void haConfigSensor(byte tag_id, String unit, String icon, bool is_diagnostic = false, uint8_t hpUnit = 0)
 {
   // send HA config packet for up time
   const size_t capacity = JSON_ARRAY_SIZE(15) + JSON_OBJECT_SIZE(30) + 250;
@@ -2818,56 +4299,79 @@ void haConfigSensor(byte tag_id, String unit, String icon, bool is_diagnostic =
   
   // Set unique ID and value template
   String tag = getEntityTag(tag_id);
-  haConfig[F("unique_id")] = getId() + "_" + tag;
+  haConfig[F("unique_id")] = getId() + haUnitSuffix(hpUnit) + "_" + tag;
   haConfig[F("val_tpl")] = "{{ value_json." + tag + " }}";
 
   if (tag_id == ENT_ROOM_TEMPERATURE)
   {
     haConfig[F("dev_cla")] = "temperature";
     haConfig[F("unit_of_meas")] = useFahrenheit ? F("°F") : F("°C");
-    haConfig[F("stat_t")] = ha_state_topic;
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_STATE, hpUnit).buf;
   }
   else if (tag_id == ENT_COMPR_FRQ)
   {
     haConfig[F("dev_cla")] = "frequency";
     haConfig[F("unit_of_meas")] = unit;
-    haConfig[F("stat_t")] = ha_state_topic;
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_STATE, hpUnit).buf;
   }
   else if (tag_id == ENT_CONNECTION_STATE)
   {
     haConfig[F("dev_cla")] = "connectivity";
     haConfig[F("payload_on")] = "online";
     haConfig[F("payload_off")] = "offline";
-    haConfig[F("stat_t")] = ha_system_info_topic;
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_SYSTEM_INFO).buf;
   }
   else if (tag_id == ENT_UP_TIME)
   {
     haConfig[F("dev_cla")] = "timestamp";
     haConfig[F("val_tpl")] = "{{ as_datetime(value_json." + tag + ") }}";
     // haConfig[F("unit_of_meas")] = unit;
-    haConfig[F("stat_t")] = ha_system_info_topic;
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_SYSTEM_INFO).buf;
   }
   else if (tag_id == ENT_FREE_HEAP)
   {
     haConfig[F("unit_of_meas")] = unit;
     haConfig[F("sug_dsp_prc")] = 0;
-    haConfig[F("stat_t")] = ha_system_info_topic;
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_SYSTEM_INFO).buf;
   }
   else if (tag_id == ENT_RSSI)
   {
     haConfig[F("unit_of_meas")] = unit;
-    haConfig[F("stat_t")] = ha_system_info_topic;
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_SYSTEM_INFO).buf;
   }
   else if (tag_id == ENT_BSSI)
   {
-    haConfig[F("stat_t")] = ha_system_info_topic;
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_SYSTEM_INFO).buf;
+  }
+  else if (tag_id == ENT_CFG_WRITES)
+  {
+    haConfig[F("stat_cla")] = "total_increasing";
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_SYSTEM_INFO).buf;
+  }
+  else if (tag_id == ENT_OUTDOOR_TEMPERATURE)
+  {
+    haConfig[F("dev_cla")] = "temperature";
+    haConfig[F("stat_cla")] = "measurement";
+    haConfig[F("unit_of_meas")] = useFahrenheit ? F("°F") : F("°C");
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_STATE, hpUnit).buf;
+  }
+  else if (tag_id == ENT_INPUT_POWER || tag_id == ENT_ENERGY || tag_id == ENT_RUNTIME)
+  {
+    haConfig[F("dev_cla")] = tag_id == ENT_INPUT_POWER ? "power" : tag_id == ENT_ENERGY ? "energy" : "duration";
+    haConfig[F("stat_cla")] = tag_id == ENT_INPUT_POWER ? "measurement" : "total_increasing";
+    haConfig[F("unit_of_meas")] = unit;
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_STATE, hpUnit).buf;
+  }
+  else if (tag_id == ENT_ERROR_CODE)
+  {
+    haConfig[F("stat_t")] = HaTopic(HA_TOPIC_STATE, hpUnit).buf;
   }
 
   if (is_diagnostic)
     haConfig[F("ent_cat")] = F("diagnostic");
 
   // add device info
-  haConfigureDevice(haConfig);
+  haConfigureDevice(haConfig, hpUnit);
   
   String mqttOutput;
   serializeJson(haConfig, mqttOutput);
@@ -2882,8 +4386,8 @@ void haConfigSensor(byte tag_id, String unit, String icon, bool is_diagnostic =
     ha_entity_type = F("sensor");
   }
 
-  String ha_config_topic = haGetConfigTopic(ha_entity_type, tag);
-  mqttClient->publish(ha_config_topic.c_str(), 1, true, mqttOutput.c_str());
+  HaTopic ha_config_topic = haGetConfigTopic(ha_entity_type.c_str(), tag.c_str(), hpUnit);
+  mqttPublish(ha_config_topic.c_str(), 1, true, mqttOutput.c_str());
 }
 
 void haConfigButton(byte tag_id, String payload_press, String icon)
@@ -2901,7 +4405,7 @@ void haConfigButton(byte tag_id, String payload_press, String icon)
 
   haConfig[F("dev_cla")] = payload_press;
   haConfig[F("payload_press")] = payload_press; //"restart", "factory", "upgrade" ;
-  haConfig[F("command_topic")] = ha_system_set_topic;
+  haConfig[F("command_topic")] = HaTopic(HA_TOPIC_SYSTEM_SET).buf;
   haConfig[F("ent_cat")] = F("config");
   
   // add device info
@@ -2909,8 +4413,8 @@ void haConfigButton(byte tag_id, String payload_press, String icon)
 
   String mqttOutput;
   serializeJson(haConfig, mqttOutput);
-  String ha_config_topic = haGetConfigTopic("button", tag);
-  mqttClient->publish(ha_config_topic.c_str(), 1, true, mqttOutput.c_str());
+  HaTopic ha_config_topic = haGetConfigTopic("button", tag.c_str());
+  mqttPublish(ha_config_topic.c_str(), 1, true, mqttOutput.c_str());
 }
 
 void haConfigOption(uint8_t tag_id, String icon) {
@@ -2923,14 +4427,14 @@ void haConfigOption(uint8_t tag_id, String icon) {
     String tag = getEntityTag(tag_id);
     haConfig[F("unique_id")] = getId() + "_" + tag;
     haConfig[F("command_template")] = "{\"options\": {\"" + tag + "\": \"{{ value }}\" } }";
-    haConfig[F("command_topic")] = ha_system_setting_request;
+    haConfig[F("command_topic")] = HaTopic(HA_TOPIC_SYSTEM_SETTING_REQUEST).buf;
 
     JsonArray haConfigOptions = haConfig[F("options")].to<JsonArray>();
     if (tag_id == ENT_WEB_PANEL) {
         haConfigOptions.add("On");
         haConfigOptions.add("Off");
     }
-    haConfig[F("state_topic")] = ha_system_setting_info;
+    haConfig[F("state_topic")] = HaTopic(HA_TOPIC_SYSTEM_INFO).buf;
     haConfig[F("value_template")] = "{{ value_json." + tag + " }}";
     haConfig[F("entity_category")] = F("config");
 
@@ -2938,8 +4442,8 @@ void haConfigOption(uint8_t tag_id, String icon) {
 
     String mqttOutput;
     serializeJson(haConfig, mqttOutput);
-    String ha_config_topic = haGetConfigTopic("select", tag);
-    mqttClient->publish(ha_config_topic.c_str(), 1, true, mqttOutput.c_str());
+    HaTopic ha_config_topic = haGetConfigTopic("select", tag.c_str());
+    mqttPublish(ha_config_topic.c_str(), 1, true, mqttOutput.c_str());
 }
 
 void sendDeviceInfo()
@@ -2948,10 +4452,10 @@ void sendDeviceInfo()
   uint32_t freeHeapBytes = getFreeHeapBytes();
   uint32_t totalHeapBytes = getTotalHeapBytes();
 
-  const size_t capacity = JSON_OBJECT_SIZE(10);
+  const size_t capacity = JSON_OBJECT_SIZE(11) + JSON_OBJECT_SIZE(BOOT_PHASE_COUNT);
   DynamicJsonDocument haConfigInfo(capacity);
 
-  haConfigInfo[getEntityTag(ENT_CONNECTION_STATE)] = hp.isConnected() ? "online" : "offline";
+  haConfigInfo[getEntityTag(ENT_CONNECTION_STATE)] = hpIsConnected() ? "online" : "offline";
   // get free heap in percent
   // we round to 0.5 (half) to avoid continue changes
   //float percentageHeapFree = 0.5 * round(2.0*(freeHeapBytes * 100.0f / (float)totalHeapBytes));
@@ -2964,13 +4468,29 @@ void sendDeviceInfo()
   haConfigInfo[getEntityTag(ENT_BSSI)] = getWifiBSSID();
   haConfigInfo[getEntityTag(ENT_UP_TIME)] = getUpTimeSeconds();
   haConfigInfo[getEntityTag(ENT_WEB_PANEL)] = _webPanelDisable ? "Off" : "On";
+  haConfigInfo[getEntityTag(ENT_CFG_WRITES)] = configWrites.get();
+  // boot phases in us, sent until every milestone is in
+  static bool bootProfileSent = false;
+  if (!bootProfileSent)
+  {
+    JsonObject boot = haConfigInfo.createNestedObject("boot_us");
+    bool complete = true;
+    for (uint8_t phase = 0; phase < BOOT_PHASE_COUNT; phase++)
+    {
+      if (bootReached((BootPhase)phase))
+        boot[bootPhaseName[phase]] = bootPhaseDurationUs((BootPhase)phase);
+      else if (phase >= BOOT_SETUP_PHASES)
+        complete = false;
+    }
+    bootProfileSent = complete;
+  }
 
   String mqttOutput;
   serializeJson(haConfigInfo, mqttOutput);
-  mqttClient->publish(ha_system_info_topic.c_str(), 1, false, mqttOutput.c_str());
+  mqttPublish(HaTopic(HA_TOPIC_SYSTEM_INFO).c_str(), 1, false, mqttOutput.c_str());
 }
 
-void haConfigClimate()
+void haConfigClimate(uint8_t unit)
 {
   // send HA config packet
   // setup HA payload device
@@ -2978,7 +4498,7 @@ void haConfigClimate()
   DynamicJsonDocument haConfig(capacity);
 
   haConfig[F("name")] = nullptr;
-  haConfig[F("unique_id")] = getId();
+  haConfig[F("unique_id")] = getId() + haUnitSuffix(unit);
 
   JsonArray haConfigModes = haConfig.createNestedArray(F("modes"));
   haConfigModes.add(F("heat_cool")); // native AUTO mode
@@ -2991,12 +4511,12 @@ void haConfigClimate()
   haConfigModes.add(F("fan_only")); // native FAN mode
   haConfigModes.add(F("off"));
 
-  haConfig[F("mode_cmd_t")] = ha_mode_set_topic;
-  haConfig[F("mode_stat_t")] = ha_state_topic;
+  haConfig[F("mode_cmd_t")] = HaTopic(HA_TOPIC_MODE_SET, unit).buf;
+  haConfig[F("mode_stat_t")] = HaTopic(HA_TOPIC_STATE, unit).buf;
   haConfig[F("mode_stat_tpl")] = F("{{ value_json.mode if (value_json is defined and value_json.mode is defined and value_json.mode|length) else 'off' }}"); // Set default value for fix "Could not parse data for HA"
-  haConfig[F("temp_cmd_t")] = ha_temp_set_topic;
-  haConfig[F("temp_stat_t")] = ha_state_topic;
-  haConfig[F("pow_cmd_t")] = ha_power_set_topic;
+  haConfig[F("temp_cmd_t")] = HaTopic(HA_TOPIC_TEMP_SET, unit).buf;
+  haConfig[F("temp_stat_t")] = HaTopic(HA_TOPIC_STATE, unit).buf;
+  haConfig[F("pow_cmd_t")] = HaTopic(HA_TOPIC_POWER_SET, unit).buf;
 
   // Set default value for fix "Could not parse data for HA"
   String temp_stat_tpl_str = F("{% if (value_json is defined and value_json.temperature is defined) %}{% if (value_json.temperature|int >= ");
@@ -3004,7 +4524,7 @@ void haConfigClimate()
   temp_stat_tpl_str += (String)convertCelsiusToLocalUnit(max_temp, useFahrenheit) + ") %}{{ value_json.temperature }}";
   temp_stat_tpl_str += "{% elif (value_json.temperature|int < " + (String)convertCelsiusToLocalUnit(min_temp, useFahrenheit) + ") %}" + (String)convertCelsiusToLocalUnit(min_temp, useFahrenheit) + "{% elif (value_json.temperature|int > " + (String)convertCelsiusToLocalUnit(max_temp, useFahrenheit) + ") %}" + (String)convertCelsiusToLocalUnit(max_temp, useFahrenheit) + "{% endif %}{% else %}" + (String)convertCelsiusToLocalUnit(22, useFahrenheit) + "{% endif %}";
   haConfig[F("temp_stat_tpl")] = temp_stat_tpl_str;
-  haConfig[F("curr_temp_t")] = ha_state_topic;
+  haConfig[F("curr_temp_t")] = HaTopic(HA_TOPIC_STATE, unit).buf;
   String curr_temp_tpl_str = F("{{ value_json.room_temperature if (value_json is defined and value_json.room_temperature is defined and value_json.room_temperature|int > ");
   curr_temp_tpl_str += (String)convertCelsiusToLocalUnit(1, useFahrenheit) + ") }}"; // Set default value for fix "Could not parse data for HA"
   haConfig[F("curr_temp_tpl")] = curr_temp_tpl_str;
@@ -3025,8 +4545,8 @@ void haConfigClimate()
   haConfigFan_modes.add(F("middle")); //3 native
   haConfigFan_modes.add(F("high")); //4 native
 
-  haConfig[F("fan_mode_cmd_t")] = ha_fan_set_topic;
-  haConfig[F("fan_mode_stat_t")] = ha_state_topic;
+  haConfig[F("fan_mode_cmd_t")] = HaTopic(HA_TOPIC_FAN_SET, unit).buf;
+  haConfig[F("fan_mode_stat_t")] = HaTopic(HA_TOPIC_STATE, unit).buf;
   haConfig[F("fan_mode_stat_tpl")] = F("{{ value_json.fan if (value_json is defined and value_json.fan is defined and value_json.fan|length) else 'auto' }}"); // Set default value for fix "Could not parse data for HA"
 
   // vertical swing mode control
@@ -3039,8 +4559,8 @@ void haConfigClimate()
   haConfigSwing_modes.add(F("5"));
   haConfigSwing_modes.add(F("SWING"));
 
-  haConfig[F("swing_mode_cmd_t")] = ha_vane_set_topic;
-  haConfig[F("swing_mode_stat_t")] = ha_state_topic;
+  haConfig[F("swing_mode_cmd_t")] = HaTopic(HA_TOPIC_VANE_SET, unit).buf;
+  haConfig[F("swing_mode_stat_t")] = HaTopic(HA_TOPIC_STATE, unit).buf;
   haConfig[F("swing_mode_stat_tpl")] = F("{{ value_json.vane if (value_json is defined and value_json.vane is defined and value_json.vane|length) else 'AUTO' }}"); // Set default value for fix "Could not parse data for HA"
 
   // horizontal swing mode control
@@ -3053,27 +4573,42 @@ void haConfigClimate()
   haConfigSwing_H_modes.add(F("<>"));
   haConfigSwing_H_modes.add(F("SWING"));
 
-  haConfig[F("swing_h_mode_cmd_t")] = ha_wide_vane_set_topic;
-  haConfig[F("swing_h_mode_stat_t")] = ha_state_topic;
+  haConfig[F("swing_h_mode_cmd_t")] = HaTopic(HA_TOPIC_WIDE_VANE_SET, unit).buf;
+  haConfig[F("swing_h_mode_stat_t")] = HaTopic(HA_TOPIC_STATE, unit).buf;
   haConfig[F("swing_h_mode_stat_tpl")] = F("{{ value_json.wideVane if (value_json is defined and value_json.wideVane is defined and value_json.wideVane|length) else 'SWING' }}"); // Set default value for fix "Could not parse data for HA"
 
   // action control topic
-  haConfig[F("action_topic")] = ha_state_topic;
+  haConfig[F("action_topic")] = HaTopic(HA_TOPIC_STATE, unit).buf;
   haConfig[F("action_template")] = F("{{ value_json.action if (value_json is defined and value_json.action is defined and value_json.action|length) else 'idle' }}"); // Set default value for fix "Could not parse data for HA"
 
   // add device info
-  haConfigureDevice(haConfig);
+  haConfigureDevice(haConfig, unit);
 
   String mqttOutput;
   serializeJson(haConfig, mqttOutput);
-  String ha_config_topic = haGetConfigTopic("climate");
-  mqttClient->publish(ha_config_topic.c_str(), 1, true, mqttOutput.c_str());
+  HaTopic ha_config_topic = haGetConfigTopic("climate", nullptr, unit);
+  mqttPublish(ha_config_topic.c_str(), 1, true, mqttOutput.c_str());
+}
+
+// Sensors of the extended fields, sent once a unit report them
+void haConfigExtended(uint8_t unit, uint8_t fields)
+{
+  if (fields & HP_EXT_HAS_OUTDOOR_TEMP)
+    haConfigSensor(ENT_OUTDOOR_TEMPERATURE, "", "mdi:thermometer", false, unit);
+  if (fields & HP_EXT_HAS_POWER)
+    haConfigSensor(ENT_INPUT_POWER, "W", "mdi:flash", false, unit);
+  if (fields & HP_EXT_HAS_ENERGY)
+    haConfigSensor(ENT_ENERGY, "kWh", "mdi:lightning-bolt", false, unit);
+  if (fields & HP_EXT_HAS_ERROR)
+    haConfigSensor(ENT_ERROR_CODE, "", "mdi:alert-circle", true, unit);
+  if (fields & HP_EXT_HAS_RUNTIME)
+    haConfigSensor(ENT_RUNTIME, "h", "mdi:timer-outline", true, unit);
 }
 
 void sendHaConfig()
 {
   // Climate
-  haConfigClimate();
+  haConfigClimate(0);
 
   // Button
   haConfigButton(ENT_RESTART_BTN, "restart", "mdi:restart");
@@ -3088,13 +4623,26 @@ void sendHaConfig()
   haConfigSensor(ENT_FREE_HEAP, "%", "mdi:memory", true);
   haConfigSensor(ENT_RSSI, "dBm", "mdi:network-strength-1", true);
   haConfigSensor(ENT_BSSI, "", "mdi:router-wireless", true);
+  haConfigSensor(ENT_CFG_WRITES, "", "mdi:content-save", true);
   haConfigOption(ENT_WEB_PANEL, "mdi:cog");
+  // Extra units, the diagnostics stay on the first device
+  for (uint8_t unit = 1; unit < HP_UNIT_MAX; unit++)
+  {
+    haConfigClimate(unit);
+    haConfigSensor(ENT_ROOM_TEMPERATURE, "", "mdi:thermometer", false, unit);
+    haConfigSensor(ENT_COMPR_FRQ, "Hz", "mdi:sine-wave", false, unit);
+  }
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+  {
+    hpExtAnnounced[unit] = 0;
+    haConfigExtended(unit, hpExtTakeNew(unit, hpExtGet(unit).has));
+  }
 }
 
 void mqttConnect()
 {
   ESP_LOGD(TAG, "Connecting to MQTT...");
-  if (mqttClient != nullptr)
+  if (mqttClient != nullptr && !mqttClosing)
   {
     if (!mqtt_server.isEmpty() && !mqtt_port.isEmpty())
     {
@@ -3103,7 +4651,8 @@ void mqttConnect()
   }
 }
 
-bool connectWifi()
+// Set station hostname, static address and start association, do not wait for the result
+void configWifiStation()
 {
   // WiFi.disconnect(true);
   // delay(1000);
@@ -3147,46 +4696,8 @@ bool connectWifi()
 #else
     WiFi.config(0, 0, 0);
 #endif
-    }
-    WiFi.begin(ap_ssid.c_str(), ap_pwd.c_str());
-    ESP_LOGD(TAG, "Connected to %s", ap_ssid.c_str());
-    wifi_timeout = millis() + 30000;
-    while (WiFi.status() != WL_CONNECTED && millis() < wifi_timeout)
-    {
-      ESP_LOGD(TAG, ".");
-      // Serial.print(WiFi.status());
-      //  wait 500ms, flashing the blue LED to indicate WiFi connecting...
-      digitalWrite(blueLedPin, LOW);
-      delay(250);
-      digitalWrite(blueLedPin, HIGH);
-      delay(250);
-    }
-    if (WiFi.status() != WL_CONNECTED)
-    {
-      ESP_LOGD(TAG, "Failed to connect to wifi");
-      return false;
-    }
-    ESP_LOGD(TAG, "Connected to %s", ap_ssid.c_str());
-    ESP_LOGD(TAG, "Ready, IP address: ");
-    unsigned long dhcpStartTime = millis();
-    while ((WiFi.localIP().toString() == "0.0.0.0" || WiFi.localIP().toString() == "") && millis() - dhcpStartTime < 5000)
-    {
-      ESP_LOGD(TAG, ".");
-      delay(500);
-    }
-    if (WiFi.localIP().toString() == "0.0.0.0" || WiFi.localIP().toString() == "")
-    {
-      ESP_LOGD(TAG, "Failed to get IP address");
-      return false;
-    }
-    ESP_LOGD(TAG, "%s", WiFi.localIP().toString().c_str());
-    ticker.detach();  // Stop blinking the LED because now we are connected:)
-    // keep LED off
-    digitalWrite(blueLedPin, blueLedDisabled);
-    // Auto reconnected
-    WiFi.setAutoReconnect(true);
-    WiFi.persistent(true);
-    return true;
+  }
+  WiFi.begin(ap_ssid.c_str(), ap_pwd.c_str());
 }
 
 // temperature helper functions
@@ -3299,8 +4810,10 @@ void redirectLoginPage(AsyncWebServerRequest *request)
 
 bool checkLogin(AsyncWebServerRequest *request)
 {
+  httpRequests.add();
   if (!is_authenticated(request) && login_password.length() > 0)
   {
+    httpAuthFailures.add();
     redirectLoginPage(request);
     return false;
   }
@@ -3309,147 +4822,742 @@ bool checkLogin(AsyncWebServerRequest *request)
 
 void loop()
 {
+  {
+    LOOP_STAGE(STAGE_LOOP); // the idle sleep is not counted
 #ifdef ARDUINO_OTA
-  ArduinoOTA.handle();
+    {
+      LOOP_STAGE(STAGE_OTA);
+      ArduinoOTA.handle();
+    }
 #endif
 #ifdef WEBSOCKET_ENABLE
-  ws.cleanupClients();
+    {
+      LOOP_STAGE(STAGE_WS_CLEANUP);
+      ws.cleanupClients();
+      sendControlStateStale();
+    }
+#else
+    sendControlStateStale();
 #endif
-  checkRebootRequest();
-  // reset board to attempt to connect to wifi again if in ap mode or wifi dropped out and time limit passed
-  bool wifiConnected = WiFi.getMode() == WIFI_STA and WiFi.status() == WL_CONNECTED;
-  if (wifiConnected)
-  {
-    // ESP_LOGD(TAG, "Reset wifi connect timeout");
-    wifi_timeout = millis() + WIFI_RETRY_INTERVAL_MS;
-  }
-  else if (wifi_config and millis() > wifi_timeout)
-  {
-    ESP_LOGD(TAG, "Wifi connect timeout, restart device now");
-    ESP.restart();
-  }
-  // Sync HVAC UNIT even if mqtt not connected
-  if (!captive)
-  {
-#ifdef ESP8266
-    MDNS.update(); // ESP32 working without call this
+#ifdef ESP32
+    {
+      LOOP_STAGE(STAGE_HP_EVENTS);
+      hpDispatchEvents();
+    }
 #endif
-    checkHpUpdateRequest();
-    checkWifiScanRequest();
-    // Sync HVAC UNIT
-    if (!hp.isConnected())
+    schedRun(); // scheduled tasks time their own stage
+    if (!captive)
     {
-      // Use exponential backoff for retries, where each retry is double the length of the previous one.
-      unsigned long durationNextSync = (1 << hpConnectionRetries) * HP_RETRY_INTERVAL_MS;
-      if (((millis() - lastHpSync > durationNextSync) or lastHpSync == 0))
-      {
-        lastHpSync = millis();
-        // If we've retried more than the max number of tries, keep retrying at that fixed interval, which is several minutes.
-        hpConnectionRetries = min((uint32_t)(hpConnectionRetries + 1u), HP_MAX_RETRIES);
-        hpConnectionTotalRetries++;
-        hp.sync();
-      }
+#ifdef ESP8266
+      if (bootReached(BOOT_DEFERRED))
+        MDNS.update(); // ESP32 working without call this
+#endif
     }
     else
     {
-      hpConnectionRetries = 0;
-      hp.sync();
+      LOOP_STAGE(STAGE_DNS);
+      dnsServer.processNextRequest(); // for captivate portal
     }
-    // check mqtt status and retry
-    if (wifiConnected and (!mqtt_connected || !mqttClient->connected()) and millis() > mqtt_reconnect_timeout) // retry to connect mqtt
+#ifdef ESP8266
+    // Read HVAC UNIT packets, also in the captive portal after a wifi fallback. Connect retries run
+    // from hpSyncRetry, ESP32 do both in the HP task
+    if (hp[0].isConnected())
     {
-      mqtt_reconnect_timeout = millis() + MQTT_RECONNECT_INTERVAL_MS; // only retry next 5 seconds to prevent crash
-      if (mqttClient != nullptr)
-      {
-#ifdef ESP32
-        xTimerStart(mqttReconnectTimer, 0);
-#else
-        mqttConnect();
-#endif
-      }
+      LOOP_STAGE(STAGE_HP_SYNC);
+      hpPoll(0);
     }
-  }
-  else
-  {
-    dnsServer.processNextRequest(); // for captivate portal
-  }
-  if (!captive and mqtt_config)
-  {
-#ifdef ESP8266
-    if (mqttClient != nullptr)
+    if (!captive and mqtt_config and mqttClient != nullptr)
     {
+      LOOP_STAGE(STAGE_MQTT_LOOP);
       mqttClient->loop();
     }
+    heapMinFreeBytes = min(heapMinFreeBytes, ESP.getFreeHeap());
 #endif
-    if (wifiConnected && mqtt_connected)
-    {
-      sendKeepAlive();
-    }
   }
-  // delay(10);
+  // sleep until the next task is due, CPU and modem can power down meanwhile
+#ifdef ESP32
+  hpWaitEvents(schedIdleMs(LOOP_IDLE_MAX_MS)); // HP events wake loop() early
+#else
+  delay(schedIdleMs(LOOP_IDLE_MAX_MS));
+#endif
 }
 
-// Reboot in nextSeconds in the future
-void sendRebootRequest(unsigned long nextSeconds)
+#ifdef ESP8266
+// Sync HVAC UNIT even if mqtt not connected, connect retries back off with jitter and restart on UART activity
+void hpSyncRetry()
 {
-  requestReboot = true;
-  requestRebootTime = millis() + nextSeconds * 1000L;
-  ESP_LOGI(TAG, "Send Reboot Request");
+  if (hp[0].isConnected())
+  {
+    hpLinkConnected(0);
+    schedAt(TASK_HP_SYNC_RETRY, HP_RETRY_INTERVAL_MS, hpSyncRetry); // watch for lost connection
+    return;
+  }
+  if (hpLinkRetryNow(0, Serial.available() > 0))
+  {
+    hp[0].sync();
+    hpLinkRetried(0);
+  }
+  schedAt(TASK_HP_SYNC_RETRY, HP_LINK_CHECK_MS, hpSyncRetry);
 }
+#endif
 
-void checkRebootRequest()
+// reset board to attempt to connect to wifi again if in ap mode or wifi dropped out and time limit passed
+void wifiWatchdog()
 {
-  if (requestReboot and (millis() > requestRebootTime + REBOOT_REQUEST_INTERVAL_MS))
+  bool wifiConnected = WiFi.getMode() == WIFI_STA and WiFi.status() == WL_CONNECTED;
+  if (wifiConnected)
   {
-    requestReboot = false;
-    requestRebootTime = 0;
-    ESP_LOGI(TAG, "Restart device from request");
+    wifi_timeout = millis() + WIFI_RETRY_INTERVAL_MS;
+  }
+  else if (wifi_config and timeReached(wifi_timeout))
+  {
+    ESP_LOGD(TAG, "Wifi connect timeout, restart device now");
+    flushConfigSave();
     ESP.restart();
   }
 }
 
-void checkHpUpdateRequest()
+// check mqtt status and retry
+void mqttReconnect()
 {
-  if (requestHpUpdate and (millis() > requestHpUpdateTime))
+  LOOP_STAGE(STAGE_MQTT_RECONNECT);
+  bool wifiConnected = WiFi.getMode() == WIFI_STA and WiFi.status() == WL_CONNECTED;
+  if (mqttClient == nullptr || !wifiConnected || (mqtt_connected && mqttClient->connected()))
+  {
+    return;
+  }
+  if (millis() - lastMqttRetry >= MQTT_RECONNECT_INTERVAL_MS)
   {
-    requestHpUpdate = false;
-    requestHpUpdateTime = 0;
-    ESP_LOGI(TAG, "Update HP from request");
-    hp.update();
+    lastMqttRetry = millis(); // only retry next 10 seconds to prevent crash
+#ifdef ESP32
+    xTimerStart(mqttReconnectTimer, 0);
+#else
+    mqttConnect();
+#endif
   }
 }
 
-void checkWifiScanRequest()
+void keepAliveTask()
 {
-  if (requestWifiScan and (millis() > requestWifiScanTime))
-  {
-    requestWifiScan = false;
-    requestWifiScanTime = 0;
-    WiFi.scanNetworks(true);
-    lastWifiScanMillis = millis();
-  }
-  else
+  LOOP_STAGE(STAGE_KEEP_ALIVE);
+  if (mqtt_config and mqtt_connected)
   {
-    if (wifi_list.isEmpty() and millis() - lastWifiScanMillis > 2000) // waiting 2 seconds for data available
-    {
-      getWifiList();
-      getWifiOptions(true); // send data over web event
-    }
+    sendKeepAlive();
+    sendLoopStats();
+    sendTelemetry();
   }
 }
 
-#ifdef ESP32
-void WiFiEvent(WiFiEvent_t event)
+// Reboot in nextSeconds in the future
+void sendRebootRequest(unsigned long nextSeconds)
 {
-  ESP_LOGD(TAG, "[WiFi-event] event: %d\n", event);
-  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP || event == ARDUINO_EVENT_WIFI_STA_GOT_IP6)
-  {
-    ESP_LOGD(TAG, "WiFi connected, IP address: %s", WiFi.localIP().toString().c_str());
-    if (millis() > mqtt_reconnect_timeout)
-    {
-      mqtt_reconnect_timeout = millis() + MQTT_RECONNECT_INTERVAL_MS; // only retry next 5 seconds to prevent crash
-      ticker.detach();                                                // Stop blinking the LED because now we are connected:)
-      // keep LED off
+  requestReboot = true;
+  schedAt(TASK_REBOOT, nextSeconds * 1000L + REBOOT_REQUEST_INTERVAL_MS, onRebootRequest);
+  ESP_LOGI(TAG, "Send Reboot Request");
+}
+
+void onRebootRequest()
+{
+  requestReboot = false;
+  ESP_LOGI(TAG, "Restart device from request");
+  flushConfigSave();
+  ESP.restart();
+}
+
+// Apply saved config in CONFIG_APPLY_DELAY_MS, multiple requests are merged
+void sendConfigApplyRequest(uint8_t applyFlags)
+{
+  requestConfigApply |= applyFlags;
+  schedAt(TASK_CONFIG_APPLY, CONFIG_APPLY_DELAY_MS, onConfigApplyRequest);
+  ESP_LOGI(TAG, "Send Config Apply Request: %d", applyFlags);
+}
+
+void onConfigApplyRequest()
+{
+  uint8_t applyFlags = requestConfigApply;
+  requestConfigApply = 0;
+  flushConfigSave(); // apply reload config from files
+  if (applyFlags & APPLY_WIFI)
+    applyWifiConfig();
+  if ((applyFlags & APPLY_OTHERS) && applyOthersConfig())
+    applyFlags |= APPLY_MQTT; // HA discovery topic changed
+  if (applyFlags & APPLY_MQTT)
+    applyMqttConfig(); // republish discovery on connect, so unit change is covered
+  else if (applyFlags & APPLY_UNIT)
+    applyUnitConfig();
+}
+
+// Save changed config after CONFIG_SAVE_QUIET_MS without new changes, repeated toggles are written once
+void sendConfigSaveRequest(uint8_t saveFlags)
+{
+  requestConfigSave |= saveFlags;
+  schedAt(TASK_CONFIG_SAVE, CONFIG_SAVE_QUIET_MS, flushConfigSave);
+}
+
+void flushConfigSave()
+{
+  if (requestConfigSave & APPLY_OTHERS)
+  {
+    ESP_LOGI(TAG, "Save pending others config");
+    saveCurrentOthers(); // clear the flag
+  }
+  requestConfigSave = 0;
+  schedCancel(TASK_CONFIG_SAVE);
+}
+
+// Reconnect station with new wifi settings, loop() fallback to reboot if it does not come back
+void applyWifiConfig()
+{
+  String old_hostname = hostname;
+  loadWifi();
+  if (hostname.isEmpty())
+  {
+    hostname = hostnamePrefix;
+    hostname += getId();
+  }
+  ESP_LOGI(TAG, "Apply wifi config, ssid: %s", ap_ssid.c_str());
+  if (captive or ap_ssid.isEmpty())
+    return;
+  WiFi.disconnect();
+  configWifiStation();
+  wifi_timeout = millis() + WIFI_RETRY_INTERVAL_MS;
+  if (old_hostname != hostname && bootReached(BOOT_DEFERRED))
+  {
+    MDNS.end();
+    MDNS.begin(hostname);
+    MDNS.addService("http", "tcp", 80);
+  }
+}
+
+// Rebuild mqtt client and HA topics, onMqttConnect subscribe and send HA config again.
+// The client keep pointers to the server strings and to the will topic in the topic table, so it is
+// closed and deleted before loadMqtt() and initHaTopics() change them
+void applyMqttConfig()
+{
+  ESP_LOGI(TAG, "Apply MQTT config");
+  schedCancel(TASK_MQTT_RECONNECT);
+  if (!mqttClosing && mqttClient != nullptr && mqttClient->connected())
+  {
+    // a clean disconnect does not send the will, the client send the queued offline before it
+    mqttPublish(HaTopic(HA_TOPIC_AVAILABILITY).c_str(), 1, false, mqtt_payload_unavailable);
+    mqttClient->disconnect();
+  }
+  mqttClosing = true;
+  mqttClosingAt = millis();
+  schedAt(TASK_MQTT_CLOSE, 0, mqttCloseWait, MQTT_CLOSE_POLL_MS);
+}
+
+// Wait for the old client to close, then build the new one from the saved config
+void mqttCloseWait()
+{
+  if (mqttClient != nullptr && mqttClient->connected() && millis() - mqttClosingAt < MQTT_CLOSE_WAIT_MS)
+    return;
+  schedCancel(TASK_MQTT_CLOSE);
+  if (mqttClient != nullptr)
+  {
+    delete mqttClient; // close by force if the broker did not answer
+    mqttClient = nullptr;
+  }
+  mqttClosing = false;
+  mqtt_connected = false;
+  if (!loadMqtt() || !mqtt_config)
+    return;
+  initHaTopics();
+  initMqtt();
+  lastMqttRetry = millis() - MQTT_RECONNECT_INTERVAL_MS;
+  schedAt(TASK_MQTT_RECONNECT, 0, mqttReconnect, MQTT_RETRY_INTERVAL_MS); // connect on next loop
+}
+
+// Temperature unit, step, modes, language and login are read on use, only HA need to know
+void applyUnitConfig()
+{
+  ESP_LOGI(TAG, "Apply unit config");
+  tempFusionSubscribe(false);
+  loadUnit();
+  tempFusionSubscribe(true);
+  if (mqttClient != nullptr && mqttClient->connected())
+  {
+    sendHaConfig();
+    for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+    {
+      if (hpIsConnected(unit))
+        hpStatusChanged(unit, hpGetStatus(unit));
+    }
+  }
+}
+
+// Return true if the MQTT client must be rebuilt
+bool applyOthersConfig()
+{
+  ESP_LOGI(TAG, "Apply others config");
+  int old_tx = HP_TX;
+  int old_rx = HP_RX;
+  bool old_haa = others_haa;
+  String old_haa_topic = others_haa_topic;
+  bool old_web_started = webServerStarted;
+  loadOthers();
+  if (old_tx != HP_TX || old_rx != HP_RX)
+  {
+    // HP serial can not be moved at run time
+    ESP_LOGI(TAG, "UART pins changed, reboot");
+    sendRebootRequest(3);
+    return false;
+  }
+  // time zone is read on use, ntp server need to be set again
+  if (!captive)
+  {
+    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer.c_str());
+  }
+  applyWebPanel();
+  if (old_haa != others_haa || old_haa_topic != others_haa_topic)
+  {
+    // birth topic and discovery prefix changed, reconnect to resubscribe
+    return true;
+  }
+  if (old_web_started != webServerStarted && mqttClient != nullptr && mqttClient->connected())
+  {
+    // device configuration url depend on web panel
+    sendHaConfig();
+    sendDeviceInfo();
+  }
+  return false;
+}
+
+void onHpUpdateRequest(uint8_t unit)
+{
+  ESP_LOGI(TAG, "Update HP %u from request", unit + 1);
+  cmdTraceMark(unit, CMD_TRACE_SENT);
+  hp[unit].update();
+}
+
+static void hpPostCommand(const HpCommand &command)
+{
+#ifdef ESP32
+  if (hpCommandQueue == nullptr)
+    return; // captive portal, HP is not connected
+  if (xQueueSend(hpCommandQueue, &command, pdMS_TO_TICKS(HP_COMMAND_TIMEOUT_MS)) != pdTRUE)
+    ESP_LOGW(TAG, "HP command queue full, drop command %d", command.type);
+  else
+    xTaskNotifyGive(hpTaskHandle);
+#else
+  hpExecuteCommand(command);
+#endif
+}
+
+// Change a HP setting from any task, text is copied so it can be a temporary
+void hpSendCommand(uint8_t unit, HpCommandType type, const char *text, float value)
+{
+  HpCommand command;
+  command.type = type;
+  command.unit = unit;
+  command.length = 0;
+  command.value = value;
+  strlcpy(command.text, text != nullptr ? text : "", sizeof(command.text));
+  hpPostCommand(command);
+}
+
+void hpSendCustomPacket(uint8_t unit, const byte *packet, int length)
+{
+  HpCommand command;
+  command.type = HP_CMD_CUSTOM_PACKET;
+  command.unit = unit;
+  command.length = constrain(length, 0, (int)sizeof(command.text));
+  command.value = 0;
+  memcpy(command.text, packet, command.length);
+  hpPostCommand(command);
+}
+
+// Run a command on the HP object, from the HP task on ESP32
+void hpExecuteCommand(const HpCommand &command)
+{
+  uint8_t unit = command.unit;
+  if (unit >= HP_UNIT_MAX)
+    return;
+  HeatPump &unitHp = hp[unit];
+  hpPollBoost(unit);
+  switch (command.type)
+  {
+  case HP_CMD_POWER:
+    unitHp.setPowerSetting(command.text);
+    break;
+  case HP_CMD_MODE:
+    unitHp.setModeSetting(command.text);
+    break;
+  case HP_CMD_TEMPERATURE:
+    unitHp.setTemperature(command.value);
+    break;
+  case HP_CMD_FAN:
+    unitHp.setFanSpeed(command.text);
+    break;
+  case HP_CMD_VANE:
+    unitHp.setVaneSetting(command.text);
+    break;
+  case HP_CMD_WIDE_VANE:
+    unitHp.setWideVaneSetting(command.text);
+    break;
+  case HP_CMD_REMOTE_TEMP:
+    cmdTraceMark(unit, CMD_TRACE_SENT); // written at once, not through update()
+    unitHp.setRemoteTemperature(command.value);
+    break;
+  case HP_CMD_CUSTOM_PACKET:
+    unitHp.sendCustomPacket((byte *)command.text, command.length);
+    break;
+  case HP_CMD_UPDATE:
+    if (unitHp.getSettings() == unitHp.getWantedSettings()) // only update it settings change
+    {
+      ESP_LOGW(TAG, "Same Settings to HP, Igrore");
+    }
+    else
+    {
+      ESP_LOGI(TAG, "Send Settings to HP");
+      hpRequestUpdate(unit);
+    }
+    break;
+  }
+}
+
+// Send wanted settings in HP_UPDATE_DELAY_MS, settings arriving meanwhile go in the same update
+void hpRequestUpdate(uint8_t unit)
+{
+#ifdef ESP32
+  hpUpdatePending[unit] = true;
+  hpUpdateDue[unit] = millis() + HP_UPDATE_DELAY_MS;
+#else
+  schedAt(TASK_HP_UPDATE, HP_UPDATE_DELAY_MS, []() { onHpUpdateRequest(0); });
+#endif
+}
+
+// Read what the unit sent, send the next info request only when a poll is due
+void hpPoll(uint8_t unit)
+{
+#ifdef ESP32
+  bool received = hpSerial[unit]->available() > 0;
+#else
+  bool received = Serial.available() > 0;
+#endif
+  if (!received && !timeReached(hpPollDue[unit]))
+  {
+    int extType = hpExtSlotTake(unit, hpPollDue[unit]);
+    if (extType >= 0)
+      hp[unit].sync(extType); // idle slot between two core requests
+    return;
+  }
+  hp[unit].sync();
+  if (received)
+    return;
+  // sync sent a request, or the update when wanted settings differ
+  if (hpPollChanged[unit])
+  {
+    hpPollChanged[unit] = false;
+    hpPollIntervalMs[unit] = hpPollMinMs;
+  }
+  else
+  {
+    const char *power = hp[unit].getSettings().power;
+    bool powerOn = power != nullptr && strcmp(power, "ON") == 0;
+    hpPollIntervalMs[unit] = min(hpPollIntervalMs[unit] * 2, powerOn ? hpPollOnMaxMs : hpPollOffMaxMs);
+  }
+  hpPollDue[unit] = millis() + hpPollIntervalMs[unit];
+  hpExtSlotOpen(unit, hpPollIntervalMs[unit]);
+}
+
+// Poll fast again at once, after a command or a change made on the unit
+void hpPollBoost(uint8_t unit)
+{
+  hpPollChanged[unit] = true;
+  hpPollIntervalMs[unit] = hpPollMinMs;
+  hpPollDue[unit] = millis();
+}
+
+// Keep the fast rate while the compressor ramp, room temperature alone does not count
+void hpPollStatus(uint8_t unit, const heatpumpStatus &status)
+{
+  if (status.compressorFrequency != hpPollCompressorFrequency[unit] || status.operating != hpPollOperating[unit])
+  {
+    hpPollCompressorFrequency[unit] = status.compressorFrequency;
+    hpPollOperating[unit] = status.operating;
+    hpPollChanged[unit] = true;
+  }
+}
+
+heatpumpSettings hpGetSettings(uint8_t unit)
+{
+#ifdef ESP32
+  HP_STATE_LOCK();
+  heatpumpSettings settings = hpState[unit].settings;
+  HP_STATE_UNLOCK();
+  return settings;
+#else
+  return hp[unit].getSettings();
+#endif
+}
+
+heatpumpStatus hpGetStatus(uint8_t unit)
+{
+#ifdef ESP32
+  HP_STATE_LOCK();
+  heatpumpStatus status = hpState[unit].status;
+  HP_STATE_UNLOCK();
+  return status;
+#else
+  return hp[unit].getStatus();
+#endif
+}
+
+bool hpIsConnected(uint8_t unit)
+{
+#ifdef ESP32
+  return hpState[unit].connected;
+#else
+  return hp[unit].isConnected();
+#endif
+}
+
+// The unit has a UART, connected or not
+bool hpHasUart(uint8_t unit)
+{
+#ifdef ESP32
+  return hpSerial[unit] != nullptr;
+#else
+  return unit == 0;
+#endif
+}
+
+unsigned long hpGetLastWanted(uint8_t unit)
+{
+#ifdef ESP32
+  HP_STATE_LOCK();
+  unsigned long lastWanted = hpState[unit].lastWanted;
+  HP_STATE_UNLOCK();
+  return lastWanted;
+#else
+  return hp[unit].getLastWanted();
+#endif
+}
+
+#ifdef ESP32
+// Callbacks of a unit run in the HP task, they post events for loop()
+void hpTaskAttach(uint8_t unit)
+{
+  hp[unit].setSettingsChangedCallback([unit]() { hpTaskSettingsChanged(unit); });
+  hp[unit].setStatusChangedCallback([unit](heatpumpStatus currentStatus) { hpTaskStatusChanged(unit, currentStatus); });
+  hp[unit].setPacketCallback([unit](byte *packet, unsigned int length, const char *packetDirection) { hpTaskPacket(unit, packet, length, packetDirection); });
+  // Allow Remote/Panel
+  hp[unit].enableExternalUpdate();
+  hp[unit].enableAutoUpdate();
+}
+
+#ifdef HP_EXTRA_UNIT_PINS
+// Second unit on Serial2, third on Serial when the first unit does not use it
+void hpConnectExtraUnit(uint8_t unit)
+{
+  HardwareSerial *serial = unit == 1 ? &Serial2 : &Serial;
+  if (serial == hpSerial[0])
+  {
+    ESP_LOGE(TAG, "HP %u: UART used by the first unit, set its pins", unit + 1);
+    return;
+  }
+  int8_t rx = pgm_read_byte(&hpExtraUnitPins[unit - 1][0]);
+  int8_t tx = pgm_read_byte(&hpExtraUnitPins[unit - 1][1]);
+  if (serial == &Serial)
+    esp_log_level_set("*", ESP_LOG_NONE); // UART0 belong to the unit
+  hpTaskAttach(unit);
+  hpSerial[unit] = serial;
+  hp[unit].connect(serial, rx, tx);
+  hpLinkBegin(unit, rx);
+}
+#endif
+
+// The HP task own the CN105 links, web and TLS load in other tasks do not delay the serial
+void hpTaskStart()
+{
+  hpCommandQueue = xQueueCreate(HP_COMMAND_QUEUE_LEN, sizeof(HpCommand));
+  hpEventQueue = xQueueCreate(HP_EVENT_QUEUE_LEN, sizeof(HpEvent));
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+    hpPublishState(unit);
+  xTaskCreatePinnedToCore(hpTask, "hpTask", HP_TASK_STACK_SIZE, nullptr, HP_TASK_PRIORITY, &hpTaskHandle, HP_TASK_CORE);
+  // the UART driver event queue wake the task when the line go idle after a frame
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+  {
+    if (hpSerial[unit] == nullptr)
+      continue;
+    hpSerial[unit]->setRxTimeout(HP_RX_TIMEOUT_SYMBOLS);
+    hpSerial[unit]->onReceive([unit]() { hpSerialReceive(unit); }, true);
+  }
+}
+
+// Run in the UART event task
+void hpSerialReceive(uint8_t unit)
+{
+  hpRxFrameUs[unit] = micros() | 1; // 0 mean no frame waiting
+  xTaskNotifyGive(hpTaskHandle);
+}
+
+void hpTask(void *parameter)
+{
+  HpCommand command;
+  uint32_t waitMs = HP_TASK_IDLE_MS;
+  for (;;)
+  {
+    // received frames and commands wake the task at once, the timeout is for the next poll or retry of any unit
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+    LOOP_STAGE(STAGE_HP_SYNC);
+    waitMs = UINT32_MAX;
+    while (xQueueReceive(hpCommandQueue, &command, 0) == pdTRUE)
+    {
+      hpExecuteCommand(command);
+    }
+    for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+    {
+      if (hpSerial[unit] == nullptr)
+        continue;
+      uint32_t unitWaitMs = HP_TASK_IDLE_MS;
+      if (hp[unit].isConnected())
+      {
+        hpLinkConnected(unit);
+        hpPoll(unit);
+        if (hpSerial[unit]->available() > 0)
+          xTaskNotifyGive(hpTaskHandle); // sync read one packet, come back for the next one
+        else if (!hpUpdatePending[unit])
+          unitWaitMs = max((int32_t)(hpExtWakeAt(unit, hpPollDue[unit]) - millis()), (int32_t)1); // sleep until the next request
+      }
+      else if (hpLinkRetryNow(unit, hpSerial[unit]->available() > 0))
+      {
+        // received bytes wake the task, the line level is checked every HP_TASK_IDLE_MS
+        hp[unit].sync();
+        hpLinkRetried(unit);
+      }
+      if (hpUpdatePending[unit] && timeReached(hpUpdateDue[unit]))
+      {
+        hpUpdatePending[unit] = false;
+        onHpUpdateRequest(unit);
+      }
+      hpPublishState(unit);
+      waitMs = min(waitMs, unitWaitMs);
+    }
+  }
+}
+
+// Copy the HP state of a unit for the other tasks, HP task only
+void hpPublishState(uint8_t unit)
+{
+  HpState state;
+  state.settings = hp[unit].getSettings();
+  state.status = hp[unit].getStatus();
+  state.lastWanted = hp[unit].getLastWanted();
+  state.connected = hp[unit].isConnected();
+  HP_STATE_LOCK();
+  hpState[unit] = state;
+  HP_STATE_UNLOCK();
+}
+
+static void hpPostEvent(uint8_t unit, HpEventType type)
+{
+  HpEvent event;
+  event.type = type;
+  event.unit = unit;
+  xQueueSend(hpEventQueue, &event, 0); // if dropped, the next event still read the latest state
+}
+
+void hpTaskSettingsChanged(uint8_t unit)
+{
+  cmdTraceMark(unit, CMD_TRACE_SETTINGS);
+  hpPollBoost(unit);
+  hpPublishState(unit);
+  hpPostEvent(unit, HP_EVT_SETTINGS);
+}
+
+void hpTaskStatusChanged(uint8_t unit, heatpumpStatus currentStatus)
+{
+  bootMilestone(BOOT_HP_STATUS);
+  hpPollStatus(unit, currentStatus);
+  hpPublishState(unit);
+  hpPostEvent(unit, HP_EVT_STATUS);
+}
+
+void hpTaskPacket(uint8_t unit, byte *packet, unsigned int length, const char *packetDirection)
+{
+  uint32_t frameUs = hpRxFrameUs[unit];
+  if (frameUs != 0 && strcmp(packetDirection, "packetRecv") == 0)
+  {
+    hpRxFrameUs[unit] = 0;
+    hpFrameLatencyLastUs = micros() - frameUs;
+    hpFrameLatencyMaxUs = max(hpFrameLatencyMaxUs, hpFrameLatencyLastUs);
+    hpFrames.add();
+    hpFrameLatency.record(hpFrameLatencyLastUs);
+  }
+  hpPacketDebug(unit, packet, length, packetDirection);
+}
+
+// Sleep up to waitMs, return early when the HP task post an event
+void hpWaitEvents(uint32_t waitMs)
+{
+  HpEvent event;
+  if (hpEventQueue == nullptr)
+    delay(waitMs); // captive portal, no HP task
+  else
+    xQueuePeek(hpEventQueue, &event, pdMS_TO_TICKS(waitMs));
+}
+
+// Run HP callbacks in loop()
+void hpDispatchEvents()
+{
+  if (hpEventQueue == nullptr)
+    return;
+  HpEvent event;
+  while (xQueueReceive(hpEventQueue, &event, 0) == pdTRUE)
+  {
+    switch (event.type)
+    {
+    case HP_EVT_SETTINGS:
+      hpSettingsChanged(event.unit);
+      break;
+    case HP_EVT_STATUS:
+      hpStatusChanged(event.unit, hpGetStatus(event.unit));
+      break;
+    }
+  }
+}
+#endif
+
+void startWifiScan()
+{
+  LOOP_STAGE(STAGE_WIFI_SCAN);
+  WiFi.scanNetworks(true);
+  lastWifiScanMillis = millis();
+  schedAt(TASK_WIFI_SCAN, 2000, readWifiScan); // waiting 2 seconds for data available
+}
+
+void readWifiScan()
+{
+  LOOP_STAGE(STAGE_WIFI_SCAN);
+  if (WiFi.scanComplete() == WIFI_SCAN_RUNNING)
+  {
+    schedAt(TASK_WIFI_SCAN, 500, readWifiScan);
+    return;
+  }
+  getWifiList();
+  getWifiOptions(true); // send data over web event
+}
+
+#ifdef ESP32
+void WiFiEvent(WiFiEvent_t event)
+{
+  ESP_LOGD(TAG, "[WiFi-event] event: %d\n", event);
+  if (event == ARDUINO_EVENT_WIFI_AP_START)
+  {
+    WiFi.softAPConfig(apIP, apIP, netMsk);
+  }
+  else if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP || event == ARDUINO_EVENT_WIFI_STA_GOT_IP6)
+  {
+    ESP_LOGD(TAG, "WiFi connected, IP address: %s", WiFi.localIP().toString().c_str());
+    if (wifiState == WIFI_STATE_CONNECTING)
+      schedAt(TASK_WIFI_CONNECT, 0, onWifiReady);
+    if (millis() - lastMqttRetry >= MQTT_RECONNECT_INTERVAL_MS)
+    {
+      lastMqttRetry = millis(); // only retry next 10 seconds to prevent crash
+      ticker.detach();                                                // Stop blinking the LED because now we are connected:)
+      // keep LED off
       digitalWrite(blueLedPin, blueLedDisabled);
       xTimerStart(mqttReconnectTimer, 0); // start timer to connect to MQTT
       // init and get the time
@@ -3459,7 +5567,8 @@ void WiFiEvent(WiFiEvent_t event)
   else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED)
   {
     ESP_LOGD(TAG, "WiFi lost connection");
-    if (millis() > wifi_timeout)
+    wifiDisconnects.add();
+    if (timeReached(wifi_timeout))
     {
       ESP_LOGD(TAG, "Starting AP mode");
       xTimerStop(mqttReconnectTimer, 0);
@@ -3467,7 +5576,7 @@ void WiFiEvent(WiFiEvent_t event)
     }
     else
     { // retry connect
-      if (millis() > wifi_reconnect_timeout)
+      if (timeReached(wifi_reconnect_timeout))
       {
         wifi_reconnect_timeout = millis() + WIFI_RECONNECT_INTERVAL_MS; // only retry next 5 seconds to prevent crash
         xTimerStop(mqttReconnectTimer, 0);                              // ensure we don't reconnect to MQTT while reconnecting to Wi-Fi
@@ -3481,9 +5590,11 @@ void WiFiEvent(WiFiEvent_t event)
 void onWifiConnect(const WiFiEventStationModeGotIP &event)
 {
   ESP_LOGD(TAG, "WiFi connected, IP address: %s", WiFi.localIP().toString().c_str());
-  if (millis() > mqtt_reconnect_timeout)
+  if (wifiState == WIFI_STATE_CONNECTING)
+    schedAt(TASK_WIFI_CONNECT, 0, onWifiReady);
+  if (millis() - lastMqttRetry >= MQTT_RECONNECT_INTERVAL_MS)
   {
-    mqtt_reconnect_timeout = millis() + MQTT_RECONNECT_INTERVAL_MS; // only retry next 5 seconds to prevent crash
+    lastMqttRetry = millis(); // only retry next 10 seconds to prevent crash
     ticker.detach();                                                // Stop blinking the LED because now we are connected:)
     // keep LED off
     digitalWrite(blueLedPin, blueLedDisabled);
@@ -3496,6 +5607,7 @@ void onWifiConnect(const WiFiEventStationModeGotIP &event)
 void onWifiDisconnect(const WiFiEventStationModeDisconnected &event)
 {
   ESP_LOGD(TAG, "Disconnected from Wi-Fi.");
+  wifiDisconnects.add();
   // TODO crash on esp8266
   mqttReconnectTimer.detach(); // ensure we don't reconnect to MQTT while reconnecting to Wi-Fi
   // wifiReconnectTimer.once(2, connectWifi);
@@ -3507,28 +5619,40 @@ void onMqttConnect(bool sessionPresent)
 {
   ESP_LOGD(TAG, "Connected to MQTT. Session present: %d", sessionPresent);
   mqtt_connected = true;
+  mqttConnects.add();
+  if (!bootReached(BOOT_MQTT_READY))
+  {
+    bootMilestone(BOOT_MQTT_READY);
+    ESP_LOGI(TAG, "MQTT ready in %u ms", bootPhaseUs[BOOT_MQTT_READY] / 1000);
+  }
 
-  mqttClient->subscribe(ha_system_set_topic.c_str(), 1);
-  mqttClient->subscribe(ha_system_setting_request.c_str(), 1);
-  mqttClient->subscribe(ha_debug_pckts_set_topic.c_str(), 1);
-  mqttClient->subscribe(ha_debug_logs_set_topic.c_str(), 1);
-  mqttClient->subscribe(ha_mode_set_topic.c_str(), 1);
-  mqttClient->subscribe(ha_fan_set_topic.c_str(), 1);
-  mqttClient->subscribe(ha_temp_set_topic.c_str(), 1);
-  mqttClient->subscribe(ha_vane_set_topic.c_str(), 1);
-  mqttClient->subscribe(ha_wide_vane_set_topic.c_str(), 1);
-  mqttClient->subscribe(ha_remote_temp_set_topic.c_str(), 1);
-  mqttClient->subscribe(ha_custom_packet.c_str(), 1);
-  mqttClient->subscribe(ha_birth_topic.c_str(), 1);
+  mqttClient->subscribe(HaTopic(HA_TOPIC_SYSTEM_SET).c_str(), 1);
+  mqttClient->subscribe(HaTopic(HA_TOPIC_SYSTEM_SETTING_REQUEST).c_str(), 1);
+  mqttClient->subscribe(HaTopic(HA_TOPIC_DEBUG_PCKTS_SET).c_str(), 1);
+  mqttClient->subscribe(HaTopic(HA_TOPIC_DEBUG_LOGS_SET).c_str(), 1);
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+  {
+    mqttClient->subscribe(HaTopic(HA_TOPIC_MODE_SET, unit).c_str(), 1);
+    mqttClient->subscribe(HaTopic(HA_TOPIC_FAN_SET, unit).c_str(), 1);
+    mqttClient->subscribe(HaTopic(HA_TOPIC_TEMP_SET, unit).c_str(), 1);
+    mqttClient->subscribe(HaTopic(HA_TOPIC_VANE_SET, unit).c_str(), 1);
+    mqttClient->subscribe(HaTopic(HA_TOPIC_WIDE_VANE_SET, unit).c_str(), 1);
+    mqttClient->subscribe(HaTopic(HA_TOPIC_REMOTE_TEMP_SET, unit).c_str(), 1);
+    mqttClient->subscribe(HaTopic(HA_TOPIC_CUSTOM_PACKET, unit).c_str(), 1);
+  }
+  mqttClient->subscribe(HaTopic(HA_TOPIC_BIRTH).c_str(), 1);
+  tempFusionSubscribe(true);
   // send online message
-  mqttClient->publish(ha_availability_topic.c_str(), 1, false, mqtt_payload_available);
-  sendHaConfig();
+  mqttPublish(HaTopic(HA_TOPIC_AVAILABILITY).c_str(), 1, false, mqtt_payload_available);
+  if (bootReached(BOOT_DEFERRED))
+    sendHaConfig(); // else fast boot send it with the deferred work
 }
 
 void onMqttDisconnect(espMqttClientTypes::DisconnectReason reason)
 {
   mqtt_disconnect_reason = (uint8_t)reason;
   mqtt_connected = false;
+  mqttDisconnects.add();
   ESP_LOGE(TAG, "Disconnected from MQTT. reason: %d", (uint8_t)reason);
   bool wifiConnected = WiFi.getMode() == WIFI_STA and WiFi.status() == WL_CONNECTED;
   if (wifiConnected)
@@ -3566,19 +5690,73 @@ void onMqttPublish(uint16_t packetId)
   ESP_LOGD(TAG, "Publish acknowledged. packetId:  %d", packetId);
 }
 
+// Every publish go through here to be counted, packetId 0 when the client could not queue it
+uint16_t mqttPublish(const char *topic, uint8_t qos, bool retain, const char *payload)
+{
+  uint16_t packetId = mqttClient->publish(topic, qos, retain, payload);
+  mqttPublishes.add();
+  if (packetId == 0)
+    mqttPublishFailures.add();
+  return packetId;
+}
+
 // Handler webserver response
 #ifdef WEBSOCKET_ENABLE
+// Web socket commands, by the start of the text message
+struct WsCommand
+{
+  const char *prefix;
+  void (*handler)(AsyncWebSocketClient *client, char *message, size_t length);
+};
+
+static const WsCommand wsCommands[] = {
+    {"{", wsControlCommand},          // control page, see controlCommand()
+    {"language;", wsLanguageCommand}}; // unit page
+
+// language;N, the page reload in the new language
+void wsLanguageCommand(AsyncWebSocketClient *client, char *message, size_t length)
+{
+  int index = 0;
+  for (size_t pos = strlen("language;"); pos < length && isdigit(message[pos]); pos++)
+    index = index * 10 + (message[pos] - '0');
+  if (system_language_index != index)
+  {
+    client->text("REFRESH"); // refresh web page
+    system_language_index = index;
+    ESP_LOGE(TAG, "Set unit language id: %d\n", system_language_index);
+  }
+}
+
+void wsControlCommand(AsyncWebSocketClient *client, char *message, size_t length)
+{
+  controlCommand(message, length);
+}
+
 void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
 {
   if (type == WS_EVT_CONNECT)
   {
     ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] connect\n", server->url(), client->id());
-    client->printf("Hello Client %" PRIu32 " :)", client->id());
+    // the socket change settings, same login as the pages
+    if (login_password.length() > 0 && !is_authenticated((AsyncWebServerRequest *)arg))
+    {
+      client->close();
+      return;
+    }
+    if (!webClientAdd(WEB_CHANNEL_WS, client))
+    {
+      client->close(); // channel full, the page fall back to the forms
+      return;
+    }
+    if (hpIsConnected())
+      client->text(getControlState(hpGetSettings(), hpGetStatus())); // initial state of the control page
     client->ping();
   }
   else if (type == WS_EVT_DISCONNECT)
   {
     ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] disconnect\n", server->url(), client->id());
+    wsMessageRelease(client->id());
+    webClientRemove(WEB_CHANNEL_WS, client);
   }
   else if (type == WS_EVT_ERROR)
   {
@@ -3586,95 +5764,23 @@ void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventTyp
   }
   else if (type == WS_EVT_PONG)
   {
-    ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] pong[%zu]: %s\n", server->url(), client->id(), len, (len) ? (char *)data : "");
+    ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] pong[%zu]\n", server->url(), client->id(), len);
   }
   else if (type == WS_EVT_DATA)
   {
     AwsFrameInfo *info = (AwsFrameInfo *)arg;
-    String msg = "";
-    if (info->final && info->index == 0 && info->len == len)
-    {
-      // the whole message is in a single frame and we got all of it's data
-      ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] %s-message[%llu]: ", server->url(), client->id(), (info->opcode == WS_TEXT) ? "text" : "binary", info->len);
-
-      if (info->opcode == WS_TEXT)
-      {
-        for (size_t i = 0; i < info->len; i++)
-        {
-          msg += (char)data[i];
-        }
-      }
-      else
-      {
-        char buff[3];
-        for (size_t i = 0; i < info->len; i++)
-        {
-          sprintf(buff, "%02x", (uint8_t)data[i]);
-          msg += buff;
-        }
-      }
-      ESP_LOGD(TAG, "%s\n", msg.c_str());
-      if (info->opcode == WS_TEXT)
-      {
-        String command = getValueBySeparator(msg, ';', 0);
-        if (command == "language")
-        {
-          String data = getValueBySeparator(msg, ';', 1);
-          if (system_language_index != data.toInt())
-          {
-            client->text("REFRESH"); // refresh web page
-            system_language_index = data.toInt();
-            ESP_LOGE(TAG, "Set unit language id: %d\n", system_language_index);
-          }
-        }
-        // client->text("I got your text message"); // may crash on Safari
-      }
-      else
-      {
-        client->binary("I got your binary message");
-      }
-    }
-    else
+    size_t length;
+    char *message = wsMessageFeed(client->id(), info, data, len, length); // in place or reassembled
+    if (message == nullptr || info->message_opcode != WS_TEXT) // no binary command
+      return;
+    ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] text-message[%zu]: %.*s\n", server->url(), client->id(), length, (int)length, message);
+    for (const WsCommand &command : wsCommands)
     {
-      // message is comprised of multiple frames or the frame is split into multiple packets
-      if (info->index == 0)
-      {
-        if (info->num == 0)
-          ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] %s-message start\n", server->url(), client->id(), (info->message_opcode == WS_TEXT) ? "text" : "binary");
-        ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] frame[%lu] start[%llu]\n", server->url(), client->id(), info->num, info->len);
-      }
-
-      ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] frame[%lu] %s[%llu - %llu]: ", server->url(), client->id(), info->num, (info->message_opcode == WS_TEXT) ? "text" : "binary", info->index, info->index + len);
-
-      if (info->opcode == WS_TEXT)
+      size_t prefix = strlen(command.prefix);
+      if (length >= prefix && memcmp(message, command.prefix, prefix) == 0)
       {
-        for (size_t i = 0; i < len; i++)
-        {
-          msg += (char)data[i];
-        }
-      }
-      else
-      {
-        char buff[3];
-        for (size_t i = 0; i < len; i++)
-        {
-          sprintf(buff, "%02x", (uint8_t)data[i]);
-          msg += buff;
-        }
-      }
-      ESP_LOGD(TAG, "%s\n", msg.c_str());
-
-      if ((info->index + len) == info->len)
-      {
-        ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] frame[%lu] end[%llu]\n", server->url(), client->id(), info->num, info->len);
-        if (info->final)
-        {
-          ESP_LOGD(TAG, "ws[%s][%" PRIu32 "] %s-message end\n", server->url(), client->id(), (info->message_opcode == WS_TEXT) ? "text" : "binary");
-          // if(info->message_opcode == WS_TEXT)
-          //   client->text("I got your text message");
-          // else
-          //   client->binary("I got your binary message");
-        }
+        command.handler(client, message, length);
+        break;
       }
     }
   }
@@ -3804,6 +5910,24 @@ uint32_t getFreeHeapBytes()
 return freeHeapBytes;
 }
 
+uint32_t getMinFreeHeapBytes()
+{
+#ifdef ESP32
+  return heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+#else
+  return heapMinFreeBytes; // no low mark in the SDK, sampled by loop()
+#endif
+}
+
+uint32_t getLargestFreeBlockBytes()
+{
+#ifdef ESP32
+  return heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+#else
+  return ESP.getMaxFreeBlockSize();
+#endif
+}
+
 uint32_t getTotalHeapBytes()
 {
 #ifdef ESP32
@@ -3815,14 +5939,20 @@ uint32_t getTotalHeapBytes()
 return totalHeapBytes;
 }
 
+// eFuse state does not change while running, read it once
 bool isSecureEnable()
 {
 #ifdef ESP32
-  bool flashEncrypt = esp_flash_encryption_enabled();
-  bool secureBoot = esp_secure_boot_enabled();
-  ESP_LOGW(TAG, "Flash encryption:  %s", flashEncrypt ? "YES" : "NO");
-  ESP_LOGW(TAG, "Secure boot:  %s", secureBoot ? "YES" : "NO");
-  return flashEncrypt && secureBoot;
+  static int8_t secure = -1;
+  if (secure < 0)
+  {
+    bool flashEncrypt = esp_flash_encryption_enabled();
+    bool secureBoot = esp_secure_boot_enabled();
+    ESP_LOGW(TAG, "Flash encryption:  %s", flashEncrypt ? "YES" : "NO");
+    ESP_LOGW(TAG, "Secure boot:  %s", secureBoot ? "YES" : "NO");
+    secure = flashEncrypt && secureBoot;
+  }
+  return secure;
 #endif
   return false;
 }
@@ -3929,7 +6059,7 @@ String getWifiOptions(bool send)
     }
     if (send)
     {
-      events.send(wifiOptions.c_str(), "wifiOptions", millis(), 20); // send wifi data to browser
+      webClientsSend(WEB_CHANNEL_EVENTS, wifiOptions.c_str(), "wifiOptions", millis()); // send wifi data to browser
     }
   }
   return wifiOptions;
@@ -3956,6 +6086,7 @@ String getValueBySeparator(const String& data, char separator, int index)
 
 void factoryReset()
 {
+  requestConfigSave = 0; // do not write config back before reboot
   SPIFFS.format();
   WiFi.disconnect(true, true);
 #ifdef ESP32
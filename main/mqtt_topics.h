@@ -0,0 +1,180 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// MQTT topics without one heap String per topic: the prefixes are kept once in a fixed
+// arena and a full topic is composed on the stack from the suffix table when needed.
+// Arena layout: "<mqtt_topic>/<mqtt_fn>\0<discovery prefix>\0<availability topic>\0"
+// Extra units have their set and state topics under "<mqtt_topic>/<mqtt_fn>/unitN", N from 2.
+
+#define HA_TOPIC_MAX_LEN 192    // composed topic buffer
+#define HA_TOPIC_PREFIX_MAX 64  // mqtt_topic, mqtt_fn and the discovery prefix, cut to it by saveMqtt() and saveOthers()
+#define HA_TOPIC_ARENA_SIZE 384
+
+enum HaTopicId : uint8_t
+{
+  HA_TOPIC_POWER_SET,
+  HA_TOPIC_MODE_SET,
+  HA_TOPIC_TEMP_SET,
+  HA_TOPIC_REMOTE_TEMP_SET,
+  HA_TOPIC_FAN_SET,
+  HA_TOPIC_VANE_SET,
+  HA_TOPIC_WIDE_VANE_SET,
+  HA_TOPIC_DEBUG_PCKTS,
+  HA_TOPIC_DEBUG_PCKTS_SET,
+  HA_TOPIC_DEBUG_LOGS,
+  HA_TOPIC_DEBUG_LOGS_SET,
+  HA_TOPIC_STATE,
+  HA_TOPIC_SYSTEM_INFO,            // device info and setting state
+  HA_TOPIC_SYSTEM_SET,             // for control over mqtt
+  HA_TOPIC_SYSTEM_SETTING_REQUEST, // for control over mqtt
+  HA_TOPIC_SYSTEM_SETTING_RESPOND, // for control over mqtt
+  HA_TOPIC_CUSTOM_PACKET,
+  HA_TOPIC_DIAGNOSTICS, // loop timing and stalls
+  HA_TOPIC_CMD_LATENCY, // set command traces
+  HA_TOPIC_DEBUG_REMOTE_TEMP, // fused remote temperature and its sources
+  HA_TOPIC_DEBUG_TELEMETRY,   // telemetry registry
+  HA_TOPIC_AVAILABILITY,
+  HA_TOPIC_BIRTH, // under discovery prefix, all other under main prefix
+  HA_TOPIC_COUNT
+};
+
+static const char *const haTopicSuffix[HA_TOPIC_COUNT] = {
+    /* HA_TOPIC_POWER_SET */ "/power/set",
+    /* HA_TOPIC_MODE_SET */ "/mode/set",
+    /* HA_TOPIC_TEMP_SET */ "/temp/set",
+    /* HA_TOPIC_REMOTE_TEMP_SET */ "/remote_temp/set",
+    /* HA_TOPIC_FAN_SET */ "/fan/set",
+    /* HA_TOPIC_VANE_SET */ "/vane/set",
+    /* HA_TOPIC_WIDE_VANE_SET */ "/wide-vane/set",
+    /* HA_TOPIC_DEBUG_PCKTS */ "/debug/packets",
+    /* HA_TOPIC_DEBUG_PCKTS_SET */ "/debug/packets/set",
+    /* HA_TOPIC_DEBUG_LOGS */ "/debug/logs",
+    /* HA_TOPIC_DEBUG_LOGS_SET */ "/debug/logs/set",
+    /* HA_TOPIC_STATE */ "/state",
+    /* HA_TOPIC_SYSTEM_INFO */ "/system/info",
+    /* HA_TOPIC_SYSTEM_SET */ "/system/set",
+    /* HA_TOPIC_SYSTEM_SETTING_REQUEST */ "/system/opt/rqt",
+    /* HA_TOPIC_SYSTEM_SETTING_RESPOND */ "/system/opt/rps",
+    /* HA_TOPIC_CUSTOM_PACKET */ "/custom/send",
+    /* HA_TOPIC_DIAGNOSTICS */ "/debug/loop",
+    /* HA_TOPIC_CMD_LATENCY */ "/debug/latency",
+    /* HA_TOPIC_DEBUG_REMOTE_TEMP */ "/debug/remote_temp",
+    /* HA_TOPIC_DEBUG_TELEMETRY */ "/debug/telemetry",
+    /* HA_TOPIC_AVAILABILITY */ "/availability",
+    /* HA_TOPIC_BIRTH */ "/status"};
+
+// Topics with one namespace per unit, the others belong to the device
+static bool haTopicPerUnit(uint8_t id)
+{
+  return id <= HA_TOPIC_WIDE_VANE_SET || id == HA_TOPIC_STATE || id == HA_TOPIC_CUSTOM_PACKET;
+}
+
+char haTopicArena[HA_TOPIC_ARENA_SIZE];
+uint16_t haTopicMainLen = 0;
+uint16_t haTopicDiscoveryOffset = 0;
+uint16_t haTopicDiscoveryLen = 0;
+uint16_t haTopicWillOffset = 0;
+
+// Append str to the arena at pos, return the position after its terminator or 0 if it does not fit
+static uint16_t haTopicArenaPut(uint16_t pos, const char *str, const char *suffix = "")
+{
+  size_t len = strlen(str);
+  size_t suffix_len = strlen(suffix);
+  if (pos + len + suffix_len + 1 > HA_TOPIC_ARENA_SIZE)
+    return 0;
+  memcpy(haTopicArena + pos, str, len);
+  memcpy(haTopicArena + pos + len, suffix, suffix_len + 1);
+  return pos + len + suffix_len + 1;
+}
+
+// Return false if the prefixes are too long, the topics are empty then
+bool haTopicsInit(const char *main_prefix, const char *discovery_prefix)
+{
+  uint16_t pos = haTopicArenaPut(0, main_prefix);
+  uint16_t discovery_pos = pos ? haTopicArenaPut(pos, discovery_prefix) : 0;
+  uint16_t end = discovery_pos ? haTopicArenaPut(discovery_pos, main_prefix, haTopicSuffix[HA_TOPIC_AVAILABILITY]) : 0;
+  if (end == 0 || pos > HA_TOPIC_MAX_LEN - 32)
+  {
+    memset(haTopicArena, 0, 3);
+    haTopicMainLen = 0;
+    haTopicDiscoveryOffset = 1;
+    haTopicDiscoveryLen = 0;
+    haTopicWillOffset = 2;
+    return false;
+  }
+  haTopicMainLen = pos - 1;
+  haTopicDiscoveryOffset = pos;
+  haTopicDiscoveryLen = discovery_pos - pos - 1;
+  haTopicWillOffset = discovery_pos;
+  return true;
+}
+
+// Availability topic stay in the arena, the MQTT client keep the will topic pointer
+const char *haTopicWill()
+{
+  return haTopicArena + haTopicWillOffset;
+}
+
+// Return HA_TOPIC_COUNT if topic is not one of ours, unit is set for per unit topics
+HaTopicId haTopicMatch(const char *topic, uint8_t &unit)
+{
+  unit = 0;
+  if (haTopicMainLen == 0) // haTopicsInit() failed, an empty prefix would match any topic
+    return HA_TOPIC_COUNT;
+  if (strncmp(topic, haTopicArena, haTopicMainLen) == 0)
+  {
+    const char *suffix = topic + haTopicMainLen;
+    if (strncmp(suffix, "/unit", 5) == 0 && suffix[5] >= '2' && suffix[5] < '1' + HP_UNIT_MAX)
+    {
+      unit = suffix[5] - '1';
+      suffix += 6;
+    }
+    for (uint8_t id = 0; id < HA_TOPIC_BIRTH; id++)
+    {
+      if ((unit == 0 || haTopicPerUnit(id)) && strcmp(suffix, haTopicSuffix[id]) == 0)
+        return (HaTopicId)id;
+    }
+  }
+  if (strncmp(topic, haTopicArena + haTopicDiscoveryOffset, haTopicDiscoveryLen) == 0 &&
+      strcmp(topic + haTopicDiscoveryLen, haTopicSuffix[HA_TOPIC_BIRTH]) == 0)
+    return HA_TOPIC_BIRTH;
+  return HA_TOPIC_COUNT;
+}
+
+// Full topic composed on the stack. Use c_str() for MQTT calls, assign buf to JSON so it is copied
+struct HaTopic
+{
+  char buf[HA_TOPIC_MAX_LEN];
+
+  explicit HaTopic(HaTopicId id, uint8_t unit = 0)
+  {
+    const char *prefix = (id == HA_TOPIC_BIRTH) ? haTopicArena + haTopicDiscoveryOffset : haTopicArena;
+    if (unit > 0 && haTopicPerUnit(id))
+      snprintf(buf, sizeof(buf), "%s/unit%u%s", prefix, unit + 1, haTopicSuffix[id]);
+    else
+      snprintf(buf, sizeof(buf), "%s%s", prefix, haTopicSuffix[id]);
+  }
+
+  // HA discovery config topic: <discovery prefix>/<entity_type>/<node_id>/[<entity_tag>/]config
+  HaTopic(const char *entity_type, const char *node_id, const char *entity_tag)
+  {
+    if (entity_tag != nullptr && entity_tag[0] != '\0')
+      snprintf(buf, sizeof(buf), "%s/%s/%s/%s/config", haTopicArena + haTopicDiscoveryOffset, entity_type, node_id, entity_tag);
+    else
+      snprintf(buf, sizeof(buf), "%s/%s/%s/config", haTopicArena + haTopicDiscoveryOffset, entity_type, node_id);
+  }
+
+  const char *c_str() const { return buf; }
+};
@@ -0,0 +1,119 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Packet debug log: raw CN105 packets go in a fixed ring from the packet callback, without heap.
+// The drain hex encode up to PACKET_LOG_BATCH of them into one static buffer per MQTT message, and
+// send batches until the ring is empty or PACKET_LOG_OUTBOX messages wait in the MQTT outbox.
+// When the ring is full the oldest packet is dropped and counted. Packets of extra units carry their unit.
+// Bytes are written like String(byte, HEX) did before the ring, without leading zero.
+
+#ifdef ESP32
+#define PACKET_LOG_SIZE 64
+#else
+#define PACKET_LOG_SIZE 32
+#endif
+#define PACKET_LOG_BATCH 8
+#define PACKET_LOG_OUTBOX 4 // outbox messages of any kind, the drain wait above it
+// {"dropped":4294967295,"packets":[ + per packet {"ms":4294967295,"unit":3,"packetRecv":"<3 chars per byte>"}, + ]}
+#define PACKET_LOG_TEXT_SIZE (48 + PACKET_LOG_BATCH * (45 + 3 * HP_PACKET_MAX_LEN))
+
+struct PacketLogEntry
+{
+  uint32_t ms;
+  uint8_t unit;
+  bool sent;
+  uint8_t length;
+  byte data[HP_PACKET_MAX_LEN];
+};
+
+PacketLogEntry packetLog[PACKET_LOG_SIZE];
+uint16_t packetLogHead = 0; // next write
+uint16_t packetLogCount = 0;
+uint32_t packetLogDropped = 0;
+#ifdef ESP32
+portMUX_TYPE packetLogMux = portMUX_INITIALIZER_UNLOCKED; // written from the HP task
+#define PACKET_LOG_LOCK() portENTER_CRITICAL(&packetLogMux)
+#define PACKET_LOG_UNLOCK() portEXIT_CRITICAL(&packetLogMux)
+#else
+#define PACKET_LOG_LOCK()
+#define PACKET_LOG_UNLOCK()
+#endif
+
+static const char packetLogHex[] = "0123456789abcdef";
+
+void packetLogAdd(uint8_t unit, const byte *packet, unsigned int length, bool sent)
+{
+  PACKET_LOG_LOCK();
+  PacketLogEntry &entry = packetLog[packetLogHead];
+  entry.ms = millis();
+  entry.unit = unit;
+  entry.sent = sent;
+  entry.length = min(length, (unsigned int)HP_PACKET_MAX_LEN);
+  memcpy(entry.data, packet, entry.length);
+  packetLogHead = (packetLogHead + 1) % PACKET_LOG_SIZE;
+  if (packetLogCount < PACKET_LOG_SIZE)
+    packetLogCount++;
+  else
+    packetLogDropped++;
+  PACKET_LOG_UNLOCK();
+}
+
+bool packetLogPending()
+{
+  return packetLogCount > 0;
+}
+
+// Take the oldest packet, false when the ring is empty
+bool packetLogTake(PacketLogEntry &entry)
+{
+  bool taken = false;
+  PACKET_LOG_LOCK();
+  if (packetLogCount > 0)
+  {
+    entry = packetLog[(packetLogHead + PACKET_LOG_SIZE - packetLogCount) % PACKET_LOG_SIZE];
+    packetLogCount--;
+    taken = true;
+  }
+  PACKET_LOG_UNLOCK();
+  return taken;
+}
+
+// Write the next batch as JSON into text, return its length or 0 when there is nothing to send
+size_t packetLogFormat(char *text, size_t size)
+{
+  PacketLogEntry entry;
+  uint8_t taken = 0;
+  size_t pos = snprintf(text, size, "{\"dropped\":%lu,\"packets\":[", (unsigned long)packetLogDropped);
+  while (taken < PACKET_LOG_BATCH && packetLogTake(entry))
+  {
+    pos += snprintf(text + pos, size - pos, "%s{\"ms\":%lu,", taken ? "," : "", (unsigned long)entry.ms);
+    if (entry.unit > 0)
+      pos += snprintf(text + pos, size - pos, "\"unit\":%u,", entry.unit + 1);
+    pos += snprintf(text + pos, size - pos, "\"%s\":\"", entry.sent ? "packetSent" : "packetRecv");
+    for (uint8_t idx = 0; idx < entry.length; idx++)
+    {
+      if (entry.data[idx] >> 4)
+        text[pos++] = packetLogHex[entry.data[idx] >> 4];
+      text[pos++] = packetLogHex[entry.data[idx] & 0x0f];
+      text[pos++] = ' ';
+    }
+    pos += snprintf(text + pos, size - pos, "\"}");
+    taken++;
+  }
+  if (taken == 0)
+    return 0;
+  pos += snprintf(text + pos, size - pos, "]}");
+  return pos;
+}
@@ -0,0 +1,213 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Remote temperature toward the unit, per unit. Readings go through an EMA or a median of the last
+// REMOTE_TEMP_MEDIAN_SIZE, the filtered value is written only when it moved by the deadband from the
+// last value written, and at most once per remoteTempIntervalS. A held value is written when the
+// interval end, unless the readings came back inside the deadband. A steady value is written again
+// once REMOTE_TEMP_MAX_AGE_MS old so the unit keep it. A unit without readings for
+// CHECK_REMOTE_TEMP_INTERVAL_MS go back to its own sensor.
+
+#define REMOTE_TEMP_MEDIAN_SIZE 5
+#define REMOTE_TEMP_EMA_ALPHA 0.3f // weight of a new reading
+#define REMOTE_TEMP_MAX_AGE_MS 120000 // resend inside the deadband, below CHECK_REMOTE_TEMP_INTERVAL_MS
+
+enum RemoteTempFilter : uint8_t
+{
+  REMOTE_TEMP_FILTER_NONE,
+  REMOTE_TEMP_FILTER_EMA,
+  REMOTE_TEMP_FILTER_MEDIAN,
+  REMOTE_TEMP_FILTER_COUNT
+};
+
+static const char *const remoteTempFilterName[REMOTE_TEMP_FILTER_COUNT] = {
+    /* REMOTE_TEMP_FILTER_NONE */ "none",
+    /* REMOTE_TEMP_FILTER_EMA */ "ema",
+    /* REMOTE_TEMP_FILTER_MEDIAN */ "median"};
+
+struct RemoteTemp
+{
+  bool active;         // readings received, the unit use them
+  uint32_t receivedAt; // last reading
+  float samples[REMOTE_TEMP_MEDIAN_SIZE];
+  uint8_t count;
+  uint8_t next;
+  float ema;
+  float filtered;
+  bool written; // a value was written since the readings started
+  float writtenValue;
+  uint32_t writtenAt;
+  bool held; // filtered value out of the deadband, waiting for the interval
+};
+
+// unit config, see loadUnit()
+RemoteTempFilter remoteTempFilter = REMOTE_TEMP_FILTER_EMA;
+float remoteTempDeadband = 0.2;   // °C
+uint32_t remoteTempIntervalS = 60; // min time between two writes
+
+RemoteTemp remoteTemp[HP_UNIT_MAX];
+TelemetryCounterSet<HP_UNIT_MAX> remoteTempWrites("remote_temp_writes_total", "Remote temperature packets written to the unit",
+                                                   "unit", hpUnitLabel, hpHasUart);
+TelemetryCounterSet<HP_UNIT_MAX> remoteTempDeadbandSkips("remote_temp_deadband_skips_total", "Remote temperature readings not written, inside the deadband",
+                                                         "unit", hpUnitLabel, hpHasUart);
+TelemetryCounterSet<HP_UNIT_MAX> remoteTempRateSkips("remote_temp_rate_skips_total", "Remote temperature readings not written at once, held by the interval",
+                                                     "unit", hpUnitLabel, hpHasUart);
+#ifdef ESP32
+portMUX_TYPE remoteTempMux = portMUX_INITIALIZER_UNLOCKED; // MQTT callback and loop() timer
+#define REMOTE_TEMP_LOCK() portENTER_CRITICAL(&remoteTempMux)
+#define REMOTE_TEMP_UNLOCK() portEXIT_CRITICAL(&remoteTempMux)
+#else
+#define REMOTE_TEMP_LOCK()
+#define REMOTE_TEMP_UNLOCK()
+#endif
+
+RemoteTempFilter remoteTempFilterFromName(const String &name)
+{
+  for (uint8_t filter = 0; filter < REMOTE_TEMP_FILTER_COUNT; filter++)
+    if (name == remoteTempFilterName[filter])
+      return (RemoteTempFilter)filter;
+  return REMOTE_TEMP_FILTER_EMA;
+}
+
+static float remoteTempMedian(const RemoteTemp &state)
+{
+  float sorted[REMOTE_TEMP_MEDIAN_SIZE];
+  memcpy(sorted, state.samples, sizeof(sorted));
+  telemetrySort(sorted, state.count);
+  return state.count % 2 ? sorted[state.count / 2] : (sorted[state.count / 2 - 1] + sorted[state.count / 2]) / 2;
+}
+
+// Write decision of the filtered value, with the lock held
+static bool remoteTempDue(uint8_t unit)
+{
+  RemoteTemp &state = remoteTemp[unit];
+  if (state.written && fabsf(state.filtered - state.writtenValue) < remoteTempDeadband &&
+      millis() - state.writtenAt < REMOTE_TEMP_MAX_AGE_MS)
+  {
+    state.held = false;
+    remoteTempDeadbandSkips.add(unit);
+    return false;
+  }
+  if (state.written && millis() - state.writtenAt < remoteTempIntervalS * 1000)
+  {
+    state.held = true;
+    remoteTempRateSkips.add(unit);
+    return false;
+  }
+  state.held = false;
+  state.written = true;
+  state.writtenValue = state.filtered;
+  state.writtenAt = millis();
+  remoteTempWrites.add(unit);
+  return true;
+}
+
+// A reading in °C from MQTT. True with the value to write to the unit now
+bool remoteTempReading(uint8_t unit, float celsius, float &value)
+{
+  REMOTE_TEMP_LOCK();
+  RemoteTemp &state = remoteTemp[unit];
+  if (!state.active)
+  {
+    state.count = 0;
+    state.next = 0;
+    state.ema = celsius;
+    state.written = false;
+  }
+  state.active = true;
+  state.receivedAt = millis();
+  state.samples[state.next] = celsius;
+  state.next = (state.next + 1) % REMOTE_TEMP_MEDIAN_SIZE;
+  state.count = min(state.count + 1, REMOTE_TEMP_MEDIAN_SIZE);
+  state.ema += REMOTE_TEMP_EMA_ALPHA * (celsius - state.ema);
+  switch (remoteTempFilter)
+  {
+  case REMOTE_TEMP_FILTER_EMA:
+    state.filtered = state.ema;
+    break;
+  case REMOTE_TEMP_FILTER_MEDIAN:
+    state.filtered = remoteTempMedian(state);
+    break;
+  default:
+    state.filtered = celsius;
+    break;
+  }
+  bool due = remoteTempDue(unit);
+  value = state.filtered;
+  REMOTE_TEMP_UNLOCK();
+  return due;
+}
+
+// The fused source of the unit still has fresh readings, do not revert to the unit sensor
+void remoteTempTouch(uint8_t unit)
+{
+  REMOTE_TEMP_LOCK();
+  if (remoteTemp[unit].active)
+    remoteTemp[unit].receivedAt = millis();
+  REMOTE_TEMP_UNLOCK();
+}
+
+// Readings stopped, by MQTT or staleness, the unit go back to its own sensor
+void remoteTempStop(uint8_t unit)
+{
+  REMOTE_TEMP_LOCK();
+  remoteTemp[unit].active = false;
+  remoteTemp[unit].held = false;
+  REMOTE_TEMP_UNLOCK();
+}
+
+// Timer side of a unit: stale is set when the readings stopped, the return is true with the held value
+// to write now. nextMs get the time to the next expiry or held write of this unit
+bool remoteTempCheck(uint8_t unit, bool &stale, float &value, uint32_t &nextMs)
+{
+  bool due = false;
+  stale = false;
+  REMOTE_TEMP_LOCK();
+  RemoteTemp &state = remoteTemp[unit];
+  if (state.active)
+  {
+    uint32_t age = millis() - state.receivedAt;
+    if (age >= CHECK_REMOTE_TEMP_INTERVAL_MS)
+    {
+      state.active = false;
+      state.held = false;
+      stale = true;
+    }
+    else
+    {
+      nextMs = min(nextMs, CHECK_REMOTE_TEMP_INTERVAL_MS - age);
+      if (state.held)
+      {
+        uint32_t waited = millis() - state.writtenAt;
+        if (waited >= remoteTempIntervalS * 1000)
+        {
+          state.held = false;
+          state.written = true;
+          state.writtenValue = state.filtered;
+          state.writtenAt = millis();
+          remoteTempWrites.add(unit);
+          value = state.filtered;
+          due = true;
+        }
+        else
+        {
+          nextMs = min(nextMs, remoteTempIntervalS * 1000 - waited);
+        }
+      }
+    }
+  }
+  REMOTE_TEMP_UNLOCK();
+  return due;
+}
@@ -0,0 +1,133 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Cooperative scheduler for loop(). Every kind of deferred work has one fixed slot, arming a slot
+// again replaces its deadline, so repeated requests are merged like the old request flags.
+// With a dozen slots a linear scan is cheaper than timer wheel buckets.
+// Deadlines are compared by signed difference, so they stay correct when millis() roll over.
+
+enum SchedTaskId : uint8_t
+{
+  TASK_REBOOT,
+  TASK_CONFIG_APPLY,
+  TASK_CONFIG_SAVE,
+  TASK_HP_UPDATE,
+  TASK_HP_SYNC_RETRY,
+  TASK_REMOTE_TEMP_CHECK,
+  TASK_TEMP_FUSION,
+  TASK_WIFI_SCAN,
+  TASK_WIFI_CONNECT,
+  TASK_BOOT_DEFERRED,
+  TASK_WIFI_WATCHDOG,
+  TASK_MQTT_RECONNECT,
+  TASK_MQTT_CLOSE,
+  TASK_KEEP_ALIVE,
+  TASK_PACKET_LOG,
+  TASK_COUNT
+};
+
+typedef void (*SchedCallback)();
+
+struct SchedTask
+{
+  SchedCallback callback;
+  uint32_t due;
+  uint32_t period; // 0 for one-shot
+  bool active;
+};
+
+SchedTask schedTasks[TASK_COUNT];
+#ifdef ESP32
+portMUX_TYPE schedMux = portMUX_INITIALIZER_UNLOCKED; // web and wifi callbacks run in other tasks
+#define SCHED_LOCK() portENTER_CRITICAL(&schedMux)
+#define SCHED_UNLOCK() portEXIT_CRITICAL(&schedMux)
+#else
+#define SCHED_LOCK()
+#define SCHED_UNLOCK()
+#endif
+
+// True when deadline is now or passed, deadline must be less than 24 days away
+inline bool timeReached(uint32_t deadline)
+{
+  return (int32_t)(millis() - deadline) >= 0;
+}
+
+// Run callback in delayMs, then every period ms if period is not 0
+void schedAt(SchedTaskId id, uint32_t delayMs, SchedCallback callback, uint32_t period = 0)
+{
+  SCHED_LOCK();
+  schedTasks[id].callback = callback;
+  schedTasks[id].due = millis() + delayMs;
+  schedTasks[id].period = period;
+  schedTasks[id].active = true;
+  SCHED_UNLOCK();
+}
+
+void schedCancel(SchedTaskId id)
+{
+  SCHED_LOCK();
+  schedTasks[id].active = false;
+  SCHED_UNLOCK();
+}
+
+bool schedPending(SchedTaskId id)
+{
+  return schedTasks[id].active;
+}
+
+// Run due tasks, a callback can arm or cancel any slot including its own
+void schedRun()
+{
+  for (uint8_t id = 0; id < TASK_COUNT; id++)
+  {
+    SchedCallback callback = nullptr;
+    SCHED_LOCK();
+    SchedTask &task = schedTasks[id];
+    if (task.active && (int32_t)(millis() - task.due) >= 0)
+    {
+      callback = task.callback;
+      if (task.period)
+        task.due += task.period * (1 + (millis() - task.due) / task.period); // skip missed runs, no burst
+      else
+        task.active = false;
+    }
+    SCHED_UNLOCK();
+    if (callback != nullptr)
+      callback();
+  }
+}
+
+// Milliseconds until the next deadline, at most maxMs
+uint32_t schedIdleMs(uint32_t maxMs)
+{
+  uint32_t idle = maxMs;
+  uint32_t now = millis();
+  SCHED_LOCK();
+  for (uint8_t id = 0; id < TASK_COUNT; id++)
+  {
+    if (!schedTasks[id].active)
+      continue;
+    int32_t left = (int32_t)(schedTasks[id].due - now);
+    if (left <= 0)
+    {
+      idle = 0;
+      break;
+    }
+    if ((uint32_t)left < idle)
+      idle = left;
+  }
+  SCHED_UNLOCK();
+  return idle;
+}
@@ -0,0 +1,362 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Counters, gauges and fixed-bucket histograms any subsystem can record into. A metric is a static object
+// that link itself into the registry when constructed, before setup(), so the registry never change
+// after boot and recording is one atomic add without lock or allocation. A metric can hold a series per
+// label value, like one per unit or per loop stage. Only standard headers are used, the module also build
+// on the host. telemetryFormat() write a series as Prometheus text, a JSON member or a status page line
+// through a write callback a line at a time, /metrics, the debug/telemetry topic and the status page all
+// read the registry.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TELEMETRY_BUCKETS_MAX 8 // with the +Inf one
+#define TELEMETRY_PREFIX "mitsubishi2mqtt_"
+#define TELEMETRY_LINE_SIZE 192 // one HELP line or one sample with the hostname and series labels
+
+#ifdef ESP8266
+// one core and records never come from an ISR, a plain add can not be interrupted by another record
+#define TELEMETRY_ADD(var, n) ((var) += (n))
+#define TELEMETRY_STORE(var, n) ((var) = (n))
+#define TELEMETRY_LOAD(var) (var)
+#else
+#define TELEMETRY_ADD(var, n) __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+#define TELEMETRY_STORE(var, n) __atomic_store_n(&(var), (n), __ATOMIC_RELAXED)
+#define TELEMETRY_LOAD(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#endif
+
+enum TelemetryType : uint8_t
+{
+  TELEMETRY_COUNTER,
+  TELEMETRY_GAUGE,
+  TELEMETRY_HISTOGRAM,
+  TELEMETRY_TYPE_COUNT
+};
+
+static const char *const telemetryTypeName[TELEMETRY_TYPE_COUNT] = {
+    /* TELEMETRY_COUNTER */ "counter",
+    /* TELEMETRY_GAUGE */ "gauge",
+    /* TELEMETRY_HISTOGRAM */ "histogram"};
+
+enum TelemetryFormat : uint8_t
+{
+  TELEMETRY_PROMETHEUS, // HELP and TYPE with the first series, labels go in every sample
+  TELEMETRY_JSON,       // "name":value, a histogram or a labelled metric is an object
+  TELEMETRY_TEXT        // name: value, a histogram give its count and average
+};
+
+// Append text to out, the String or buffer of the caller
+typedef void (*TelemetryWrite)(void *out, const char *text);
+
+struct TelemetryMetric;
+TelemetryMetric *telemetryFirst = nullptr; // registration order, set before any constructor run
+TelemetryMetric **telemetryLast = &telemetryFirst;
+uint8_t telemetryCount = 0;
+uint8_t telemetrySeriesCount = 0; // series of all the metrics, see telemetryAt()
+
+struct TelemetryMetric
+{
+  const char *name; // Prometheus name without TELEMETRY_PREFIX, also the JSON key
+  const char *help;
+  TelemetryType type;
+  uint8_t series;                  // one without label
+  const char *label;               // label name of the series
+  const char *const *labelValues;  // label value of each series, nullptr for a series without the label
+  bool (*present)(uint8_t series); // false for a series not reported, nullptr to report all
+  uint32_t scale;                  // exported value is the recorded one / scale, 1000000 to record us and export s
+  uint8_t buckets;                 // histogram only, the last one is +Inf
+  const uint32_t *bounds;          // upper bound of each bucket but the last
+  uint32_t *value;                 // per series: counter total, gauge as int32_t, histogram count
+  uint64_t *sum;                   // per series, histogram
+  uint32_t *bucket;                // buckets per series, histogram
+  TelemetryMetric *next;
+
+  TelemetryMetric(const char *name, const char *help, TelemetryType type, uint8_t series, uint32_t *value,
+                  const char *label = nullptr, const char *const *labelValues = nullptr, bool (*present)(uint8_t) = nullptr,
+                  uint32_t scale = 1)
+      : name(name), help(help), type(type), series(series), label(label), labelValues(labelValues), present(present),
+        scale(scale), buckets(0), bounds(nullptr), value(value), sum(nullptr), bucket(nullptr), next(nullptr)
+  {
+    *telemetryLast = this;
+    telemetryLast = &next;
+    telemetryCount++;
+    telemetrySeriesCount += series;
+  }
+  TelemetryMetric(const TelemetryMetric &) = delete;
+
+  void record(uint8_t index, uint32_t v)
+  {
+    uint8_t at = 0;
+    while (at < buckets - 1 && v > bounds[at])
+      at++;
+    TELEMETRY_ADD(bucket[index * buckets + at], 1);
+    TELEMETRY_ADD(sum[index], (uint64_t)v);
+    TELEMETRY_ADD(value[index], 1);
+  }
+};
+
+// Sort a window of latencies or readings in place. Insertion sort, the windows hold a few dozen values at most
+template <typename T>
+void telemetrySort(T *values, uint8_t size)
+{
+  for (uint8_t i = 1; i < size; i++)
+  {
+    T value = values[i];
+    uint8_t j = i;
+    for (; j > 0 && values[j - 1] > value; j--)
+      values[j] = values[j - 1];
+    values[j] = value;
+  }
+}
+
+// Nearest rank percentile of a sorted window, size must not be 0. Percent 100 give the max
+template <typename T>
+T telemetryPercentile(const T *sorted, uint8_t size, uint8_t percent)
+{
+  return sorted[(size * percent + 99) / 100 - 1];
+}
+
+struct TelemetryCounter : TelemetryMetric
+{
+  uint32_t total = 0;
+
+  TelemetryCounter(const char *name, const char *help) : TelemetryMetric(name, help, TELEMETRY_COUNTER, 1, &total) {}
+  void add(uint32_t n = 1) { TELEMETRY_ADD(total, n); }
+  uint32_t get() const { return TELEMETRY_LOAD(total); }
+};
+
+struct TelemetryGauge : TelemetryMetric
+{
+  uint32_t current = 0;
+
+  TelemetryGauge(const char *name, const char *help) : TelemetryMetric(name, help, TELEMETRY_GAUGE, 1, &current) {}
+  void set(int32_t v) { TELEMETRY_STORE(current, (uint32_t)v); }
+  int32_t get() const { return (int32_t)TELEMETRY_LOAD(current); }
+};
+
+// N bounds then the +Inf bucket
+template <uint8_t N>
+struct TelemetryHistogram : TelemetryMetric
+{
+  static_assert(N + 1 <= TELEMETRY_BUCKETS_MAX, "too many telemetry buckets");
+  uint32_t count = 0;
+  uint64_t total = 0;
+  uint32_t counts[N + 1] = {};
+
+  TelemetryHistogram(const char *name, const char *help, const uint32_t (&bounds)[N], uint32_t scale = 1)
+      : TelemetryMetric(name, help, TELEMETRY_HISTOGRAM, 1, &count, nullptr, nullptr, nullptr, scale)
+  {
+    this->buckets = N + 1;
+    this->bounds = bounds;
+    this->sum = &total;
+    this->bucket = counts;
+  }
+  void record(uint32_t v) { TelemetryMetric::record(0, v); }
+};
+
+// A counter per label value
+template <uint8_t S>
+struct TelemetryCounterSet : TelemetryMetric
+{
+  uint32_t totals[S] = {};
+
+  TelemetryCounterSet(const char *name, const char *help, const char *label, const char *const *labelValues,
+                      bool (*present)(uint8_t) = nullptr)
+      : TelemetryMetric(name, help, TELEMETRY_COUNTER, S, totals, label, labelValues, present) {}
+  void add(uint8_t index, uint32_t n = 1) { TELEMETRY_ADD(totals[index], n); }
+  uint32_t get(uint8_t index) const { return TELEMETRY_LOAD(totals[index]); }
+};
+
+// A gauge per label value
+template <uint8_t S>
+struct TelemetryGaugeSet : TelemetryMetric
+{
+  uint32_t current[S] = {};
+
+  TelemetryGaugeSet(const char *name, const char *help, const char *label, const char *const *labelValues, uint32_t scale = 1)
+      : TelemetryMetric(name, help, TELEMETRY_GAUGE, S, current, label, labelValues, nullptr, scale) {}
+  void set(uint8_t index, int32_t v) { TELEMETRY_STORE(current[index], (uint32_t)v); }
+  int32_t get(uint8_t index) const { return (int32_t)TELEMETRY_LOAD(current[index]); }
+};
+
+// A histogram per label value, N bounds then the +Inf bucket
+template <uint8_t S, uint8_t N>
+struct TelemetryHistogramSet : TelemetryMetric
+{
+  static_assert(N + 1 <= TELEMETRY_BUCKETS_MAX, "too many telemetry buckets");
+  uint32_t count[S] = {};
+  uint64_t total[S] = {};
+  uint32_t counts[S][N + 1] = {};
+
+  TelemetryHistogramSet(const char *name, const char *help, const uint32_t (&bounds)[N], uint32_t scale, const char *label,
+                        const char *const *labelValues)
+      : TelemetryMetric(name, help, TELEMETRY_HISTOGRAM, S, count, label, labelValues, nullptr, scale)
+  {
+    this->buckets = N + 1;
+    this->bounds = bounds;
+    this->sum = total;
+    this->bucket = counts[0];
+  }
+};
+
+// Metric holding the series at index, counting every series of every metric in registration order.
+// nullptr past the end
+TelemetryMetric *telemetryAt(uint8_t index, uint8_t &series)
+{
+  TelemetryMetric *metric = telemetryFirst;
+  while (metric != nullptr && index >= metric->series)
+  {
+    index -= metric->series;
+    metric = metric->next;
+  }
+  series = index;
+  return metric;
+}
+
+bool telemetryPresent(const TelemetryMetric &metric, uint8_t series)
+{
+  return series < metric.series && (metric.present == nullptr || metric.present(series));
+}
+
+// printf a line then write it, a longer line is cut
+static void telemetryLine(TelemetryWrite write, void *out, const char *format, ...) __attribute__((format(printf, 3, 4)));
+static void telemetryLine(TelemetryWrite write, void *out, const char *format, ...)
+{
+  char line[TELEMETRY_LINE_SIZE];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  write(out, line);
+}
+
+// Recorded value as exported, an integer unless the metric is scaled
+static void telemetryNumber(char *text, size_t size, double value, uint32_t scale)
+{
+  if (scale == 1)
+    snprintf(text, size, "%.0f", value);
+  else
+    snprintf(text, size, "%.6f", value / scale);
+}
+
+// Write one series of a metric, nothing for a series not present. labels like hostname="x" are for the
+// Prometheus samples. The JSON members of a labelled metric are only valid once all its series are written
+void telemetryFormat(const TelemetryMetric &metric, uint8_t series, TelemetryFormat format, const char *labels,
+                     TelemetryWrite write, void *out)
+{
+  if (!telemetryPresent(metric, series))
+    return;
+  bool first = true;
+  for (uint8_t before = 0; before < series && first; before++)
+    first = !telemetryPresent(metric, before);
+  bool last = true;
+  for (uint8_t after = series + 1; after < metric.series && last; after++)
+    last = !telemetryPresent(metric, after);
+  bool histogram = metric.type == TELEMETRY_HISTOGRAM;
+  uint32_t value = TELEMETRY_LOAD(metric.value[series]);
+  char number[24];
+  if (metric.type == TELEMETRY_GAUGE)
+    telemetryNumber(number, sizeof(number), (int32_t)value, metric.scale);
+  else
+    snprintf(number, sizeof(number), "%lu", (unsigned long)value);
+  uint32_t buckets[TELEMETRY_BUCKETS_MAX];
+  char sum[24] = "";
+  if (histogram)
+  {
+    for (uint8_t index = 0; index < metric.buckets; index++)
+      buckets[index] = TELEMETRY_LOAD(metric.bucket[series * metric.buckets + index]);
+    telemetryNumber(sum, sizeof(sum), (double)TELEMETRY_LOAD(metric.sum[series]), metric.scale);
+  }
+  const char *labelValue = metric.labelValues != nullptr ? metric.labelValues[series] : nullptr;
+  char key[8]; // JSON and text key of a series without label value
+  snprintf(key, sizeof(key), "%u", series + 1);
+  switch (format)
+  {
+  case TELEMETRY_PROMETHEUS:
+  {
+    char sampleLabels[TELEMETRY_LINE_SIZE / 2];
+    if (labelValue != nullptr)
+      snprintf(sampleLabels, sizeof(sampleLabels), "%s%s%s=\"%s\"", labels, *labels ? "," : "", metric.label, labelValue);
+    else
+      snprintf(sampleLabels, sizeof(sampleLabels), "%s", labels);
+    if (first)
+      telemetryLine(write, out, "# HELP " TELEMETRY_PREFIX "%s %s\n# TYPE " TELEMETRY_PREFIX "%s %s\n",
+                    metric.name, metric.help, metric.name, telemetryTypeName[metric.type]);
+    if (!histogram)
+    {
+      telemetryLine(write, out, TELEMETRY_PREFIX "%s{%s} %s\n", metric.name, sampleLabels, number);
+      break;
+    }
+    uint32_t cumulative = 0;
+    for (uint8_t index = 0; index < metric.buckets; index++)
+    {
+      cumulative += buckets[index];
+      char bound[16] = "+Inf";
+      if (index < metric.buckets - 1)
+        snprintf(bound, sizeof(bound), "%g", (double)metric.bounds[index] / metric.scale);
+      telemetryLine(write, out, TELEMETRY_PREFIX "%s_bucket{%s%sle=\"%s\"} %lu\n", metric.name, sampleLabels,
+                    *sampleLabels ? "," : "", bound, (unsigned long)cumulative);
+    }
+    telemetryLine(write, out, TELEMETRY_PREFIX "%s_sum{%s} %s\n", metric.name, sampleLabels, sum);
+    telemetryLine(write, out, TELEMETRY_PREFIX "%s_count{%s} %s\n", metric.name, sampleLabels, number);
+    break;
+  }
+  case TELEMETRY_JSON:
+    if (first)
+      telemetryLine(write, out, "\"%s\":%s", metric.name, metric.label != nullptr ? "{" : "");
+    if (metric.label != nullptr)
+      telemetryLine(write, out, "%s\"%s\":", first ? "" : ",", labelValue != nullptr ? labelValue : key);
+    if (!histogram)
+      write(out, number);
+    else
+    {
+      telemetryLine(write, out, "{\"count\":%s,\"sum\":%s,\"le\":[", number, sum);
+      for (uint8_t index = 0; index < metric.buckets - 1; index++)
+        telemetryLine(write, out, "%s%g", index ? "," : "", (double)metric.bounds[index] / metric.scale);
+      write(out, "],\"hist\":[");
+      for (uint8_t index = 0; index < metric.buckets; index++)
+        telemetryLine(write, out, "%s%lu", index ? "," : "", (unsigned long)buckets[index]);
+      write(out, "]}");
+    }
+    if (last && metric.label != nullptr)
+      write(out, "}");
+    break;
+  case TELEMETRY_TEXT:
+    if (metric.label != nullptr)
+      telemetryLine(write, out, "%s%s %s: ", first ? "" : ", ", metric.name, labelValue != nullptr ? labelValue : key);
+    else
+      telemetryLine(write, out, "%s: ", metric.name);
+    if (!histogram)
+      write(out, number);
+    else
+    {
+      double average = value ? (double)TELEMETRY_LOAD(metric.sum[series]) / value : 0;
+      telemetryNumber(sum, sizeof(sum), average, metric.scale);
+      telemetryLine(write, out, "%s, avg %s", number, sum);
+    }
+    break;
+  }
+}
+
+// Every series of a metric in format
+void telemetryFormatAll(const TelemetryMetric &metric, TelemetryFormat format, const char *labels, TelemetryWrite write, void *out)
+{
+  for (uint8_t series = 0; series < metric.series; series++)
+    telemetryFormat(metric, series, format, labels, write, out);
+}
@@ -0,0 +1,241 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Remote temperature from several sensor topics, fused on the device. A source is configured as
+// "topic|json.path|weight|timeout_s|unit", only the topic is required: a plain number payload, weight 1,
+// TEMP_FUSION_TIMEOUT_S and the first unit. Each unit keep the running weighted sums of its fresh
+// sources, a reading or a source going stale update them and the fused value go to the remote temp
+// filter of the unit like a remote_temp/set message.
+// The topic and path Strings are set by loop() and read by the MQTT task, they are guarded by a mutex
+// because a String can not be copied in a critical section; the readings and sums use the portMUX.
+
+#define TEMP_FUSION_SOURCES 3
+#define TEMP_FUSION_TIMEOUT_S 600
+#define TEMP_FUSION_TIMEOUT_MAX_S 86400 // a day, keep timeout_s * 1000 in range
+
+struct TempFusionSource
+{
+  String topic; // empty when not configured
+  String path;  // dot separated keys in a JSON payload, empty for a plain number
+  float weight;
+  uint32_t timeoutMs;
+  uint8_t unit;
+  bool fresh;
+  float value; // °C
+  uint32_t receivedAt;
+  uint32_t readings;
+};
+
+TempFusionSource tempFusionSource[TEMP_FUSION_SOURCES];
+float tempFusionWeight[HP_UNIT_MAX];   // sum of the weights of the fresh sources
+float tempFusionWeighted[HP_UNIT_MAX]; // sum of weight * value of the fresh sources
+uint8_t tempFusionFresh[HP_UNIT_MAX];
+bool tempFusionChanged = false; // since the last diagnostics publish
+#ifdef ESP32
+portMUX_TYPE tempFusionMux = portMUX_INITIALIZER_UNLOCKED; // MQTT callback and loop() timer
+#define TEMP_FUSION_LOCK() portENTER_CRITICAL(&tempFusionMux)
+#define TEMP_FUSION_UNLOCK() portEXIT_CRITICAL(&tempFusionMux)
+SemaphoreHandle_t tempFusionConfigMutex = nullptr; // source config, taken before tempFusionMux
+#define TEMP_FUSION_CONFIG_LOCK() xSemaphoreTakeRecursive(tempFusionConfigMutex, portMAX_DELAY)
+#define TEMP_FUSION_CONFIG_UNLOCK() xSemaphoreGiveRecursive(tempFusionConfigMutex)
+#else
+#define TEMP_FUSION_LOCK()
+#define TEMP_FUSION_UNLOCK()
+#define TEMP_FUSION_CONFIG_LOCK()
+#define TEMP_FUSION_CONFIG_UNLOCK()
+#endif
+
+// Field of a source spec, empty when missing
+static String tempFusionField(const String &spec, uint8_t index)
+{
+  int start = 0;
+  for (uint8_t field = 0; field < index; field++)
+  {
+    start = spec.indexOf('|', start);
+    if (start < 0)
+      return String();
+    start++;
+  }
+  int end = spec.indexOf('|', start);
+  return spec.substring(start, end < 0 ? spec.length() : end);
+}
+
+// Empty spec or a valid source
+bool tempFusionSpecValid(const String &spec)
+{
+  if (spec.isEmpty())
+    return true;
+  String weight = tempFusionField(spec, 2);
+  String timeout = tempFusionField(spec, 3);
+  String unit = tempFusionField(spec, 4);
+  return !tempFusionField(spec, 0).isEmpty() && tempFusionField(spec, 0).length() <= 128 &&
+         (weight.isEmpty() || weight.toFloat() > 0) && (timeout.isEmpty() || (timeout.toInt() > 0 && timeout.toInt() <= TEMP_FUSION_TIMEOUT_MAX_S)) &&
+         (unit.isEmpty() || (unit.toInt() >= 1 && unit.toInt() <= HP_UNIT_MAX));
+}
+
+static void tempFusionDrop(TempFusionSource &source)
+{
+  source.fresh = false;
+  tempFusionWeight[source.unit] -= source.weight;
+  tempFusionWeighted[source.unit] -= source.weight * source.value;
+  if (--tempFusionFresh[source.unit] == 0)
+  {
+    tempFusionWeight[source.unit] = 0; // no float drift left behind
+    tempFusionWeighted[source.unit] = 0;
+  }
+}
+
+// Set a source from its spec, tempFusionReset() once all are set. The fields are parsed aside and
+// swapped in under the locks, the MQTT task may be matching a topic meanwhile
+void tempFusionConfigure(uint8_t index, const String &spec)
+{
+  TempFusionSource &source = tempFusionSource[index];
+  String topic = tempFusionSpecValid(spec) ? tempFusionField(spec, 0) : String();
+  String path = tempFusionField(spec, 1);
+  String weight = tempFusionField(spec, 2);
+  String timeout = tempFusionField(spec, 3);
+  String unit = tempFusionField(spec, 4);
+  long timeoutS = timeout.isEmpty() ? TEMP_FUSION_TIMEOUT_S : constrain(timeout.toInt(), 1, TEMP_FUSION_TIMEOUT_MAX_S);
+  long unitIndex = unit.isEmpty() ? 0 : constrain(unit.toInt() - 1, 0, HP_UNIT_MAX - 1);
+  TEMP_FUSION_CONFIG_LOCK();
+  source.topic = topic;
+  source.path = path;
+  TEMP_FUSION_LOCK();
+  if (source.fresh)
+    tempFusionDrop(source); // leave the sums of the old unit and weight clean
+  source.weight = weight.isEmpty() ? 1 : weight.toFloat();
+  source.timeoutMs = timeoutS * 1000;
+  source.unit = unitIndex;
+  TEMP_FUSION_UNLOCK();
+  TEMP_FUSION_CONFIG_UNLOCK();
+}
+
+// Spec of a configured source with all its fields, empty when not configured
+String tempFusionSpec(uint8_t index)
+{
+  const TempFusionSource &source = tempFusionSource[index];
+  String spec;
+  TEMP_FUSION_CONFIG_LOCK();
+  if (!source.topic.isEmpty())
+    spec = source.topic + '|' + source.path + '|' + String(source.weight, 2) + '|' + String(source.timeoutMs / 1000) + '|' + String(source.unit + 1);
+  TEMP_FUSION_CONFIG_UNLOCK();
+  return spec;
+}
+
+// Restart the fusion without readings
+void tempFusionReset()
+{
+  TEMP_FUSION_LOCK();
+  for (uint8_t index = 0; index < TEMP_FUSION_SOURCES; index++)
+  {
+    tempFusionSource[index].fresh = false;
+    tempFusionSource[index].readings = 0;
+  }
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+  {
+    tempFusionWeight[unit] = 0;
+    tempFusionWeighted[unit] = 0;
+    tempFusionFresh[unit] = 0;
+  }
+  tempFusionChanged = true;
+  TEMP_FUSION_UNLOCK();
+}
+
+bool tempFusionConfigured()
+{
+  for (uint8_t index = 0; index < TEMP_FUSION_SOURCES; index++)
+    if (!tempFusionSource[index].topic.isEmpty())
+      return true;
+  return false;
+}
+
+// Source of a topic, -1 if none. Hold TEMP_FUSION_CONFIG_LOCK() until the reading is parsed
+int tempFusionMatch(const char *topic)
+{
+  for (uint8_t index = 0; index < TEMP_FUSION_SOURCES; index++)
+    if (!tempFusionSource[index].topic.isEmpty() && tempFusionSource[index].topic == topic)
+      return index;
+  return -1;
+}
+
+// Reading of a payload, a number or the value at the source path of a JSON document
+bool tempFusionParse(uint8_t index, const char *message, float &value)
+{
+  const String &path = tempFusionSource[index].path;
+  if (path.isEmpty())
+  {
+    char *end;
+    value = strtof(message, &end);
+    return end != message;
+  }
+  DynamicJsonDocument doc(JSON_OBJECT_SIZE(16) + 256);
+  if (deserializeJson(doc, message) != DeserializationError::Ok)
+    return false;
+  JsonVariant node = doc.as<JsonVariant>();
+  int start = 0;
+  while (start >= 0 && !node.isNull())
+  {
+    int end = path.indexOf('.', start);
+    node = node[path.substring(start, end < 0 ? path.length() : end)];
+    start = end < 0 ? -1 : end + 1;
+  }
+  if (!node.is<float>())
+    return false;
+  value = node.as<float>();
+  return true;
+}
+
+// A reading in °C of a source. Return its unit and the fused value
+uint8_t tempFusionReading(uint8_t index, float celsius, float &fused)
+{
+  TempFusionSource &source = tempFusionSource[index];
+  TEMP_FUSION_LOCK();
+  if (source.fresh)
+    tempFusionDrop(source);
+  source.fresh = true;
+  source.value = celsius;
+  source.receivedAt = millis();
+  source.readings++;
+  tempFusionWeight[source.unit] += source.weight;
+  tempFusionWeighted[source.unit] += source.weight * celsius;
+  tempFusionFresh[source.unit]++;
+  fused = tempFusionWeighted[source.unit] / tempFusionWeight[source.unit];
+  tempFusionChanged = true;
+  TEMP_FUSION_UNLOCK();
+  return source.unit;
+}
+
+// Drop the stale sources, return the units whose fused value changed as bits. fused get the new value
+// of these units, NAN for a unit left without fresh source
+uint8_t tempFusionExpire(float fused[HP_UNIT_MAX])
+{
+  uint8_t changed = 0;
+  TEMP_FUSION_LOCK();
+  for (uint8_t index = 0; index < TEMP_FUSION_SOURCES; index++)
+  {
+    TempFusionSource &source = tempFusionSource[index];
+    if (source.fresh && millis() - source.receivedAt >= source.timeoutMs)
+    {
+      tempFusionDrop(source);
+      changed |= 1 << source.unit;
+    }
+  }
+  for (uint8_t unit = 0; unit < HP_UNIT_MAX; unit++)
+    fused[unit] = tempFusionFresh[unit] ? tempFusionWeighted[unit] / tempFusionWeight[unit] : NAN;
+  if (changed)
+    tempFusionChanged = true;
+  TEMP_FUSION_UNLOCK();
+  return changed;
+}
@@ -0,0 +1,240 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Web socket and event source clients. Each channel admit up to webClientsMax clients, a new client
+// over it is closed at connect. A client with WEB_CLIENT_SLOW_QUEUE messages still queued is slow and
+// webSlowPolicy decide: drop skip the messages to it, a skipped client is marked stale and get the whole
+// latest state once its queue drained, so only the older states are lost; disconnect close it.
+// The web server task add and remove clients, loop() send to them. On ESP32 both hold the mutex so a
+// client is not deleted while loop() use it.
+
+#define WEB_CLIENTS_MAX 8       // per channel, upper bound of the setting
+#define WEB_CLIENT_SLOW_QUEUE 4 // queued messages
+
+enum WebChannel : uint8_t
+{
+  WEB_CHANNEL_WS,
+  WEB_CHANNEL_EVENTS,
+  WEB_CHANNEL_COUNT
+};
+
+static const char *const webChannelName[WEB_CHANNEL_COUNT] = {
+    /* WEB_CHANNEL_WS */ "ws",
+    /* WEB_CHANNEL_EVENTS */ "events"};
+
+enum WebSlowPolicy : uint8_t
+{
+  WEB_SLOW_DROP,
+  WEB_SLOW_DISCONNECT,
+  WEB_SLOW_POLICY_COUNT
+};
+
+static const char *const webSlowPolicyName[WEB_SLOW_POLICY_COUNT] = {
+    /* WEB_SLOW_DROP */ "drop",
+    /* WEB_SLOW_DISCONNECT */ "disconnect"};
+
+// One message of a state, event is for the event source
+struct WebMessage
+{
+  const char *message;
+  const char *event;
+};
+
+struct WebClientTable
+{
+  void *client[WEB_CLIENTS_MAX]; // AsyncWebSocketClient or AsyncEventSourceClient, nullptr when free
+  bool stale[WEB_CLIENTS_MAX];   // client that missed a message
+};
+
+// others config, see loadOthers()
+#ifdef ESP32
+uint8_t webClientsMax[WEB_CHANNEL_COUNT] = {4, 4};
+#else
+uint8_t webClientsMax[WEB_CHANNEL_COUNT] = {2, 2};
+#endif
+WebSlowPolicy webSlowPolicy = WEB_SLOW_DROP;
+
+WebClientTable webClients[WEB_CHANNEL_COUNT];
+TelemetryCounterSet<WEB_CHANNEL_COUNT> webClientRejected("web_client_rejected_total", "Web clients closed at connect, the channel was full",
+                                                         "channel", webChannelName);
+TelemetryCounterSet<WEB_CHANNEL_COUNT> webClientDropped("web_client_dropped_total", "Messages skipped to slow web clients", "channel", webChannelName);
+TelemetryCounterSet<WEB_CHANNEL_COUNT> webClientClosed("web_client_closed_total", "Slow web clients disconnected", "channel", webChannelName);
+// Sampled by telemetryRefresh()
+TelemetryGaugeSet<WEB_CHANNEL_COUNT> webClientsGauge("web_clients", "Connected web clients", "channel", webChannelName);
+TelemetryGaugeSet<WEB_CHANNEL_COUNT> webClientQueuedGauge("web_client_queued_messages", "Messages queued to the web clients", "channel", webChannelName);
+bool webClientsStale[WEB_CHANNEL_COUNT] = {}; // a stale flag is set
+#ifdef ESP32
+SemaphoreHandle_t webClientsMutex = nullptr;
+#define WEB_CLIENTS_LOCK() xSemaphoreTakeRecursive(webClientsMutex, portMAX_DELAY)
+#define WEB_CLIENTS_UNLOCK() xSemaphoreGiveRecursive(webClientsMutex)
+#else
+#define WEB_CLIENTS_LOCK()
+#define WEB_CLIENTS_UNLOCK()
+#endif
+
+WebSlowPolicy webSlowPolicyFromName(const String &name)
+{
+  for (uint8_t policy = 0; policy < WEB_SLOW_POLICY_COUNT; policy++)
+    if (name == webSlowPolicyName[policy])
+      return (WebSlowPolicy)policy;
+  return WEB_SLOW_DROP;
+}
+
+// A client connected, false when the channel is full and the client must be closed
+bool webClientAdd(WebChannel channel, void *client)
+{
+  bool added = false;
+  WEB_CLIENTS_LOCK();
+  WebClientTable &table = webClients[channel];
+  uint8_t count = 0;
+  int8_t free = -1;
+  for (uint8_t slot = 0; slot < WEB_CLIENTS_MAX; slot++)
+  {
+    if (table.client[slot] != nullptr)
+      count++;
+    else if (free < 0)
+      free = slot;
+  }
+  if (free >= 0 && count < webClientsMax[channel])
+  {
+    table.client[free] = client;
+    table.stale[free] = false;
+    added = true;
+  }
+  else
+  {
+    webClientRejected.add(channel);
+  }
+  WEB_CLIENTS_UNLOCK();
+  return added;
+}
+
+void webClientRemove(WebChannel channel, void *client)
+{
+  WEB_CLIENTS_LOCK();
+  WebClientTable &table = webClients[channel];
+  for (uint8_t slot = 0; slot < WEB_CLIENTS_MAX; slot++)
+    if (table.client[slot] == client)
+      table.client[slot] = nullptr;
+  WEB_CLIENTS_UNLOCK();
+}
+
+uint8_t webClientCount(WebChannel channel)
+{
+  uint8_t count = 0;
+  WEB_CLIENTS_LOCK();
+  for (uint8_t slot = 0; slot < WEB_CLIENTS_MAX; slot++)
+    if (webClients[channel].client[slot] != nullptr)
+      count++;
+  WEB_CLIENTS_UNLOCK();
+  return count;
+}
+
+static size_t webClientQueue(WebChannel channel, void *client)
+{
+  if (channel == WEB_CHANNEL_WS)
+    return ((AsyncWebSocketClient *)client)->queueLen();
+  return ((AsyncEventSourceClient *)client)->packetsWaiting();
+}
+
+// Messages still queued to the clients of a channel
+size_t webClientQueued(WebChannel channel)
+{
+  size_t queued = 0;
+  WEB_CLIENTS_LOCK();
+  for (uint8_t slot = 0; slot < WEB_CLIENTS_MAX; slot++)
+    if (webClients[channel].client[slot] != nullptr)
+      queued += webClientQueue(channel, webClients[channel].client[slot]);
+  WEB_CLIENTS_UNLOCK();
+  return queued;
+}
+
+// Send to each client of a channel, event and id are for the event source
+void webClientsSend(WebChannel channel, const char *message, const char *event = nullptr, uint32_t id = 0)
+{
+  WEB_CLIENTS_LOCK();
+  WebClientTable &table = webClients[channel];
+  for (uint8_t slot = 0; slot < WEB_CLIENTS_MAX; slot++)
+  {
+    void *client = table.client[slot];
+    if (client == nullptr)
+      continue;
+    if (webClientQueue(channel, client) >= WEB_CLIENT_SLOW_QUEUE)
+    {
+      if (webSlowPolicy == WEB_SLOW_DISCONNECT)
+      {
+        table.client[slot] = nullptr; // not used after close(), it may delete the client
+        webClientClosed.add(channel);
+        if (channel == WEB_CHANNEL_WS)
+          ((AsyncWebSocketClient *)client)->close();
+        else
+          ((AsyncEventSourceClient *)client)->close();
+      }
+      else
+      {
+        webClientDropped.add(channel);
+        table.stale[slot] = webClientsStale[channel] = true;
+      }
+      continue;
+    }
+    table.stale[slot] = false;
+    if (channel == WEB_CHANNEL_WS)
+      ((AsyncWebSocketClient *)client)->text(message);
+    else
+      ((AsyncEventSourceClient *)client)->send(message, event, id);
+  }
+  WEB_CLIENTS_UNLOCK();
+}
+
+// A stale client of a channel has drained its queue and can take the latest state
+bool webClientsStaleReady(WebChannel channel)
+{
+  bool ready = false;
+  WEB_CLIENTS_LOCK();
+  WebClientTable &table = webClients[channel];
+  webClientsStale[channel] = false;
+  for (uint8_t slot = 0; slot < WEB_CLIENTS_MAX; slot++)
+  {
+    if (table.client[slot] == nullptr || !table.stale[slot])
+      continue;
+    webClientsStale[channel] = true;
+    if (webClientQueue(channel, table.client[slot]) == 0)
+      ready = true;
+  }
+  WEB_CLIENTS_UNLOCK();
+  return ready;
+}
+
+// Send the whole latest state, all its messages, to the stale clients of a channel with a drained queue
+void webClientsSendStale(WebChannel channel, const WebMessage *messages, uint8_t count)
+{
+  WEB_CLIENTS_LOCK();
+  WebClientTable &table = webClients[channel];
+  for (uint8_t slot = 0; slot < WEB_CLIENTS_MAX; slot++)
+  {
+    void *client = table.client[slot];
+    if (client == nullptr || !table.stale[slot] || webClientQueue(channel, client) > 0)
+      continue;
+    table.stale[slot] = false;
+    for (uint8_t index = 0; index < count; index++)
+    {
+      if (channel == WEB_CHANNEL_WS)
+        ((AsyncWebSocketClient *)client)->text(messages[index].message);
+      else
+        ((AsyncEventSourceClient *)client)->send(messages[index].message, messages[index].event, millis());
+    }
+  }
+  WEB_CLIENTS_UNLOCK();
+}
@@ -0,0 +1,101 @@
+/*
+  mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+  Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+// Web socket message reassembly. A message in one frame is used in place from the frame buffer, a
+// message split into frames or packets is copied into a slot of its client until its last byte. The
+// slots are a fixed pool, taken by a client only while one of its messages is in flight, a message
+// longer than WS_MESSAGE_MAX or without free slot is dropped and counted. Web server task only.
+
+#ifdef ESP32
+#define WS_MESSAGE_SLOTS 4
+#else
+#define WS_MESSAGE_SLOTS 2
+#endif
+#define WS_MESSAGE_MAX 256
+
+struct WsMessageSlot
+{
+  uint32_t clientId; // 0 when free
+  uint16_t length;
+  bool overflow; // message too long, the rest of it is skipped
+  char data[WS_MESSAGE_MAX + 1];
+};
+
+WsMessageSlot wsMessageSlot[WS_MESSAGE_SLOTS];
+uint32_t wsMessageDropped = 0;
+
+static WsMessageSlot *wsMessageFind(uint32_t clientId)
+{
+  for (uint8_t index = 0; index < WS_MESSAGE_SLOTS; index++)
+    if (wsMessageSlot[index].clientId == clientId)
+      return &wsMessageSlot[index];
+  return nullptr;
+}
+
+// Client gone, free its slot
+void wsMessageRelease(uint32_t clientId)
+{
+  WsMessageSlot *slot = wsMessageFind(clientId);
+  if (slot != nullptr)
+    slot->clientId = 0;
+}
+
+// Data of a WS_EVT_DATA event. Return the whole message once its last byte arrived, nullptr before
+// or when it was dropped. The pointer is valid until the next data event, null terminated like the
+// single frame buffer of the library
+char *wsMessageFeed(uint32_t clientId, const AwsFrameInfo *info, uint8_t *data, size_t len, size_t &length)
+{
+  if (info->final && info->index == 0 && info->len == len)
+  {
+    length = len;
+    return (char *)data;
+  }
+  WsMessageSlot *slot = wsMessageFind(clientId);
+  if (info->num == 0 && info->index == 0) // first bytes of a message
+  {
+    if (slot == nullptr)
+      slot = wsMessageFind(0);
+    if (slot == nullptr)
+    {
+      wsMessageDropped++;
+      return nullptr;
+    }
+    slot->clientId = clientId;
+    slot->length = 0;
+    slot->overflow = false;
+  }
+  if (slot == nullptr) // start was dropped
+    return nullptr;
+  if (!slot->overflow && slot->length + len <= WS_MESSAGE_MAX)
+  {
+    memcpy(slot->data + slot->length, data, len);
+    slot->length += len;
+  }
+  else
+  {
+    slot->overflow = true;
+  }
+  if (!info->final || info->index + len != info->len)
+    return nullptr;
+  slot->clientId = 0; // message complete, the data stay valid until the slot is taken again
+  if (slot->overflow)
+  {
+    wsMessageDropped++;
+    return nullptr;
+  }
+  slot->data[slot->length] = '\0';
+  length = slot->length;
+  return slot->data;
+}
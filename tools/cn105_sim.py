@@ -0,0 +1,370 @@
+#!/usr/bin/env python3
+#
+# mitsubishi2mqtt - Mitsubishi Heat Pump to MQTT control for Home Assistant.
+# Copyright (c) 2023 by Pham Viet Dzung @dzungpv. All right reserved.
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# Virtual CN105 indoor unit for bench runs without a heat pump, a protocol fixture for the real
+# firmware on a board rather than a host model of it.
+#
+# Wire the board HP_TX/HP_RX to a 3.3V USB-UART adapter and run:
+#   tools/cn105_sim.py --port /dev/ttyUSB0
+#
+# The unit answers connect, info (settings, room temp, status) and set
+# (settings, remote temp) packets, other packets get an empty reply.
+# --delay-ms, --loss and --corrupt shape the replies.
+# --script runs timed changes made on the unit side, one per line:
+#   <seconds> <field>=<value> ...   fields: power mode temp fan vane wide_vane room_temp freq operating
+#
+# With --mqtt and --prefix (mqtt topic/friendly name of the device) it sends --latency temp/set
+# messages through the broker and reports MQTT set -> serial set packet -> state publish times.
+# --command remote_temp sends remote_temp/set instead and checks the traces on debug/latency:
+# each one must be stamped sent before ack. Set rt_filter none and rt_interval 0 on the device
+# first, else the filter and the rate limit hold most readings back.
+# The latency mode needs paho-mqtt.
+
+import argparse
+import os
+import random
+import select
+import sys
+import termios
+import threading
+import time
+
+HEADER_LEN = 5
+DATA_LEN = 16
+
+PKT_SET = 0x41
+PKT_GET = 0x42
+PKT_CONNECT = 0x5A
+PKT_CONNECT_FAST = 0x5B
+
+SET_SETTINGS = 0x01
+SET_REMOTE_TEMP = 0x07
+INFO_SETTINGS = 0x02
+INFO_ROOM_TEMP = 0x03
+INFO_STATUS = 0x06
+
+MODES = {"HEAT": 1, "DRY": 2, "COOL": 3, "FAN": 7, "AUTO": 8}
+FANS = {"AUTO": 0, "QUIET": 1, "1": 2, "2": 3, "3": 5, "4": 6}
+VANES = {"AUTO": 0, "1": 1, "2": 2, "3": 3, "4": 4, "5": 5, "SWING": 7}
+WIDE_VANES = {"<<": 1, "<": 2, "|": 3, ">": 4, ">>": 5, "<>": 8, "SWING": 12}
+
+
+def checksum(data):
+    return (0xFC - sum(data)) & 0xFF
+
+
+def packet(kind, data):
+    body = bytes([0xFC, kind, 0x01, 0x30, len(data)]) + bytes(data)
+    return body + bytes([checksum(body)])
+
+
+def encode_temp(temp):
+    return int(round(temp * 2)) + 128
+
+
+def decode_temp(value):
+    return (value - 128) / 2.0
+
+
+class Unit:
+    """State of the indoor unit, the fields are the raw CN105 codes"""
+
+    def __init__(self):
+        self.power = 0
+        self.mode = MODES["COOL"]
+        self.temp = 24.0
+        self.fan = FANS["AUTO"]
+        self.vane = VANES["AUTO"]
+        self.wide_vane = WIDE_VANES["|"]
+        self.room_temp = 26.0
+        self.remote_temp = None
+        self.freq = 0
+        self.operating = 0
+        self.lock = threading.Lock()
+
+    def apply(self, field, value):
+        tables = {"mode": MODES, "fan": FANS, "vane": VANES, "wide_vane": WIDE_VANES}
+        with self.lock:
+            if field == "power":
+                self.power = 1 if value.upper() == "ON" else 0
+            elif field in tables:
+                setattr(self, field, tables[field][value.upper()])
+            elif field in ("temp", "room_temp"):
+                setattr(self, field, float(value))
+            elif field in ("freq", "operating"):
+                setattr(self, field, int(value))
+            else:
+                raise ValueError("unknown field " + field)
+
+    def info(self, code):
+        data = [0] * DATA_LEN
+        data[0] = code
+        with self.lock:
+            if code == INFO_SETTINGS:
+                data[3] = self.power
+                data[4] = self.mode
+                data[5] = max(0, min(15, 31 - int(self.temp)))
+                data[6] = self.fan
+                data[7] = self.vane
+                data[10] = self.wide_vane
+                data[11] = encode_temp(self.temp)
+            elif code == INFO_ROOM_TEMP:
+                room = self.remote_temp if self.remote_temp is not None else self.room_temp
+                data[3] = max(0, min(31, int(room) - 10))
+                data[6] = encode_temp(room)
+            elif code == INFO_STATUS:
+                data[3] = self.freq
+                data[4] = self.operating
+        return data
+
+    def set(self, data):
+        with self.lock:
+            if data[0] == SET_SETTINGS:
+                if data[1] & 0x01:
+                    self.power = data[3]
+                if data[1] & 0x02:
+                    self.mode = data[4]
+                if data[1] & 0x04:
+                    self.temp = decode_temp(data[14]) if data[14] else 31 - data[5]
+                if data[1] & 0x08:
+                    self.fan = data[6]
+                if data[1] & 0x10:
+                    self.vane = data[7]
+                if data[2] & 0x01:
+                    self.wide_vane = data[13]
+                return "settings"
+            if data[0] == SET_REMOTE_TEMP:
+                if data[1] & 0x01:
+                    self.remote_temp = decode_temp(data[3]) if data[3] else data[2] / 2.0 + 8
+                else:
+                    self.remote_temp = None
+                return "remote_temp"
+        return None
+
+
+class Link:
+    """Serial side: frame parser and reply shaping"""
+
+    def __init__(self, fd, unit, args, on_set=None):
+        self.fd = fd
+        self.unit = unit
+        self.args = args
+        self.on_set = on_set
+        self.buf = bytearray()
+        self.counts = {"rx": 0, "bad": 0, "lost": 0, "corrupt": 0}
+
+    def read_frames(self, timeout):
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        if ready:
+            self.buf += os.read(self.fd, 256)
+        frames = []
+        while True:
+            start = self.buf.find(b"\xfc")
+            if start < 0:
+                self.buf.clear()
+                break
+            del self.buf[:start]
+            if len(self.buf) < HEADER_LEN:
+                break
+            end = HEADER_LEN + self.buf[4] + 1
+            if len(self.buf) < end:
+                break
+            frame = bytes(self.buf[:end])
+            if frame[-1] == checksum(frame[:-1]):
+                frames.append(frame)
+                del self.buf[:end]
+            else:
+                self.counts["bad"] += 1
+                del self.buf[:1]
+        return frames
+
+    def reply(self, frame):
+        kind, data = frame[1], frame[HEADER_LEN:-1]
+        if kind == PKT_CONNECT or kind == PKT_CONNECT_FAST:
+            answer = packet(kind + 0x20, [0x00])
+        elif kind == PKT_GET:
+            answer = packet(kind + 0x20, self.unit.info(data[0]))
+        elif kind == PKT_SET:
+            changed = self.unit.set(data)
+            if changed and self.on_set:
+                self.on_set(changed, time.monotonic())
+            answer = packet(kind + 0x20, [0] * DATA_LEN)
+        else:
+            answer = packet(kind + 0x20, [0] * DATA_LEN)
+        if random.random() < self.args.loss:
+            self.counts["lost"] += 1
+            return
+        if random.random() < self.args.corrupt:
+            self.counts["corrupt"] += 1
+            answer = bytearray(answer)
+            answer[random.randrange(1, len(answer))] ^= 1 << random.randrange(8)
+            answer = bytes(answer)
+        if self.args.delay_ms:
+            time.sleep(self.args.delay_ms / 1000.0)
+        os.write(self.fd, answer)
+
+    def serve(self, stop):
+        while not stop.is_set():
+            for frame in self.read_frames(0.05):
+                self.counts["rx"] += 1
+                if self.args.verbose:
+                    print("<", frame.hex(" "), flush=True)
+                self.reply(frame)
+
+
+def open_port(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    attrs = termios.tcgetattr(fd)
+    attrs[0] = 0  # iflag
+    attrs[1] = 0  # oflag
+    attrs[2] = termios.CS8 | termios.PARENB | termios.CREAD | termios.CLOCAL  # 8E1
+    attrs[3] = 0  # lflag
+    attrs[4] = attrs[5] = termios.B2400
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+def run_script(path, unit, stop):
+    start = time.monotonic()
+    with open(path) as lines:
+        for line in lines:
+            line = line.split("#")[0].split()
+            if not line:
+                continue
+            if stop.wait(max(0.0, start + float(line[0]) - time.monotonic())):
+                return
+            for change in line[1:]:
+                field, value = change.split("=", 1)
+                unit.apply(field, value)
+            print("script:", " ".join(line[1:]), flush=True)
+
+
+def percentiles(samples):
+    samples = sorted(samples)
+    pick = lambda p: samples[min(len(samples) - 1, int(p * len(samples)))]
+    return "n=%d p50=%.0f p95=%.0f p99=%.0f max=%.0f ms" % (len(samples), pick(0.5), pick(0.95), pick(0.99), samples[-1])
+
+
+def run_latency(args, stop, events, pending):
+    """pending is shared with the serial side, it stamps "serial" when the set packet arrives"""
+    import json
+
+    import paho.mqtt.client as mqtt
+
+    host, _, port = args.mqtt.partition(":")
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+
+    def on_message(_client, _userdata, msg):
+        try:
+            payload = json.loads(msg.payload)
+        except ValueError:
+            return
+        if msg.topic.endswith("/debug/latency"):
+            if payload.get("cmd") == args.command and "state" not in pending:
+                pending["trace"] = payload.get("ms", {})
+                pending["state"] = time.monotonic()
+                events.set()
+            return
+        try:
+            temp = float(payload.get("temperature"))
+        except (ValueError, TypeError):
+            return
+        if args.command == "temp" and pending.get("target") == temp and "state" not in pending:
+            pending["state"] = time.monotonic()
+            events.set()
+
+    client.on_message = on_message
+    client.connect(host, int(port or 1883))
+    client.subscribe(args.prefix + "/state")
+    client.subscribe(args.prefix + "/debug/latency")
+    client.loop_start()
+    to_serial, to_state, misordered = [], [], 0
+    for i in range(args.latency):
+        if stop.is_set():
+            break
+        target = 20.0 + (i % 2) * 1.5
+        pending.clear()
+        events.clear()
+        pending["target"] = target
+        pending["sent"] = time.monotonic()
+        client.publish(args.prefix + "/" + args.command + "/set", str(target))
+        if events.wait(5.0) and "serial" in pending:
+            to_serial.append((pending["serial"] - pending["sent"]) * 1000)
+            to_state.append((pending["state"] - pending["sent"]) * 1000)
+            trace = pending.get("trace")
+            if trace is not None and not ("sent" in trace and "ack" in trace and trace["sent"] <= trace["ack"]):
+                misordered += 1
+                print("trace without sent before ack:", trace, flush=True)
+        else:
+            print("timeout waiting for state", target, flush=True)
+        time.sleep(args.interval)
+    client.loop_stop()
+    if to_serial:
+        print("mqtt set -> serial set:", percentiles(to_serial))
+        print("mqtt set -> state:     ", percentiles(to_state))
+    if args.command == "remote_temp":
+        print("traces sent -> ack:", "%d of %d out of order" % (misordered, len(to_serial)))
+    stop.set()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Virtual CN105 indoor unit")
+    parser.add_argument("--port", required=True, help="serial device wired to the board HP pins")
+    parser.add_argument("--delay-ms", type=float, default=0, help="reply delay")
+    parser.add_argument("--loss", type=float, default=0, help="probability to drop a reply")
+    parser.add_argument("--corrupt", type=float, default=0, help="probability to flip a bit in a reply")
+    parser.add_argument("--script", help="timed unit side changes")
+    parser.add_argument("--mqtt", help="broker host[:port] for the latency run")
+    parser.add_argument("--user", help="broker user")
+    parser.add_argument("--password", help="broker password")
+    parser.add_argument("--prefix", help="device topic: <mqtt topic>/<friendly name>")
+    parser.add_argument("--latency", type=int, default=50, help="set messages to time")
+    parser.add_argument("--command", choices=["temp", "remote_temp"], default="temp", help="set topic of the latency run")
+    parser.add_argument("--interval", type=float, default=1.0, help="seconds between them")
+    parser.add_argument("-v", "--verbose", action="store_true", help="print received packets")
+    args = parser.parse_args()
+    if args.mqtt and not args.prefix:
+        parser.error("--mqtt needs --prefix")
+
+    unit = Unit()
+    stop = threading.Event()
+    state_seen = threading.Event()
+    pending = {}
+
+    def on_set(kind, at):
+        if kind == ("settings" if args.command == "temp" else "remote_temp") and "target" in pending and "serial" not in pending:
+            pending["serial"] = at
+
+    fd = open_port(args.port)
+    link = Link(fd, unit, args, on_set)
+    workers = []
+    if args.script:
+        workers.append(threading.Thread(target=run_script, args=(args.script, unit, stop), daemon=True))
+    if args.mqtt:
+        workers.append(threading.Thread(target=run_latency, args=(args, stop, state_seen, pending), daemon=True))
+    for worker in workers:
+        worker.start()
+    try:
+        link.serve(stop)
+    except KeyboardInterrupt:
+        stop.set()
+    print("packets:", ", ".join("%s %d" % item for item in link.counts.items()))
+
+
+if __name__ == "__main__":
+    sys.exit(main())